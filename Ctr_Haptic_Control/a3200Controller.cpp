@@ -0,0 +1,150 @@
+#include <vector>
+
+#include "A3200.h"
+#include "a3200Controller.h"
+
+using namespace std;
+
+
+// AXISFAULT_PositionErrorFault: the axis fell too far behind its command.
+static const uint32_t POSITION_ERROR_FAULT = 1u << 0;
+
+struct A3200Controller::Connection {
+	A3200Handle handle = nullptr;
+	// Position feedback, then fault word, for each axis.
+	vector<WORD> itemIndices;
+	vector<STATUSITEM> itemCodes;
+	vector<DWORD> itemExtras;
+	vector<DOUBLE> itemValues;
+};
+
+A3200Controller::A3200Controller(const A3200ControllerConfig& config_) :
+	config{ config_ },
+	connection{ make_unique<Connection>() },
+	axes{ 0, 0, 0 },
+	axisCount{ 0 }
+{
+	for (unsigned int axis = 0; axis < 32 && axisCount < 3; axis++) {
+		if (config.axisMask & (1u << axis)) {
+			axes[axisCount++] = axis;
+		}
+	}
+	for (size_t i = 0; i < axisCount; i++) {
+		connection->itemIndices.push_back(static_cast<WORD>(axes[i]));
+		connection->itemCodes.push_back(STATUSITEM_PositionFeedback);
+		connection->itemIndices.push_back(static_cast<WORD>(axes[i]));
+		connection->itemCodes.push_back(STATUSITEM_AxisFault);
+	}
+	connection->itemExtras.assign(connection->itemIndices.size(), 0);
+	connection->itemValues.assign(connection->itemIndices.size(), 0.0);
+}
+
+A3200Controller::~A3200Controller() {
+	disconnect();
+}
+
+bool A3200Controller::check(bool ok, const char* what) {
+	if (!ok) {
+		char message[256] = "";
+		A3200GetLastErrorString(message, sizeof(message));
+		lock_guard<mutex> guard(errorLock);
+		error = string(what) + ": " + message;
+	}
+	return ok;
+}
+
+string A3200Controller::name() const {
+	return "a3200";
+}
+
+bool A3200Controller::connect() {
+	if (connection->handle) {
+		return true;
+	}
+	if (!check(A3200Connect(&connection->handle) != 0, "A3200Connect")) {
+		connection->handle = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void A3200Controller::disconnect() {
+	if (connection->handle) {
+		A3200Disconnect(connection->handle);
+		connection->handle = nullptr;
+	}
+}
+
+bool A3200Controller::isConnected() const {
+	return connection->handle != nullptr;
+}
+
+bool A3200Controller::enable() {
+	return connection->handle
+		&& check(A3200MotionEnable(connection->handle, TASKID_01, static_cast<AXISMASK>(config.axisMask)) != 0,
+			"A3200MotionEnable");
+}
+
+bool A3200Controller::moveAbsolute(double x, double y, double z, double speed) {
+	DOUBLE positions[3] = { x, y, z };
+	DOUBLE speeds[3] = { speed, speed, speed };
+	return connection->handle
+		&& check(A3200MotionMoveAbs(connection->handle, TASKID_01, static_cast<AXISMASK>(config.axisMask), positions,
+			speeds) != 0, "A3200MotionMoveAbs");
+}
+
+bool A3200Controller::moveIncremental(double dx, double dy, double dz, double speed) {
+	DOUBLE distances[3] = { dx, dy, dz };
+	DOUBLE speeds[3] = { speed, speed, speed };
+	return connection->handle
+		&& check(A3200MotionMoveInc(connection->handle, TASKID_01, static_cast<AXISMASK>(config.axisMask), distances,
+			speeds) != 0, "A3200MotionMoveInc");
+}
+
+bool A3200Controller::setVelocity(double vx, double vy, double vz) {
+	if (!connection->handle) {
+		return false;
+	}
+	const double velocities[3] = { vx, vy, vz };
+	for (size_t i = 0; i < axisCount; i++) {
+		const AXISINDEX axis = static_cast<AXISINDEX>(axes[i]);
+		const bool ok = velocities[i] == 0.0
+			? A3200MotionFreeRunStop(connection->handle, TASKID_01, axis) != 0
+			: A3200MotionFreeRun(connection->handle, TASKID_01, axis, velocities[i]) != 0;
+		if (!check(ok, "A3200MotionFreeRun")) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool A3200Controller::stop() {
+	return connection->handle
+		&& check(A3200MotionAbort(connection->handle, static_cast<AXISMASK>(config.axisMask)) != 0, "A3200MotionAbort");
+}
+
+bool A3200Controller::readFeedback(StageSample& sample) {
+	Connection& c = *connection;
+	if (!c.handle || !check(A3200StatusGetItems(c.handle, static_cast<DWORD>(c.itemIndices.size()), c.itemIndices.data(),
+		c.itemCodes.data(), c.itemExtras.data(), c.itemValues.data()) != 0, "A3200StatusGetItems")) {
+		return false;
+	}
+	double* position[3] = { &sample.x, &sample.y, &sample.z };
+	sample.status = 0;
+	for (size_t i = 0; i < axisCount; i++) {
+		*position[i] = c.itemValues[2 * i];
+		const uint32_t fault = static_cast<uint32_t>(c.itemValues[2 * i + 1]);
+		if (fault != 0) {
+			sample.status |= STAGE_STATUS_FAULT;
+		}
+		if (fault & POSITION_ERROR_FAULT) {
+			sample.status |= STAGE_STATUS_FOLLOWING_ERROR;
+		}
+	}
+	return true;
+}
+
+string A3200Controller::lastError() const {
+	lock_guard<mutex> guard(errorLock);
+	return error;
+}
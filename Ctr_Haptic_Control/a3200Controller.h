@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "imotionController.h"
+
+using namespace std;
+
+
+struct A3200ControllerConfig {
+	// AXISMASK bits of up to three axes, driven as x, y and z in mask order;
+	// e.g. 0x3 for an x-y stage.
+	unsigned int axisMask = 0x3;
+};
+
+// IMotionController over the Aerotech A3200 C library. The SDK types stay
+// in the .cpp so nothing else needs A3200.h. readFeedback() reads position
+// feedback and the fault word of every axis in one A3200StatusGetItems()
+// call; call it from one thread at a time. The C library may be called
+// from several threads on one handle.
+class A3200Controller : public IMotionController {
+
+private:
+	struct Connection;
+
+	A3200ControllerConfig config;
+	unique_ptr<Connection> connection;
+	unsigned int axes[3];
+	size_t axisCount;
+	mutable mutex errorLock;
+	string error;
+
+	bool check(bool ok, const char* what);
+
+public:
+	explicit A3200Controller(const A3200ControllerConfig& config_);
+	~A3200Controller();
+	A3200Controller(const A3200Controller&) = delete;
+	A3200Controller& operator=(const A3200Controller&) = delete;
+
+	string name() const override;
+
+	bool connect() override;
+	void disconnect() override;
+	bool isConnected() const override;
+
+	bool enable() override;
+	bool moveAbsolute(double x, double y, double z, double speed) override;
+	bool moveIncremental(double dx, double dy, double dz, double speed) override;
+	bool setVelocity(double vx, double vy, double vz) override;
+	bool stop() override;
+
+	bool readFeedback(StageSample& sample) override;
+
+	string lastError() const override;
+};
@@ -0,0 +1,213 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Spinnaker.h"
+#include "benchmark.h"
+#include "pixelConvert.h"
+#include "sessionMessages.h"
+#include "sessionReplay.h"
+
+using namespace Spinnaker;
+using namespace std;
+
+
+template <typename F>
+static double timeMs(size_t iterations, F&& body) {
+	body();
+	const auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++) {
+		body();
+	}
+	const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	return elapsed.count() / iterations;
+}
+
+static void printResult(const string& label, double ms, size_t bytes) {
+	cout << "  " << left << setw(28) << label << right << fixed << setprecision(3) << setw(9) << ms << " ms  "
+		 << setprecision(0) << setw(7) << bytes / (ms * 1000.0) << " MB/s" << endl;
+}
+
+void runConversionBenchmark(size_t width, size_t height, size_t iterations) {
+	vector<uint8_t> source(width * height);
+	mt19937 rng(1);
+	for (auto& value : source) {
+		value = static_cast<uint8_t>(rng());
+	}
+	vector<uint8_t> destination(width * height);
+
+	cout << "BayerRG8 -> Mono8, " << width << "x" << height << ", " << iterations << " iterations" << endl;
+
+	try {
+		ImagePtr raw = Image::Create(width, height, 0, 0, PixelFormat_BayerRG8, source.data());
+		const double allocating = timeMs(iterations, [&] {
+			ImagePtr converted = raw->Convert(PixelFormat_Mono8, EDGE_SENSING);
+		});
+		printResult("Image::Convert", allocating, source.size());
+
+		ImagePtr target = Image::Create(width, height, 0, 0, PixelFormat_Mono8, destination.data());
+		const double preallocated = timeMs(iterations, [&] {
+			raw->Convert(target, PixelFormat_Mono8, EDGE_SENSING);
+		});
+		printResult("Image::Convert (into)", preallocated, source.size());
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+	}
+
+	const size_t hardwareThreads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+	vector<size_t> threadCounts{ 1 };
+	if (hardwareThreads > 1) {
+		threadCounts.push_back(hardwareThreads);
+	}
+	const SimdLevel supported = detectSimdLevel();
+	for (size_t threads : threadCounts) {
+		PixelConverter converter(threads);
+		for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 }) {
+			if (static_cast<int>(level) > static_cast<int>(supported)) {
+				break;
+			}
+			converter.setSimdLevel(level);
+			const double ms = timeMs(iterations, [&] {
+				converter.convert(source.data(), width, PixelFormat::BayerRG8,
+					destination.data(), width, PixelFormat::Mono8, width, height);
+			});
+			printResult(string("PixelConverter ") + simdLevelName(level) + " x" + to_string(threads), ms, source.size());
+		}
+	}
+}
+
+static void fillMetadata(medusa::FrameMetadata* metadata, size_t i) {
+	metadata->set_frame_id(i);
+	metadata->set_timestamp(i * 1000);
+	medusa::StageSample* stage = metadata->mutable_stage();
+	stage->set_host_timestamp(i * 1000 + 500);
+	stage->set_x(i * 0.001);
+	stage->set_y(i * 0.002);
+	stage->set_z(1.5);
+}
+
+void runProtobufBenchmark(size_t messages) {
+	static constexpr size_t MESSAGES_PER_RESET = 1024;
+	FrameInfo info;
+	info.width = 3072;
+	info.height = 2048;
+	info.stride = 3072;
+	info.pixelFormat = PixelFormat::BayerRG8;
+	vector<uint8_t> output(256);
+	size_t serialized = 0;
+
+	cout << "FrameMetadata + ControlCommand build + serialize, " << messages << " of each" << endl;
+
+	const double heapMs = timeMs(1, [&] {
+		for (size_t i = 0; i < messages; i++) {
+			medusa::FrameMetadata* metadata = makeFrameMetadata(nullptr, 0, "flir-0", info);
+			fillMetadata(metadata, i);
+			metadata->SerializeToArray(output.data(), static_cast<int>(output.size()));
+			serialized += metadata->ByteSizeLong();
+			delete metadata;
+			medusa::ControlCommand* command = makeControlCommand(nullptr, i, i * 1000 + 800,
+				medusa::ControlCommand::VELOCITY, i * 0.001, 0.0, 0.0, 0.0, i);
+			command->SerializeToArray(output.data(), static_cast<int>(output.size()));
+			serialized += command->ByteSizeLong();
+			delete command;
+		}
+	});
+
+	// The first block comes from the caller, so once the arena has been
+	// reset it hands out memory without calling the allocator at all.
+	vector<char> block(MESSAGES_PER_RESET * 384);
+	google::protobuf::ArenaOptions options;
+	options.initial_block = block.data();
+	options.initial_block_size = block.size();
+	google::protobuf::Arena arena(options);
+	const double arenaMs = timeMs(1, [&] {
+		for (size_t i = 0; i < messages; i++) {
+			if (i % MESSAGES_PER_RESET == 0) {
+				arena.Reset();
+			}
+			medusa::FrameMetadata* metadata = makeFrameMetadata(&arena, 0, "flir-0", info);
+			fillMetadata(metadata, i);
+			metadata->SerializeToArray(output.data(), static_cast<int>(output.size()));
+			serialized += metadata->ByteSizeLong();
+			medusa::ControlCommand* command = makeControlCommand(&arena, i, i * 1000 + 800,
+				medusa::ControlCommand::VELOCITY, i * 0.001, 0.0, 0.0, 0.0, i);
+			command->SerializeToArray(output.data(), static_cast<int>(output.size()));
+			serialized += command->ByteSizeLong();
+		}
+	});
+
+	for (const auto& result : { make_pair("heap", heapMs), make_pair("arena", arenaMs) }) {
+		cout << "  " << left << setw(28) << result.first << right << fixed << setprecision(0) << setw(12)
+			 << 2 * messages / (result.second / 1000.0) << " messages/s" << endl;
+	}
+	// Each timing runs its loop twice, warm-up included.
+	cout << "  average message " << serialized / (8 * messages) << " bytes" << endl;
+}
+
+void runReplayBenchmark(const string& path, double speed) {
+	ReplayConfig config;
+	config.speed = speed;
+	SessionReplay replay(config);
+	if (!replay.open(path)) {
+		return;
+	}
+	cout << "Replaying " << path << " with " << replay.getCameraCount() << " cameras at "
+		 << (speed > 0.0 ? to_string(speed) + "x" : string("max speed")) << endl;
+
+	for (size_t i = 0; i < replay.getCameraCount(); i++) {
+		replay.getCamera(i).startStreaming();
+	}
+	ReplayStage& stage = replay.getStage();
+	stage.startSampling();
+	replay.start();
+
+	Frame frame;
+	StageSample sample;
+	uint64_t processed = 0;
+	uint64_t failed = 0;
+	uint64_t samples = 0;
+	for (;;) {
+		bool idle = true;
+		bool streaming = stage.isSampling();
+		for (size_t i = 0; i < replay.getCameraCount(); i++) {
+			ReplayCamera& camera = replay.getCamera(i);
+			while (camera.tryPopFrame(frame)) {
+				if (frame.converted(PixelFormat::Mono8)) {
+					processed++;
+				}
+				else {
+					failed++;
+				}
+				frame.reset();
+				idle = false;
+			}
+			streaming = streaming || camera.isStreaming();
+		}
+		while (stage.tryPopSample(sample)) {
+			samples++;
+			idle = false;
+		}
+		if (idle) {
+			if (!streaming) {
+				break;
+			}
+			this_thread::yield();
+		}
+	}
+	replay.stop();
+
+	const ReplayStats stats = replay.getStats();
+	cout << "  " << processed << " frames processed (" << failed << " unconvertible), " << samples << " stage samples" << endl;
+	cout << "  " << fixed << setprecision(2) << stats.sessionSeconds << " s of recording in " << stats.wallSeconds
+		 << " s: " << stats.achievedSpeed << "x, " << setprecision(1) << stats.framesPerSecond << " frames/s, dropped "
+		 << stats.framesDropped << " frames and " << stats.stageSamplesDropped << " samples, skipped "
+		 << stats.framesSkipped << " frames" << endl;
+	for (size_t i = 0; i < replay.getCameraCount(); i++) {
+		const CameraStats cameraStats = replay.getCamera(i).getStats();
+		cout << "  " << replay.getCamera(i).name() << ": delivery p99 " << cameraStats.deliveryLatency.p99Us << " us" << endl;
+	}
+}
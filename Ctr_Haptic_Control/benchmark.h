@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Times Image::Convert against PixelConverter for BayerRG8 -> Mono8 at the
+// given frame size, for every SIMD level the CPU supports and for one thread
+// and all hardware threads. Results are printed to stdout.
+void runConversionBenchmark(size_t width, size_t height, size_t iterations);
+
+// Builds and serializes a FrameMetadata message (with a nested stage sample)
+// and a ControlCommand per frame, on the heap and on a reused Arena, and
+// prints messages per second.
+void runProtobufBenchmark(size_t messages);
+
+// Replays a recorded session at speed (0 for as fast as possible) through
+// ReplayCamera/ReplayStage, converting every frame to Mono8 as stand-in
+// processing, and prints the throughput the chain sustained.
+void runReplayBenchmark(const std::string& path, double speed);
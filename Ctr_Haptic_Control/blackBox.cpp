@@ -0,0 +1,454 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "blackBox.h"
+#include "recorder.h"
+#include "utilities.h"
+
+
+const char* triggerReasonName(TriggerReason reason) {
+	switch (reason) {
+	case TriggerReason::Manual:
+		return "manual";
+	case TriggerReason::StageFault:
+		return "stage fault";
+	case TriggerReason::ImageAnomaly:
+		return "image anomaly";
+	}
+	return "unknown";
+}
+
+static size_t windowSlots(double seconds, double rate) {
+	return seconds > 0.0 && rate > 0.0 ? static_cast<size_t>(ceil(seconds * rate)) : 0;
+}
+
+
+BlackBox::Source::Source(const string& name_, size_t frameBytes_, size_t ringCapacity, size_t slotCount_,
+	size_t queueCapacity) :
+	name{ name_ },
+	frameBytes{ frameBytes_ },
+	slotCount{ slotCount_ },
+	pool{ slotCount_, nullptr },
+	queue{ queueCapacity },
+	ring(ringCapacity),
+	ringHead{ 0 },
+	lastStamp{ 0 }
+{}
+
+
+BlackBox::BlackBox(const BlackBoxConfig& config_) :
+	config{ config_ },
+	stageQueue{ config.stageQueueCapacity },
+	stageRing(windowSlots(config.preTriggerSeconds, config.stageRate) + 1),
+	stageHead{ 0 },
+	stageCount{ 0 },
+	stageFault{ false },
+	stageLastStamp{ 0 },
+	detector{ nullptr },
+	running{ false },
+	pendingTrigger{ 0 },
+	flushActive{ false },
+	flushEnd{ 0 },
+	windowClosed{ true },
+	triggers{ 0 },
+	triggersIgnored{ 0 },
+	flushes{ 0 },
+	framesFlushed{ 0 },
+	stageFlushed{ 0 },
+	stageDropped{ 0 },
+	lastReason{ 0 }
+{}
+
+BlackBox::~BlackBox() {
+	stop();
+}
+
+size_t BlackBox::addSource(const string& name, size_t frameBytes, double frameRate) {
+	if (running) {
+		throw logic_error("BlackBox::addSource called after start()");
+	}
+	// The ring holds the pre-trigger window; the rest are slots a flush may
+	// still hold while the ring keeps going through the post-trigger window.
+	const size_t ringCapacity = windowSlots(config.preTriggerSeconds, frameRate) + 1;
+	const size_t slotCount = ringCapacity + windowSlots(config.postTriggerSeconds, frameRate) + 1;
+	sources.push_back(make_unique<Source>(name, frameBytes, ringCapacity, slotCount, config.queueCapacity));
+	return sources.size() - 1;
+}
+
+void BlackBox::setAnomalyDetector(FrameAnomalyDetector* detector_) {
+	if (running) {
+		throw logic_error("BlackBox::setAnomalyDetector called after start()");
+	}
+	detector = detector_;
+}
+
+void BlackBox::capture(size_t index, const Frame& frame) {
+	Source& source = *sources[index];
+	source.captured++;
+	source.lastStamp = frame.info().hostTimestamp;
+
+	// Evict the oldest frame first so its slot can take the new one.
+	Frame& entry = source.ring[source.ringHead];
+	if (entry) {
+		entry.reset();
+		source.ringFrames--;
+	}
+	if (frame.size() > source.frameBytes) {
+		source.skipped++;
+		return;
+	}
+	Frame copy = source.pool.acquire(frame.size(), frame.info());
+	if (!copy) {
+		source.skipped++;
+		return;
+	}
+	memcpy(source.arena.buffers()[copy.slotIndex()], frame.data(), frame.size());
+	entry = copy;
+	source.ringHead = (source.ringHead + 1) % source.ring.size();
+	source.ringFrames++;
+
+	if (flushActive && !windowClosed && copy.info().hostTimestamp <= flushEnd) {
+		forwardFrames.emplace_back(index, copy);
+	}
+	if (detector && detector->isAnomalous(index, copy)) {
+		trigger(TriggerReason::ImageAnomaly);
+	}
+}
+
+void BlackBox::captureStage(const StageSample& sample) {
+	stageLastStamp = sample.hostTimestamp;
+	stageRing[stageHead] = sample;
+	stageHead = (stageHead + 1) % stageRing.size();
+	if (stageCount < stageRing.size()) {
+		stageCount++;
+	}
+
+	if (flushActive && !windowClosed && sample.hostTimestamp <= flushEnd) {
+		forwardStage.push_back(sample);
+	}
+	// Only the start of a fault triggers, not every sample while it lasts.
+	const bool fault = (sample.status & config.stageFaultMask) != 0;
+	if (fault && !stageFault) {
+		trigger(TriggerReason::StageFault);
+	}
+	stageFault = fault;
+}
+
+void BlackBox::beginFlush(uint64_t triggerTime) {
+	const uint64_t preNanos = static_cast<uint64_t>(config.preTriggerSeconds * 1e9);
+	const uint64_t windowStart = triggerTime > preNanos ? triggerTime - preNanos : 0;
+
+	lock_guard<mutex> guard(flushLock);
+	handoffFrames.clear();
+	handoffStage.clear();
+	for (size_t index = 0; index < sources.size(); index++) {
+		const Source& source = *sources[index];
+		const size_t capacity = source.ring.size();
+		for (size_t n = 0; n < capacity; n++) {
+			const Frame& frame = source.ring[(source.ringHead + n) % capacity];
+			if (frame && frame.info().hostTimestamp >= windowStart) {
+				handoffFrames.emplace_back(index, frame);
+			}
+		}
+	}
+	const size_t oldest = (stageHead + stageRing.size() - stageCount) % stageRing.size();
+	for (size_t n = 0; n < stageCount; n++) {
+		const StageSample& sample = stageRing[(oldest + n) % stageRing.size()];
+		if (sample.hostTimestamp >= windowStart) {
+			handoffStage.push_back(sample);
+		}
+	}
+
+	flushEnd = triggerTime + static_cast<uint64_t>(config.postTriggerSeconds * 1e9);
+	windowClosed = false;
+	flushActive = true;
+	pendingTrigger = 0;
+	flushWake.notify_all();
+}
+
+void BlackBox::forward(bool closeWindow) {
+	if (forwardFrames.empty() && forwardStage.empty() && !closeWindow) {
+		return;
+	}
+	lock_guard<mutex> guard(flushLock);
+	for (auto& item : forwardFrames) {
+		handoffFrames.push_back(move(item));
+	}
+	handoffStage.insert(handoffStage.end(), forwardStage.begin(), forwardStage.end());
+	forwardFrames.clear();
+	forwardStage.clear();
+	if (closeWindow) {
+		windowClosed = true;
+	}
+	flushWake.notify_all();
+}
+
+// Each queue is in timestamp order, so once a source has delivered an item
+// stamped past flushEnd nothing it still has queued belongs in the window.
+// Sources that have never delivered do not hold it open; one that has gone
+// quiet holds it for at most the grace period.
+bool BlackBox::windowDrained() const {
+	const uint64_t now = hostNanos();
+	if (now <= flushEnd) {
+		return false;
+	}
+	if (now - flushEnd > static_cast<uint64_t>(config.deliveryGraceSeconds * 1e9)) {
+		return true;
+	}
+	for (const auto& source : sources) {
+		if (source->lastStamp != 0 && source->lastStamp <= flushEnd) {
+			return false;
+		}
+	}
+	return stageLastStamp == 0 || stageLastStamp > flushEnd;
+}
+
+void BlackBox::captureLoop() {
+	static const size_t FRAME_BATCH = 16;
+	static const size_t STAGE_BATCH = 1024;
+	Frame frame;
+	StageSample sample;
+	for (;;) {
+		const bool stopping = !running;
+		size_t work = 0;
+		for (size_t index = 0; index < sources.size(); index++) {
+			for (size_t n = 0; n < FRAME_BATCH && sources[index]->queue.tryPop(frame); n++) {
+				capture(index, frame);
+				frame.reset();
+				work++;
+			}
+		}
+		for (size_t n = 0; n < STAGE_BATCH && stageQueue.tryPop(sample); n++) {
+			captureStage(sample);
+			work++;
+		}
+
+		const uint64_t pending = pendingTrigger;
+		if (pending != 0 && !flushActive) {
+			beginFlush(pending);
+		}
+		if (flushActive && !windowClosed) {
+			forward(stopping || windowDrained());
+		}
+		if (stopping) {
+			break;
+		}
+		if (work == 0) {
+			this_thread::sleep_for(chrono::microseconds(200));
+		}
+	}
+}
+
+void BlackBox::writeFlush(uint64_t index) {
+	char suffix[24];
+	snprintf(suffix, sizeof(suffix), "-%04llu.session", static_cast<unsigned long long>(index));
+	RecorderConfig recorderConfig;
+	recorderConfig.path = config.prefix + suffix;
+	// Deep enough for a whole window, so submitting rarely has to wait.
+	size_t queueCapacity = 0;
+	for (const auto& source : sources) {
+		queueCapacity = source->slotCount > queueCapacity ? source->slotCount : queueCapacity;
+	}
+	recorderConfig.queueCapacity = queueCapacity;
+	recorderConfig.telemetryQueueCapacity = stageRing.size()
+		+ windowSlots(config.postTriggerSeconds, config.stageRate) + 1;
+	Recorder recorder(recorderConfig);
+	for (const auto& source : sources) {
+		recorder.addSource(source->name);
+	}
+	const bool recording = recorder.start();
+	if (!recording) {
+		cout << "Error: unable to write black box flush " << recorderConfig.path << "." << endl;
+	}
+
+	// Frames and samples are held until the recorder has taken them; it is
+	// the flush that waits on the disk, never the capture thread.
+	vector<pair<size_t, Frame>> frames;
+	vector<StageSample> samples;
+	for (;;) {
+		bool closed;
+		{
+			unique_lock<mutex> guard(flushLock);
+			flushWake.wait_for(guard, chrono::milliseconds(10),
+				[this] { return windowClosed || !handoffFrames.empty() || !handoffStage.empty(); });
+			frames.swap(handoffFrames);
+			samples.swap(handoffStage);
+			closed = windowClosed;
+		}
+		for (auto& item : frames) {
+			while (recording && !recorder.submit(item.first, item.second)) {
+				this_thread::sleep_for(chrono::microseconds(200));
+			}
+			if (recording) {
+				framesFlushed++;
+			}
+			item.second.reset();
+		}
+		frames.clear();
+		for (const StageSample& sample : samples) {
+			while (recording && !recorder.submitStage(sample)) {
+				this_thread::sleep_for(chrono::microseconds(200));
+			}
+			if (recording) {
+				stageFlushed++;
+			}
+		}
+		samples.clear();
+		if (closed) {
+			break;
+		}
+	}
+	recorder.stop();
+	if (recording) {
+		flushes++;
+		lock_guard<mutex> guard(pathLock);
+		lastPath = recorderConfig.path;
+	}
+}
+
+void BlackBox::flushLoop() {
+	uint64_t index = 0;
+	for (;;) {
+		{
+			unique_lock<mutex> guard(flushLock);
+			flushWake.wait(guard, [this] { return flushActive || !running; });
+			if (!flushActive) {
+				return;
+			}
+		}
+		writeFlush(index++);
+		flushActive = false;
+	}
+}
+
+bool BlackBox::start() {
+	if (running) {
+		return true;
+	}
+	for (auto& source : sources) {
+		if (!source->arena.allocate(source->frameBytes, source->slotCount, config.hugePages)) {
+			cout << "Error: unable to allocate the black box ring for " << source->name << "." << endl;
+			for (auto& allocated : sources) {
+				allocated->arena.release();
+			}
+			return false;
+		}
+		for (size_t slot = 0; slot < source->slotCount; slot++) {
+			source->pool.bindBuffer(slot, source->arena.buffers()[slot]);
+		}
+		source->ringHead = 0;
+		source->lastStamp = 0;
+	}
+	stageHead = 0;
+	stageCount = 0;
+	stageFault = false;
+	stageLastStamp = 0;
+	pendingTrigger = 0;
+	flushActive = false;
+	windowClosed = true;
+	running = true;
+	flushThread = thread(&BlackBox::flushLoop, this);
+	captureThread = thread(&BlackBox::captureLoop, this);
+	return true;
+}
+
+void BlackBox::stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	// The capture thread closes an open window on its way out, so the flush
+	// thread finishes what it has and exits.
+	if (captureThread.joinable()) {
+		captureThread.join();
+	}
+	{
+		lock_guard<mutex> guard(flushLock);
+		flushWake.notify_all();
+	}
+	if (flushThread.joinable()) {
+		flushThread.join();
+	}
+	Frame frame;
+	for (auto& source : sources) {
+		while (source->queue.tryPop(frame)) {
+			frame.reset();
+		}
+		for (Frame& entry : source->ring) {
+			entry.reset();
+		}
+		source->ringFrames = 0;
+	}
+	StageSample sample;
+	while (stageQueue.tryPop(sample)) {
+	}
+}
+
+bool BlackBox::isRunning() const {
+	return running;
+}
+
+bool BlackBox::submit(size_t source, const Frame& frame) {
+	Source& target = *sources[source];
+	Frame copy = frame;
+	if (!running || !target.queue.tryPush(move(copy))) {
+		target.dropped++;
+		return false;
+	}
+	return true;
+}
+
+bool BlackBox::submitStage(const StageSample& sample) {
+	StageSample copy = sample;
+	if (!running || !stageQueue.tryPush(move(copy))) {
+		stageDropped++;
+		return false;
+	}
+	return true;
+}
+
+bool BlackBox::trigger(TriggerReason reason) {
+	lock_guard<mutex> guard(flushLock);
+	if (!running || flushActive || pendingTrigger != 0) {
+		triggersIgnored++;
+		return false;
+	}
+	pendingTrigger = hostNanos();
+	lastReason = static_cast<int>(reason);
+	triggers++;
+	return true;
+}
+
+bool BlackBox::isFlushing() const {
+	return flushActive || pendingTrigger != 0;
+}
+
+BlackBoxStats BlackBox::getStats() const {
+	BlackBoxStats stats;
+	stats.triggers = triggers;
+	stats.triggersIgnored = triggersIgnored;
+	stats.flushes = flushes;
+	stats.framesFlushed = framesFlushed;
+	stats.stageSamplesFlushed = stageFlushed;
+	stats.stageSamplesDropped = stageDropped;
+	stats.flushing = isFlushing();
+	stats.lastReason = static_cast<TriggerReason>(lastReason.load());
+	stats.ringBytes = stageRing.size() * sizeof(StageSample);
+	for (const auto& source : sources) {
+		BlackBoxSourceStats sourceStats;
+		sourceStats.name = source->name;
+		sourceStats.framesCaptured = source->captured;
+		sourceStats.framesDropped = source->dropped;
+		sourceStats.framesSkipped = source->skipped;
+		sourceStats.ringFrames = source->ringFrames;
+		sourceStats.ringCapacity = source->ring.size();
+		stats.ringBytes += source->arena.getTotalSize();
+		stats.sources.push_back(sourceStats);
+	}
+	lock_guard<mutex> guard(pathLock);
+	stats.lastPath = lastPath;
+	return stats;
+}
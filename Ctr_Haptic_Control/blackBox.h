@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bufferArena.h"
+#include "frame.h"
+#include "ringBuffer.h"
+#include "telemetry.h"
+
+using namespace std;
+
+
+enum class TriggerReason {
+	Manual,
+	StageFault,
+	ImageAnomaly
+};
+
+const char* triggerReasonName(TriggerReason reason);
+
+struct BlackBoxConfig {
+	// Flushes are written to <prefix>-0000.session, <prefix>-0001.session, ...
+	string prefix;
+	double preTriggerSeconds = 10.0;
+	double postTriggerSeconds = 5.0;
+	// Stage samples per second the telemetry ring is sized for.
+	double stageRate = 1000.0;
+	// Frames queued per source, and stage samples, between producers and
+	// the capture thread.
+	size_t queueCapacity = 16;
+	size_t stageQueueCapacity = 1 << 14;
+	// How long past the end of the post-trigger window to keep it open for
+	// items stamped inside it that are still on their way through the
+	// queues. It closes sooner once every source has delivered past the end.
+	double deliveryGraceSeconds = 0.5;
+	// Stage status bits that count as a fault and fire a trigger.
+	uint32_t stageFaultMask = 0;
+	bool hugePages = false;
+};
+
+struct BlackBoxSourceStats {
+	string name;
+	uint64_t framesCaptured = 0;
+	// Refused because the source's queue was full.
+	uint64_t framesDropped = 0;
+	// Not kept because every ring slot was still held by a flush, or the
+	// frame was larger than the slots.
+	uint64_t framesSkipped = 0;
+	size_t ringFrames = 0;
+	size_t ringCapacity = 0;
+};
+
+struct BlackBoxStats {
+	uint64_t triggers = 0;
+	// Fired while a flush was already in progress.
+	uint64_t triggersIgnored = 0;
+	uint64_t flushes = 0;
+	uint64_t framesFlushed = 0;
+	uint64_t stageSamplesFlushed = 0;
+	uint64_t stageSamplesDropped = 0;
+	size_t ringBytes = 0;
+	bool flushing = false;
+	TriggerReason lastReason = TriggerReason::Manual;
+	string lastPath;
+	vector<BlackBoxSourceStats> sources;
+};
+
+// Decides on the capture thread whether a frame should fire a trigger.
+class FrameAnomalyDetector {
+
+public:
+	virtual ~FrameAnomalyDetector() = default;
+	virtual bool isAnomalous(size_t source, const Frame& frame) = 0;
+};
+
+// Keeps the last preTriggerSeconds of every source's frames and of the
+// stage telemetry in RAM, and on a trigger writes that window plus the
+// following postTriggerSeconds to a session file.
+//
+// Frames are copied into preallocated slots by a capture thread, so the
+// camera's buffers go back as soon as they would without the black box.
+// Each source has room for (pre + post) seconds of frames: the pre window
+// lives in the ring, and the post part covers slots a slow flush still
+// holds while the ring moves on. A flush runs on its own thread through a
+// Recorder fed from the ring slots; acquisition never waits on the disk.
+class BlackBox {
+
+private:
+	struct Source {
+		string name;
+		size_t frameBytes;
+		size_t slotCount;
+		BufferArena arena;
+		FramePool pool;
+		RingBuffer<Frame> queue;
+		// Last ringCapacity frames, oldest at ringHead once full.
+		vector<Frame> ring;
+		size_t ringHead;
+		// Host timestamp of the last frame taken off the queue, 0 for none.
+		uint64_t lastStamp;
+
+		atomic<uint64_t> captured{ 0 };
+		atomic<uint64_t> dropped{ 0 };
+		atomic<uint64_t> skipped{ 0 };
+		atomic<size_t> ringFrames{ 0 };
+
+		Source(const string& name_, size_t frameBytes_, size_t ringCapacity, size_t slotCount_, size_t queueCapacity);
+	};
+
+	BlackBoxConfig config;
+	vector<unique_ptr<Source>> sources;
+	RingBuffer<StageSample> stageQueue;
+	vector<StageSample> stageRing;
+	size_t stageHead;
+	size_t stageCount;
+	bool stageFault;
+	uint64_t stageLastStamp;
+	FrameAnomalyDetector* detector;
+
+	thread captureThread;
+	thread flushThread;
+	atomic<bool> running;
+
+	// Set by trigger(), taken up by the capture thread.
+	atomic<uint64_t> pendingTrigger;
+	atomic<bool> flushActive;
+	// Capture thread only: items stamped up to flushEnd go to the flush,
+	// gathered in forward* and handed over once per pass.
+	uint64_t flushEnd;
+	vector<pair<size_t, Frame>> forwardFrames;
+	vector<StageSample> forwardStage;
+
+	// Handed from the capture thread to the flush thread.
+	mutex flushLock;
+	condition_variable flushWake;
+	vector<pair<size_t, Frame>> handoffFrames;
+	vector<StageSample> handoffStage;
+	bool windowClosed;
+
+	atomic<uint64_t> triggers;
+	atomic<uint64_t> triggersIgnored;
+	atomic<uint64_t> flushes;
+	atomic<uint64_t> framesFlushed;
+	atomic<uint64_t> stageFlushed;
+	atomic<uint64_t> stageDropped;
+	atomic<int> lastReason;
+	mutable mutex pathLock;
+	string lastPath;
+
+	void capture(size_t index, const Frame& frame);
+	void captureStage(const StageSample& sample);
+	void beginFlush(uint64_t triggerTime);
+	void forward(bool closeWindow);
+	bool windowDrained() const;
+	void captureLoop();
+	void writeFlush(uint64_t index);
+	void flushLoop();
+
+public:
+	explicit BlackBox(const BlackBoxConfig& config_);
+	~BlackBox();
+	BlackBox(const BlackBox&) = delete;
+	BlackBox& operator=(const BlackBox&) = delete;
+
+	// Add every source before start(). frameBytes is the largest frame the
+	// source delivers. Returns the id used with submit().
+	size_t addSource(const string& name, size_t frameBytes, double frameRate);
+	// Optional; must outlive the black box.
+	void setAnomalyDetector(FrameAnomalyDetector* detector_);
+
+	// Allocates every ring up front; false when the memory is not there.
+	bool start();
+	void stop();
+	bool isRunning() const;
+
+	// One producer thread per source, and one for stage samples. Return
+	// false when the item was dropped.
+	bool submit(size_t source, const Frame& frame);
+	bool submitStage(const StageSample& sample);
+
+	// Any thread. Returns false, and does nothing, while a flush is in
+	// progress.
+	bool trigger(TriggerReason reason = TriggerReason::Manual);
+	bool isFlushing() const;
+
+	BlackBoxStats getStats() const;
+};
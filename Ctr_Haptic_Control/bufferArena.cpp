@@ -0,0 +1,168 @@
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "bufferArena.h"
+
+using namespace std;
+
+// USB3 transfers are 1024-byte packets; buffers that are not a multiple of
+// that can tear.
+static constexpr size_t USB_PACKET_SIZE = 1024;
+
+static size_t roundUp(size_t value, size_t multiple) {
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+
+BufferArena::BufferArena() :
+	memory{ nullptr },
+	bufferSize{ 0 },
+	bufferCount{ 0 },
+	totalSize{ 0 },
+	hugePages{ false }
+{}
+
+BufferArena::~BufferArena() {
+	release();
+}
+
+size_t BufferArena::pageSize() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+size_t BufferArena::hugePageSize() {
+#ifdef _WIN32
+	return GetLargePageMinimum();
+#else
+	return 2 * 1024 * 1024;
+#endif
+}
+
+uint8_t* BufferArena::mapMemory(size_t size, bool huge) {
+#ifdef _WIN32
+	// MEM_LARGE_PAGES needs SeLockMemoryPrivilege; the caller falls back to
+	// normal pages when this fails.
+	const DWORD flags = MEM_RESERVE | MEM_COMMIT | (huge ? MEM_LARGE_PAGES : 0);
+	return static_cast<uint8_t*>(VirtualAlloc(nullptr, size, flags, PAGE_READWRITE));
+#else
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+	if (huge) {
+		flags |= MAP_HUGETLB;
+	}
+#else
+	if (huge) {
+		return nullptr;
+	}
+#endif
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	return p == MAP_FAILED ? nullptr : static_cast<uint8_t*>(p);
+#endif
+}
+
+void BufferArena::unmapMemory(uint8_t* memory, size_t size) {
+#ifdef _WIN32
+	(void)size;
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, size);
+#endif
+}
+
+bool BufferArena::allocate(size_t payloadSize, size_t count, bool useHugePages) {
+	const size_t page = pageSize();
+	const size_t wantedBufferSize = roundUp(roundUp(payloadSize, USB_PACKET_SIZE), page);
+	if (memory && wantedBufferSize <= bufferSize && count == bufferCount) {
+		return true;
+	}
+	release();
+
+	size_t size = wantedBufferSize * count;
+	uint8_t* block = nullptr;
+	bool gotHugePages = false;
+	const size_t huge = hugePageSize();
+	if (useHugePages && huge > 0) {
+		block = mapMemory(roundUp(size, huge), true);
+		if (block) {
+			size = roundUp(size, huge);
+			gotHugePages = true;
+		}
+		else {
+			cout << "Huge pages unavailable, falling back to " << page << "-byte pages." << endl;
+		}
+	}
+	if (!block) {
+		block = mapMemory(size, false);
+	}
+	if (!block) {
+		cout << "Unable to allocate " << size << " bytes for stream buffers." << endl;
+		return false;
+	}
+
+	// Touch every page now so the first frames do not take page faults.
+	for (size_t offset = 0; offset < size; offset += page) {
+		block[offset] = 0;
+	}
+
+	memory = block;
+	bufferSize = wantedBufferSize;
+	bufferCount = count;
+	totalSize = size;
+	hugePages = gotHugePages;
+	bufferPointers.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		bufferPointers[i] = memory + i * bufferSize;
+	}
+	return true;
+}
+
+void BufferArena::release() {
+	if (memory) {
+		unmapMemory(memory, totalSize);
+	}
+	memory = nullptr;
+	bufferSize = 0;
+	bufferCount = 0;
+	totalSize = 0;
+	hugePages = false;
+	bufferPointers.clear();
+}
+
+bool BufferArena::isAllocated() const {
+	return memory != nullptr;
+}
+
+void** BufferArena::buffers() {
+	return bufferPointers.data();
+}
+
+size_t BufferArena::getBufferSize() const {
+	return bufferSize;
+}
+
+size_t BufferArena::getBufferCount() const {
+	return bufferCount;
+}
+
+size_t BufferArena::getTotalSize() const {
+	return totalSize;
+}
+
+bool BufferArena::usesHugePages() const {
+	return hugePages;
+}
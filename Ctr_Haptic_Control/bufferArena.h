@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+
+struct ArenaReport {
+	size_t totalBytes = 0;
+	size_t bufferSize = 0;
+	size_t bufferCount = 0;
+	size_t buffersInUse = 0;
+	size_t peakBuffersInUse = 0;
+	bool hugePages = false;
+};
+
+// Page-aligned block of stream buffers handed to the driver through
+// CameraBase::SetUserBuffers(). The memory is committed and touched once in
+// allocate() so resident size does not grow while streaming.
+class BufferArena {
+
+private:
+	uint8_t* memory;
+	size_t bufferSize;
+	size_t bufferCount;
+	size_t totalSize;
+	bool hugePages;
+	vector<void*> bufferPointers;
+
+	static size_t pageSize();
+	static size_t hugePageSize();
+	static uint8_t* mapMemory(size_t size, bool huge);
+	static void unmapMemory(uint8_t* memory, size_t size);
+
+public:
+	BufferArena();
+	~BufferArena();
+	BufferArena(const BufferArena&) = delete;
+	BufferArena& operator=(const BufferArena&) = delete;
+
+	// Keeps the existing block when it already fits the request.
+	bool allocate(size_t payloadSize, size_t count, bool useHugePages);
+	void release();
+
+	bool isAllocated() const;
+	void** buffers();
+	size_t getBufferSize() const;
+	size_t getBufferCount() const;
+	size_t getTotalSize() const;
+	bool usesHugePages() const;
+};
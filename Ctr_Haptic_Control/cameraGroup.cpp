@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "cameraGroup.h"
+
+
+CameraGroup::CameraGroup(vector<ICamera*> cameras_, MatchMode mode_, uint64_t tolerance_, size_t queueCapacity) :
+	cameras{ move(cameras_) },
+	mode{ mode_ },
+	tolerance{ tolerance_ },
+	pendingLimit{ queueCapacity },
+	pending(cameras.size()),
+	firstFrameId(cameras.size(), 0),
+	lastFrameId(cameras.size(), 0),
+	anchored{ false },
+	discardsSinceSet{ 0 },
+	sets{ queueCapacity },
+	running{ false },
+	setsEmitted{ 0 },
+	setsDropped{ 0 },
+	lastSkew{ 0 },
+	maxSkew{ 0 },
+	totalSkew{ 0 },
+	unmatched{ new atomic<uint64_t>[cameras.size()] }
+{
+	if (cameras.empty() || cameras.size() > FrameSet::MAX_CAMERAS) {
+		throw invalid_argument("CameraGroup needs between 1 and FrameSet::MAX_CAMERAS cameras");
+	}
+	for (size_t i = 0; i < cameras.size(); i++) {
+		unmatched[i] = 0;
+	}
+}
+
+CameraGroup::~CameraGroup() {
+	stop();
+}
+
+void CameraGroup::start() {
+	if (running) {
+		return;
+	}
+	anchored = false;
+	discardsSinceSet = 0;
+	fill(lastFrameId.begin(), lastFrameId.end(), 0);
+	for (ICamera* camera : cameras) {
+		camera->startStreaming();
+	}
+	running = true;
+	matchThread = thread(&CameraGroup::matchLoop, this);
+}
+
+void CameraGroup::stop() {
+	if (!running) {
+		return;
+	}
+	running = false;
+	if (matchThread.joinable()) {
+		matchThread.join();
+	}
+	FrameSet set;
+	while (sets.tryPop(set)) {
+	}
+	set = FrameSet();
+	for (auto& queue : pending) {
+		queue.clear();
+	}
+	for (ICamera* camera : cameras) {
+		camera->stopStreaming();
+	}
+}
+
+uint64_t CameraGroup::keyOf(size_t camera, const Frame& frame) const {
+	if (mode == MatchMode::Timestamp) {
+		return frame.timestamp();
+	}
+	return frame.frameId() - firstFrameId[camera];
+}
+
+bool CameraGroup::pullFrames() {
+	bool pulled = false;
+	Frame frame;
+	for (size_t i = 0; i < cameras.size(); i++) {
+		while (cameras[i]->tryPopFrame(frame)) {
+			// The camera restarted its count; what is pending belongs to
+			// the old one.
+			if (mode == MatchMode::FrameId && frame.frameId() < lastFrameId[i]) {
+				unmatched[i] += pending[i].size();
+				pending[i].clear();
+				anchored = false;
+			}
+			lastFrameId[i] = frame.frameId();
+			if (pending[i].size() == pendingLimit) {
+				pending[i].pop_front();
+				unmatched[i]++;
+			}
+			pending[i].push_back(move(frame));
+			pulled = true;
+		}
+	}
+	return pulled;
+}
+
+// The reference is the head that arrived last; every other camera anchors
+// on its pending frame nearest that in host time, once it has one at or
+// after it, and drops what came before.
+bool CameraGroup::anchor() {
+	size_t reference = 0;
+	for (size_t i = 0; i < cameras.size(); i++) {
+		if (pending[i].empty()) {
+			return false;
+		}
+		if (pending[i].front().info().hostTimestamp > pending[reference].front().info().hostTimestamp) {
+			reference = i;
+		}
+	}
+	const uint64_t target = pending[reference].front().info().hostTimestamp;
+	bool ready = true;
+	for (size_t i = 0; i < cameras.size(); i++) {
+		if (pending[i].back().info().hostTimestamp < target) {
+			// Only the newest of these can still be nearest. Dropping the
+			// rest gives the camera its buffers back to deliver the next.
+			while (pending[i].size() > 1) {
+				pending[i].pop_front();
+				unmatched[i]++;
+			}
+			ready = false;
+		}
+	}
+	if (!ready) {
+		return false;
+	}
+	for (size_t i = 0; i < cameras.size(); i++) {
+		size_t nearest = 0;
+		uint64_t nearestGap = UINT64_MAX;
+		for (size_t n = 0; n < pending[i].size(); n++) {
+			const uint64_t arrival = pending[i][n].info().hostTimestamp;
+			const uint64_t gap = arrival > target ? arrival - target : target - arrival;
+			if (gap < nearestGap) {
+				nearestGap = gap;
+				nearest = n;
+			}
+		}
+		for (size_t n = 0; n < nearest; n++) {
+			pending[i].pop_front();
+			unmatched[i]++;
+		}
+		firstFrameId[i] = pending[i].front().frameId();
+	}
+	anchored = true;
+	discardsSinceSet = 0;
+	return true;
+}
+
+void CameraGroup::matchPending() {
+	if (mode == MatchMode::FrameId && !anchored && !anchor()) {
+		return;
+	}
+	for (;;) {
+		uint64_t newest = 0;
+		for (size_t i = 0; i < cameras.size(); i++) {
+			if (pending[i].empty()) {
+				return;
+			}
+			const uint64_t key = keyOf(i, pending[i].front());
+			if (key > newest) {
+				newest = key;
+			}
+		}
+
+		// Anything older than the newest head by more than the tolerance can
+		// never be matched, since later frames only move forward.
+		bool discarded = false;
+		for (size_t i = 0; i < cameras.size(); i++) {
+			if (keyOf(i, pending[i].front()) + tolerance < newest) {
+				pending[i].pop_front();
+				unmatched[i]++;
+				discarded = true;
+				discardsSinceSet++;
+			}
+		}
+		// IDs that never line up again mean the anchor is off, e.g. a
+		// camera restarted without its count going backwards.
+		if (mode == MatchMode::FrameId && discardsSinceSet >= pendingLimit) {
+			anchored = false;
+			if (!anchor()) {
+				return;
+			}
+			continue;
+		}
+		if (discarded) {
+			continue;
+		}
+
+		FrameSet set;
+		uint64_t oldest = newest;
+		for (size_t i = 0; i < cameras.size(); i++) {
+			const uint64_t key = keyOf(i, pending[i].front());
+			if (key < oldest) {
+				oldest = key;
+			}
+			set.frames[i] = move(pending[i].front());
+			pending[i].pop_front();
+		}
+		set.count = cameras.size();
+		set.index = setsEmitted;
+		set.skew = newest - oldest;
+		discardsSinceSet = 0;
+
+		const uint64_t skew = set.skew;
+		if (!sets.tryPush(move(set))) {
+			setsDropped++;
+			continue;
+		}
+		setsEmitted++;
+		lastSkew = skew;
+		totalSkew += skew;
+		if (skew > maxSkew) {
+			maxSkew = skew;
+		}
+	}
+}
+
+void CameraGroup::matchLoop() {
+	while (running) {
+		if (pullFrames()) {
+			matchPending();
+		}
+		else {
+			this_thread::sleep_for(chrono::microseconds(100));
+		}
+	}
+}
+
+bool CameraGroup::tryPopSet(FrameSet& set) {
+	return sets.tryPop(set);
+}
+
+bool CameraGroup::waitForSet(FrameSet& set, chrono::milliseconds timeout) {
+	const auto deadline = chrono::steady_clock::now() + timeout;
+	while (!sets.tryPop(set)) {
+		if (!running || chrono::steady_clock::now() >= deadline) {
+			return false;
+		}
+		this_thread::yield();
+	}
+	return true;
+}
+
+size_t CameraGroup::size() const {
+	return cameras.size();
+}
+
+CameraGroupStats CameraGroup::getStats() const {
+	CameraGroupStats stats;
+	stats.setsEmitted = setsEmitted;
+	stats.setsDropped = setsDropped;
+	stats.lastSkew = lastSkew;
+	stats.maxSkew = maxSkew;
+	stats.meanSkew = stats.setsEmitted ? static_cast<double>(totalSkew) / stats.setsEmitted : 0.0;
+	for (size_t i = 0; i < cameras.size(); i++) {
+		stats.unmatchedFrames.push_back(unmatched[i]);
+	}
+	return stats;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "icamera.h"
+#include "ringBuffer.h"
+
+using namespace std;
+
+
+enum class MatchMode {
+	Timestamp,
+	FrameId
+};
+
+// One frame per camera, in the order the cameras were given to the group.
+struct FrameSet {
+	static constexpr size_t MAX_CAMERAS = 8;
+
+	array<Frame, MAX_CAMERAS> frames;
+	size_t count = 0;
+	uint64_t index = 0;
+	uint64_t skew = 0;
+};
+
+struct CameraGroupStats {
+	uint64_t setsEmitted = 0;
+	uint64_t setsDropped = 0;
+	uint64_t lastSkew = 0;
+	uint64_t maxSkew = 0;
+	double meanSkew = 0.0;
+	vector<uint64_t> unmatchedFrames;
+};
+
+// Streams every camera at once and matches their frames into FrameSets by
+// camera timestamp (ns) or by frame ID. Frame IDs are counted from an
+// anchor frame per camera: the frames that reached the host closest
+// together once every camera has delivered, so a camera that lost its first
+// frames is not left a frame behind for the whole run. The group anchors
+// again when a camera's IDs go backwards, or when a queue's worth of frames
+// has been dropped without a set going out. Anchoring by arrival assumes
+// the cameras are hardware-triggered and their delivery latencies differ by
+// well under a frame period. Frames with no partner within the tolerance
+// are dropped and counted per camera.
+class CameraGroup {
+
+private:
+	vector<ICamera*> cameras;
+	MatchMode mode;
+	uint64_t tolerance;
+	size_t pendingLimit;
+
+	vector<deque<Frame>> pending;
+	vector<uint64_t> firstFrameId;
+	vector<uint64_t> lastFrameId;
+	bool anchored;
+	size_t discardsSinceSet;
+
+	RingBuffer<FrameSet> sets;
+	thread matchThread;
+	atomic<bool> running;
+
+	atomic<uint64_t> setsEmitted;
+	atomic<uint64_t> setsDropped;
+	atomic<uint64_t> lastSkew;
+	atomic<uint64_t> maxSkew;
+	atomic<uint64_t> totalSkew;
+	unique_ptr<atomic<uint64_t>[]> unmatched;
+
+	uint64_t keyOf(size_t camera, const Frame& frame) const;
+	bool pullFrames();
+	bool anchor();
+	void matchPending();
+	void matchLoop();
+
+public:
+	CameraGroup(vector<ICamera*> cameras_, MatchMode mode_, uint64_t tolerance_, size_t queueCapacity = 32);
+	~CameraGroup();
+	CameraGroup(const CameraGroup&) = delete;
+	CameraGroup& operator=(const CameraGroup&) = delete;
+
+	void start();
+	void stop();
+
+	bool tryPopSet(FrameSet& set);
+	bool waitForSet(FrameSet& set, chrono::milliseconds timeout);
+
+	size_t size() const;
+	CameraGroupStats getStats() const;
+};
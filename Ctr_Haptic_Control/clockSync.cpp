@@ -0,0 +1,206 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "clockSync.h"
+#include "utilities.h"
+
+
+ClockSync::ClockSync(ICameraClock& clock_, const string& name, const ClockSyncConfig& config_) :
+	clock(clock_),
+	clockName{ name },
+	config{ config_ },
+	windowHead{ 0 },
+	rejectedRun{ 0 },
+	synchronised{ false },
+	running{ false }
+{
+	config.window = config.window < 2 ? 2 : config.window;
+	config.minLatches = config.minLatches < 2 ? 2 : config.minLatches > config.window ? config.window : config.minLatches;
+	window.reserve(config.window);
+}
+
+ClockSync::~ClockSync() {
+	stop();
+}
+
+uint64_t ClockSync::convert(const Model& fit, uint64_t cameraTimestamp) {
+	const double ticks = cameraTimestamp >= fit.cameraRef
+		? static_cast<double>(cameraTimestamp - fit.cameraRef) : -static_cast<double>(fit.cameraRef - cameraTimestamp);
+	const double offset = fit.slope * ticks;
+	const double host = static_cast<double>(fit.hostRef) + offset;
+	return host > 0.0 ? fit.hostRef + static_cast<int64_t>(llround(offset)) : 0;
+}
+
+// Least squares over the window, about the oldest point so the sums keep
+// their precision in doubles.
+bool ClockSync::fit(Model& result, double& residualRms, double& residualMax) const {
+	const size_t n = window.size();
+	if (n < 2) {
+		return false;
+	}
+	const Point& origin = window[windowHead % n];
+	double meanCamera = 0.0;
+	double meanHost = 0.0;
+	double span = 0.0;
+	for (const Point& point : window) {
+		const double camera = static_cast<double>(static_cast<int64_t>(point.camera - origin.camera));
+		meanCamera += camera;
+		meanHost += static_cast<double>(static_cast<int64_t>(point.host - origin.host));
+		span = camera > span ? camera : span;
+	}
+	meanCamera /= n;
+	meanHost /= n;
+	double covariance = 0.0;
+	double variance = 0.0;
+	for (const Point& point : window) {
+		const double dc = static_cast<double>(static_cast<int64_t>(point.camera - origin.camera)) - meanCamera;
+		const double dh = static_cast<double>(static_cast<int64_t>(point.host - origin.host)) - meanHost;
+		covariance += dc * dh;
+		variance += dc * dc;
+	}
+	if (variance <= 0.0) {
+		return false;
+	}
+	result.slope = span * config.tickNanos < config.minSlopeSpanSeconds * 1e9 ? config.tickNanos : covariance / variance;
+	result.cameraRef = origin.camera;
+	result.hostRef = origin.host + static_cast<int64_t>(llround(meanHost - result.slope * meanCamera));
+
+	double squares = 0.0;
+	residualMax = 0.0;
+	for (const Point& point : window) {
+		const double residual = static_cast<double>(static_cast<int64_t>(point.host - convert(result, point.camera)));
+		squares += residual * residual;
+		residualMax = fabs(residual) > residualMax ? fabs(residual) : residualMax;
+	}
+	residualRms = sqrt(squares / n) / 1e3;
+	residualMax /= 1e3;
+	return true;
+}
+
+bool ClockSync::latch() {
+	ClockLatch reading;
+	if (!clock.latchTimestamp(reading) || reading.hostAfter < reading.hostBefore) {
+		lock_guard<mutex> guard(modelLock);
+		stats.latchErrors++;
+		return false;
+	}
+	Point point;
+	point.camera = reading.timestamp;
+	point.host = reading.hostBefore + (reading.hostAfter - reading.hostBefore) / 2;
+	point.roundTrip = reading.hostAfter - reading.hostBefore;
+	roundTrip.record(point.roundTrip);
+
+	// A microsecond of slack for clocks read in-process. A run of slow
+	// latches means the link itself got slower, so the run is let through.
+	uint64_t fastest = point.roundTrip;
+	for (const Point& kept : window) {
+		fastest = kept.roundTrip < fastest ? kept.roundTrip : fastest;
+	}
+	if (window.size() >= config.minLatches && rejectedRun < config.minLatches
+		&& point.roundTrip > config.maxRoundTripFactor * fastest + 1000.0) {
+		rejectedRun++;
+		lock_guard<mutex> guard(modelLock);
+		stats.latchesRejected++;
+		return false;
+	}
+	rejectedRun = 0;
+
+	if (window.size() < config.window) {
+		window.push_back(point);
+	}
+	else {
+		window[windowHead] = point;
+		windowHead = (windowHead + 1) % window.size();
+	}
+
+	Model next;
+	double residualRms = 0.0;
+	double residualMax = 0.0;
+	const bool fitted = fit(next, residualRms, residualMax);
+
+	lock_guard<mutex> guard(modelLock);
+	stats.latches++;
+	if (synchronised) {
+		stats.predictionErrorUs = static_cast<double>(static_cast<int64_t>(point.host - convert(model, point.camera))) / 1e3;
+	}
+	if (fitted) {
+		model = next;
+		synchronised = window.size() >= config.minLatches;
+		stats.residualRmsUs = residualRms;
+		stats.residualMaxUs = residualMax;
+		// The slope is host time per tick, so a fast camera has a small one.
+		stats.driftPpm = (config.tickNanos / next.slope - 1.0) * 1e6;
+		stats.offsetNanos = static_cast<int64_t>(convert(next, point.camera))
+			- static_cast<int64_t>(llround(point.camera * config.tickNanos));
+	}
+	return true;
+}
+
+void ClockSync::syncLoop() {
+	const uint64_t periodNanos = static_cast<uint64_t>(config.rate > 0.0 ? 1e9 / config.rate : 1e8);
+	uint64_t next = hostNanos();
+	bool reported = false;
+	while (running) {
+		if (!latch() && !reported && getStats().latchErrors > 0) {
+			cout << "Error: timestamp latch failed on " << clockName << "." << endl;
+			reported = true;
+		}
+		// Back to back until there are enough latches to fit.
+		if (!isSynchronised()) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+			next = hostNanos();
+			continue;
+		}
+		next += periodNanos;
+		// Short steps so stop() is not held up.
+		for (uint64_t now = hostNanos(); running && now < next; now = hostNanos()) {
+			const uint64_t nap = next - now;
+			this_thread::sleep_for(chrono::nanoseconds(nap < 10000000 ? nap : 10000000));
+		}
+	}
+}
+
+void ClockSync::start() {
+	if (running) {
+		return;
+	}
+	running = true;
+	syncThread = thread(&ClockSync::syncLoop, this);
+}
+
+void ClockSync::stop() {
+	running = false;
+	if (syncThread.joinable()) {
+		syncThread.join();
+	}
+}
+
+bool ClockSync::isRunning() const {
+	return running;
+}
+
+bool ClockSync::isSynchronised() const {
+	lock_guard<mutex> guard(modelLock);
+	return synchronised;
+}
+
+bool ClockSync::toHost(uint64_t cameraTimestamp, uint64_t& hostTimestamp) const {
+	lock_guard<mutex> guard(modelLock);
+	if (!synchronised) {
+		return false;
+	}
+	hostTimestamp = convert(model, cameraTimestamp);
+	return true;
+}
+
+ClockSyncStats ClockSync::getStats() const {
+	ClockSyncStats result;
+	{
+		lock_guard<mutex> guard(modelLock);
+		result = stats;
+		result.synchronised = synchronised;
+	}
+	result.roundTrip = roundTrip.summary();
+	return result;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "icamera.h"
+#include "latencyHistogram.h"
+
+using namespace std;
+
+
+struct ClockSyncConfig {
+	// Latches per second once synchronised; the first minLatches are taken
+	// a millisecond apart so conversion is available almost at once.
+	double rate = 10.0;
+	// Latches the fit is made over: at 10 Hz, the last 6.4 s.
+	size_t window = 64;
+	size_t minLatches = 8;
+	// Until the window spans this long the slope is too noisy to fit, and is
+	// held at tickNanos; only the offset is fitted.
+	double minSlopeSpanSeconds = 1.0;
+	// A latch whose round trip is more than this many times the fastest one
+	// in the window is discarded: the camera answered late, so the host
+	// midpoint says little about when it latched.
+	double maxRoundTripFactor = 3.0;
+	// Nominal length of a camera tick: 1 for cameras stamping in
+	// nanoseconds, 8 for a 125 MHz GigE Vision tick.
+	double tickNanos = 1.0;
+};
+
+struct ClockSyncStats {
+	bool synchronised = false;
+	uint64_t latches = 0;
+	// Latch commands that failed, and latches discarded as too slow.
+	uint64_t latchErrors = 0;
+	uint64_t latchesRejected = 0;
+	// Host time minus camera time (in nominal ticks) at the last latch.
+	int64_t offsetNanos = 0;
+	// Camera clock rate relative to the host's, in parts per million.
+	double driftPpm = 0.0;
+	// Of the latches in the window about the current fit.
+	double residualRmsUs = 0.0;
+	double residualMaxUs = 0.0;
+	// The last latch against the fit made before it: the error to expect
+	// when converting timestamps newer than the window.
+	double predictionErrorUs = 0.0;
+	LatencySummary roundTrip;
+};
+
+// Maps a camera's timestamps onto the host clock. A thread latches the
+// camera counter at a low rate, stamping each latch with the host midpoint
+// of the command, and refits host = a + b * camera by least squares over a
+// sliding window of latches. The slope absorbs the tick length and the
+// drift between the oscillators. The fit is a few dozen multiply-adds per
+// latch, and toHost() is a multiply under a short lock, cheap enough for
+// every frame.
+//
+// The residuals of the window about the fit, and the error of each new
+// latch against the previous fit, are published so alignment against
+// stage data can be trusted to a known bound.
+class ClockSync {
+
+private:
+	struct Point {
+		uint64_t camera;
+		uint64_t host;
+		uint64_t roundTrip;
+	};
+
+	// host = hostRef + slope * (camera - cameraRef)
+	struct Model {
+		uint64_t cameraRef = 0;
+		uint64_t hostRef = 0;
+		double slope = 1.0;
+	};
+
+	ICameraClock& clock;
+	string clockName;
+	ClockSyncConfig config;
+
+	// Latching thread only.
+	vector<Point> window;
+	size_t windowHead;
+	size_t rejectedRun;
+
+	mutable mutex modelLock;
+	Model model;
+	bool synchronised;
+	ClockSyncStats stats;
+
+	thread syncThread;
+	atomic<bool> running;
+	LatencyHistogram roundTrip;
+
+	static uint64_t convert(const Model& fit, uint64_t cameraTimestamp);
+	bool fit(Model& result, double& residualRms, double& residualMax) const;
+	void syncLoop();
+
+public:
+	// name labels error messages.
+	ClockSync(ICameraClock& clock_, const string& name, const ClockSyncConfig& config_);
+	~ClockSync();
+	ClockSync(const ClockSync&) = delete;
+	ClockSync& operator=(const ClockSync&) = delete;
+
+	void start();
+	void stop();
+	bool isRunning() const;
+
+	// Takes one latch on the calling thread; for use without start().
+	// Returns false when the latch failed or was discarded.
+	bool latch();
+
+	bool isSynchronised() const;
+	// Camera timestamp to hostNanos() time; false until synchronised.
+	bool toHost(uint64_t cameraTimestamp, uint64_t& hostTimestamp) const;
+
+	ClockSyncStats getStats() const;
+};
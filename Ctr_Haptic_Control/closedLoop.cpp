@@ -0,0 +1,181 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "closedLoop.h"
+#include "utilities.h"
+
+
+ClosedLoopController::ClosedLoopController(ICamera& camera_, IMotionController& motion_, IFeatureExtractor& extractor_,
+	const ClosedLoopConfig& config_) :
+	camera(camera_),
+	motion(motion_),
+	extractor(extractor_),
+	config{ config_ },
+	hasSetpoint{ false },
+	setpointX{ 0.0 },
+	setpointY{ 0.0 },
+	running{ false },
+	processed{ 0 },
+	superseded{ 0 },
+	stale{ 0 },
+	late{ 0 },
+	misses{ 0 },
+	sent{ 0 },
+	commandsLate{ 0 },
+	commandErrors{ 0 },
+	watchdogStops{ 0 },
+	errorX{ 0.0 },
+	errorY{ 0.0 }
+{}
+
+ClosedLoopController::~ClosedLoopController() {
+	stop();
+}
+
+double ClosedLoopController::axisVelocity(double errorPixels, double pixelsPerMm) const {
+	if (fabs(errorPixels) < config.deadbandPixels || pixelsPerMm == 0.0) {
+		return 0.0;
+	}
+	const double velocity = config.gain * errorPixels / pixelsPerMm;
+	return velocity > config.maxSpeed ? config.maxSpeed : velocity < -config.maxSpeed ? -config.maxSpeed : velocity;
+}
+
+void ClosedLoopController::controlLoop() {
+	const uint64_t deadlineNanos = static_cast<uint64_t>(config.deadlineMs * 1e6);
+	const uint64_t watchdogNanos = deadlineNanos * (config.watchdogDeadlines == 0 ? 1 : config.watchdogDeadlines);
+	Frame frame;
+	Frame newer;
+	bool stopped = true;
+	bool reported = false;
+	uint64_t lastCommand = 0;
+	while (running) {
+		if (!stopped && hostNanos() - lastCommand > watchdogNanos) {
+			if (motion.setVelocity(0.0, 0.0, 0.0)) {
+				watchdogStops++;
+				stopped = true;
+			}
+			else {
+				commandErrors++;
+			}
+		}
+		// While moving, never wait past the watchdog.
+		const chrono::milliseconds wait(stopped ? 100 : watchdogNanos / 1000000 + 1);
+		if (!camera.waitForFrame(frame, wait)) {
+			if (!camera.isStreaming()) {
+				this_thread::sleep_for(chrono::milliseconds(1));
+			}
+			continue;
+		}
+		while (camera.tryPopFrame(newer)) {
+			frame = move(newer);
+			superseded++;
+		}
+
+		const uint64_t arrival = frame.info().hostTimestamp;
+		const uint64_t deadline = arrival + deadlineNanos;
+		const uint64_t picked = hostNanos();
+		frameAge.record(picked > arrival ? picked - arrival : 0);
+		if (picked >= deadline) {
+			stale++;
+			frame.reset();
+			continue;
+		}
+
+		Feature feature;
+		const bool found = extractor.extract(frame, feature);
+		const uint64_t extracted = hostNanos();
+		extraction.record(extracted - picked);
+		processed++;
+
+		double vx = 0.0;
+		double vy = 0.0;
+		if (found) {
+			const double targetX = hasSetpoint ? setpointX.load() : frame.width() / 2.0;
+			const double targetY = hasSetpoint ? setpointY.load() : frame.height() / 2.0;
+			errorX = targetX - feature.x;
+			errorY = targetY - feature.y;
+			vx = axisVelocity(errorX, config.pixelsPerMmX);
+			vy = axisVelocity(errorY, config.pixelsPerMmY);
+		}
+		else {
+			misses++;
+		}
+		frame.reset();
+		// Only a correction can be late; a stop always goes out.
+		const bool stop = vx == 0.0 && vy == 0.0;
+		if (stop && stopped) {
+			continue;
+		}
+		if (!stop && extracted >= deadline) {
+			late++;
+			continue;
+		}
+
+		const bool ok = motion.setVelocity(vx, vy, 0.0);
+		const uint64_t accepted = hostNanos();
+		command.record(accepted - extracted);
+		if (!ok) {
+			commandErrors++;
+			if (!reported) {
+				cout << "Error: closed-loop command to " << motion.name() << " failed: " << motion.lastError() << endl;
+				reported = true;
+			}
+			continue;
+		}
+		sent++;
+		lastCommand = accepted;
+		endToEnd.record(accepted - arrival);
+		if (accepted > deadline) {
+			commandsLate++;
+		}
+		stopped = stop;
+	}
+	motion.setVelocity(0.0, 0.0, 0.0);
+}
+
+void ClosedLoopController::start() {
+	if (running) {
+		return;
+	}
+	running = true;
+	controlThread = thread(&ClosedLoopController::controlLoop, this);
+}
+
+void ClosedLoopController::stop() {
+	running = false;
+	if (controlThread.joinable()) {
+		controlThread.join();
+	}
+}
+
+bool ClosedLoopController::isRunning() const {
+	return running;
+}
+
+void ClosedLoopController::setSetpoint(double x, double y) {
+	setpointX = x;
+	setpointY = y;
+	hasSetpoint = true;
+}
+
+ClosedLoopStats ClosedLoopController::getStats() const {
+	ClosedLoopStats stats;
+	stats.framesProcessed = processed;
+	stats.framesSuperseded = superseded;
+	stats.framesStale = stale;
+	stats.framesLate = late;
+	stats.featureMisses = misses;
+	stats.commandsSent = sent;
+	stats.commandsLate = commandsLate;
+	stats.commandErrors = commandErrors;
+	stats.watchdogStops = watchdogStops;
+	stats.deadlineMisses = stats.framesStale + stats.framesLate + stats.commandsLate;
+	stats.endToEnd = endToEnd.summary();
+	stats.frameAge = frameAge.summary();
+	stats.extraction = extraction.summary();
+	stats.command = command.summary();
+	stats.errorX = errorX;
+	stats.errorY = errorY;
+	return stats;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "featureExtractor.h"
+#include "icamera.h"
+#include "imotionController.h"
+#include "latencyHistogram.h"
+
+using namespace std;
+
+
+struct ClosedLoopConfig {
+	// From a frame reaching the host to its correction being accepted by the
+	// motion controller. A frame already past it is dropped, not processed.
+	double deadlineMs = 5.0;
+	// Proportional gain, 1/s: stage speed per unit of position error.
+	double gain = 5.0;
+	// Image scale of the stage axes; negative flips an axis.
+	double pixelsPerMmX = 100.0;
+	double pixelsPerMmY = 100.0;
+	// Stage speed limit, mm/s.
+	double maxSpeed = 10.0;
+	// Errors under this many pixels command no motion.
+	double deadbandPixels = 0.5;
+	// The stage is stopped when it has been moving this many deadlines
+	// without a fresh correction: the camera stalled, or every frame was
+	// stale.
+	unsigned int watchdogDeadlines = 4;
+};
+
+struct ClosedLoopStats {
+	uint64_t framesProcessed = 0;
+	// Replaced by a newer frame before the loop got to them.
+	uint64_t framesSuperseded = 0;
+	// Already past the deadline when picked up.
+	uint64_t framesStale = 0;
+	// Deadline passed during feature extraction; no command sent.
+	uint64_t framesLate = 0;
+	uint64_t featureMisses = 0;
+	uint64_t commandsSent = 0;
+	// Sent, but accepted after the deadline.
+	uint64_t commandsLate = 0;
+	uint64_t commandErrors = 0;
+	// Stops commanded because corrections ran out.
+	uint64_t watchdogStops = 0;
+	// framesStale + framesLate + commandsLate.
+	uint64_t deadlineMisses = 0;
+	// Frame arrival to command accepted, for every command sent.
+	LatencySummary endToEnd;
+	// Frame arrival to the loop picking it up.
+	LatencySummary frameAge;
+	LatencySummary extraction;
+	LatencySummary command;
+	// Setpoint minus feature, pixels, as of the last frame processed.
+	double errorX = 0.0;
+	double errorY = 0.0;
+};
+
+// Visual servo: frame -> feature -> stage velocity correction, on one
+// thread, within a fixed latency budget. Only the newest frame is ever
+// worked on; older ones are skipped rather than queued, and a frame that
+// is already too old to make the deadline is dropped, because a late
+// correction is worse than none. The command is a velocity proportional to
+// the feature's offset from the setpoint, and a velocity stays in force
+// until replaced, so anything that stops corrections must stop the stage:
+// a lost feature commands a stop at once, deadline or not, and a watchdog
+// stops it when no correction has gone out for watchdogDeadlines
+// deadlines, e.g. because the camera stopped delivering.
+//
+// The camera is best a latest-only FrameSubscriber of its own.
+class ClosedLoopController {
+
+private:
+	ICamera& camera;
+	IMotionController& motion;
+	IFeatureExtractor& extractor;
+	ClosedLoopConfig config;
+
+	// Frame centre until set.
+	atomic<bool> hasSetpoint;
+	atomic<double> setpointX;
+	atomic<double> setpointY;
+
+	thread controlThread;
+	atomic<bool> running;
+
+	atomic<uint64_t> processed;
+	atomic<uint64_t> superseded;
+	atomic<uint64_t> stale;
+	atomic<uint64_t> late;
+	atomic<uint64_t> misses;
+	atomic<uint64_t> sent;
+	atomic<uint64_t> commandsLate;
+	atomic<uint64_t> commandErrors;
+	atomic<uint64_t> watchdogStops;
+	atomic<double> errorX;
+	atomic<double> errorY;
+	LatencyHistogram endToEnd;
+	LatencyHistogram frameAge;
+	LatencyHistogram extraction;
+	LatencyHistogram command;
+
+	double axisVelocity(double errorPixels, double pixelsPerMm) const;
+	void controlLoop();
+
+public:
+	// All three must outlive the controller; the motion controller must be
+	// connected and enabled.
+	ClosedLoopController(ICamera& camera_, IMotionController& motion_, IFeatureExtractor& extractor_,
+		const ClosedLoopConfig& config_);
+	~ClosedLoopController();
+	ClosedLoopController(const ClosedLoopController&) = delete;
+	ClosedLoopController& operator=(const ClosedLoopController&) = delete;
+
+	void start();
+	// Stops the stage as well.
+	void stop();
+	bool isRunning() const;
+
+	// Pixel position the feature is steered to; any thread.
+	void setSetpoint(double x, double y);
+
+	ClosedLoopStats getStats() const;
+};
@@ -4,22 +4,121 @@
 #include <thread>
 #include <mutex>
 
+#include "a3200Controller.h"
 #include "ctr.h"
 
 using namespace std;
 
-Ctr::Ctr() :
-	_CTR_CONFIG(CTR_CONFIG)
+Ctr::Ctr(unique_ptr<IMotionController> motion_, const CtrConfig& config) :
+	_CTR_CONFIG(config),
+	motion{ move(motion_) }
 {
 	initA3200();
 
 }
 
 Ctr::~Ctr() {
+	stopControl();
+	stopDataAcquisition();
+	stageSampler.reset();
+	if (motion) {
+		motion->disconnect();
+	}
 }
 
-void Ctr::initA3200() {}
+void Ctr::initA3200() {
+	if (!motion) {
+		A3200ControllerConfig controllerConfig;
+		controllerConfig.axisMask = _CTR_CONFIG.stageAxisMask;
+		motion = make_unique<A3200Controller>(controllerConfig);
+	}
+	cout << "Connecting to " << motion->name() << ". Initializing if necessary." << endl;
+	if (!motion->connect() || !motion->enable()) {
+		cout << "Error: unable to connect to " << motion->name() << ": " << motion->lastError() << endl;
+		motion->disconnect();
+		motion.reset();
+		return;
+	}
+	StageSamplerConfig samplerConfig;
+	samplerConfig.rate = _CTR_CONFIG.stageSampleRate;
+	stageSampler = make_unique<StageSampler>(*motion, samplerConfig);
+}
+
+bool Ctr::dataAcquisition(const vector<ICamera*>& cameras, const AcquisitionConfig& config,
+	const vector<AcquisitionSourceConfig>& sourceConfigs) {
+	stopDataAcquisition();
+	acquisition.reset();
+	if (stageSampler) {
+		stageSampler->startSampling();
+	}
+	acquisition = make_unique<DataAcquisition>(stageSampler.get(), config);
+	for (size_t i = 0; i < cameras.size(); i++) {
+		acquisition->addCamera(*cameras[i], i < sourceConfigs.size() ? sourceConfigs[i] : AcquisitionSourceConfig());
+	}
+	if (!acquisition->start()) {
+		stopDataAcquisition();
+		acquisition.reset();
+		return false;
+	}
+	return true;
+}
+
+void Ctr::stopDataAcquisition() {
+	if (acquisition) {
+		acquisition->stop();
+	}
+	if (stageSampler) {
+		stageSampler->stopSampling();
+	}
+}
+
+IMotionController* Ctr::getMotionController() {
+	return motion.get();
+}
+
+StageSampler* Ctr::getStageSampler() {
+	return stageSampler.get();
+}
+
+DataAcquisition* Ctr::getDataAcquisition() {
+	return acquisition.get();
+}
+
+bool Ctr::startControl(ICamera& camera, IFeatureExtractor* extractor) {
+	if (_CTR_CONFIG.control != Control::CLOSED_LOOP) {
+		cout << "Error: closed-loop control is not enabled in the configuration" << endl;
+		return false;
+	}
+	if (!motion) {
+		cout << "Error: closed-loop control needs a motion controller" << endl;
+		return false;
+	}
+	stopControl();
+	closedLoop.reset();
+	if (!extractor) {
+		if (!defaultExtractor) {
+			defaultExtractor = make_unique<CentroidExtractor>(CentroidConfig());
+		}
+		defaultExtractor->reset();
+		extractor = defaultExtractor.get();
+	}
+	ClosedLoopConfig config;
+	config.deadlineMs = _CTR_CONFIG.controlDeadlineMs;
+	config.gain = _CTR_CONFIG.controlGain;
+	config.pixelsPerMmX = _CTR_CONFIG.pixelsPerMm;
+	config.pixelsPerMmY = _CTR_CONFIG.pixelsPerMm;
+	config.maxSpeed = _CTR_CONFIG.maxControlSpeed;
+	closedLoop = make_unique<ClosedLoopController>(camera, *motion, *extractor, config);
+	closedLoop->start();
+	return true;
+}
+
+void Ctr::stopControl() {
+	if (closedLoop) {
+		closedLoop->stop();
+	}
+}
 
-void Ctr::dataAcquisition() {
-	
-}
\ No newline at end of file
+ClosedLoopController* Ctr::getClosedLoop() {
+	return closedLoop.get();
+}
@@ -1,7 +1,15 @@
 #pragma once
 
-#include "A3200.h"
-#include "CtrConfig.h"
+#include <memory>
+#include <vector>
+
+#include "ctrConfig.h"
+#include "closedLoop.h"
+#include "dataAcquisition.h"
+#include "featureExtractor.h"
+#include "icamera.h"
+#include "imotionController.h"
+#include "stageSampler.h"
 
 
 using namespace std;
@@ -12,13 +20,40 @@ class Ctr {
 
 private:
 	CtrConfig _CTR_CONFIG;
+	unique_ptr<IMotionController> motion;
+	unique_ptr<StageSampler> stageSampler;
+	unique_ptr<DataAcquisition> acquisition;
+	unique_ptr<CentroidExtractor> defaultExtractor;
+	unique_ptr<ClosedLoopController> closedLoop;
 
 	void initA3200();
-	void dataAcquisition();
 
 public:
-	Ctr();
+	// Drives the A3200 unless another controller (e.g. a
+	// SimMotionController) is given.
+	explicit Ctr(unique_ptr<IMotionController> motion_ = nullptr, const CtrConfig& config = CTR_CONFIG);
 	~Ctr();
-	
-	
-};
\ No newline at end of file
+
+	// Null when the controller could not be reached.
+	IMotionController* getMotionController();
+	StageSampler* getStageSampler();
+
+	// Records the cameras and the stage feedback to config.recorder.path,
+	// each frame carrying the stage position at its exposure midpoint,
+	// until stopDataAcquisition(). The cameras must be streaming.
+	// sourceConfigs pairs with cameras; missing entries take the defaults.
+	bool dataAcquisition(const vector<ICamera*>& cameras, const AcquisitionConfig& config,
+		const vector<AcquisitionSourceConfig>& sourceConfigs = vector<AcquisitionSourceConfig>());
+	void stopDataAcquisition();
+	// The current or last recording, for its stats; null before the first.
+	DataAcquisition* getDataAcquisition();
+
+	// Closed-loop mode only: steers the stage so the feature found in the
+	// camera's frames (by default the centroid of a bright spot) holds the
+	// setpoint, until stopControl(). The camera must be streaming and should
+	// be a LatestOnly subscriber used by nothing else.
+	bool startControl(ICamera& camera, IFeatureExtractor* extractor = nullptr);
+	void stopControl();
+	// The current or last control run, for its setpoint and stats.
+	ClosedLoopController* getClosedLoop();
+};
@@ -7,5 +7,18 @@ enum class Control {
 
 
 class CtrConfig {
-		
-};
\ No newline at end of file
+
+public:
+	// Stage feedback sampling: A3200 AXISMASK bits of up to three axes (x, y,
+	// z), and samples per second.
+	unsigned int stageAxisMask = 0x3;
+	double stageSampleRate = 1000.0;
+
+	// Visual servo (startControl()): frame-to-command deadline, proportional
+	// gain in 1/s, image scale and stage speed limit in mm/s.
+	Control control = Control::OPEN_LOOP;
+	double controlDeadlineMs = 5.0;
+	double controlGain = 5.0;
+	double pixelsPerMm = 100.0;
+	double maxControlSpeed = 10.0;
+};
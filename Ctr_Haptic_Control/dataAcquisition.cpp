@@ -0,0 +1,202 @@
+#include <chrono>
+#include <stdexcept>
+
+#include "dataAcquisition.h"
+#include "utilities.h"
+
+
+// Stage samples taken per pass, so a busy stage cannot starve the cameras.
+static const size_t STAGE_BATCH = 256;
+
+
+DataAcquisition::Source::Source(ICamera& camera_, const AcquisitionSourceConfig& config_) :
+	camera(camera_),
+	config{ config_ }
+{}
+
+
+DataAcquisition::DataAcquisition(IStageSource* stage_, const AcquisitionConfig& config_) :
+	config{ config_ },
+	stage{ stage_ },
+	recorder{ config_.recorder },
+	interpolator{ config_.stageHistory },
+	running{ false },
+	stageSamples{ 0 },
+	stageDropped{ 0 }
+{}
+
+DataAcquisition::~DataAcquisition() {
+	stop();
+}
+
+size_t DataAcquisition::addCamera(ICamera& camera, const AcquisitionSourceConfig& sourceConfig) {
+	if (running) {
+		throw logic_error("DataAcquisition::addCamera called after start()");
+	}
+	sources.push_back(make_unique<Source>(camera, sourceConfig));
+	return recorder.addSource(camera.name(), sourceConfig.compress);
+}
+
+uint64_t DataAcquisition::midpointOf(const Source& source, const Frame& frame, bool& clockTimed) const {
+	const uint64_t halfExposure = static_cast<uint64_t>(source.config.exposureUs * 500.0);
+	uint64_t exposureStart = 0;
+	clockTimed = source.config.clock && source.config.clock->toHost(frame.timestamp(), exposureStart);
+	if (clockTimed) {
+		return exposureStart + halfExposure;
+	}
+	const uint64_t before = static_cast<uint64_t>((source.config.latencyUs + source.config.exposureUs / 2) * 1e3);
+	const uint64_t arrival = frame.info().hostTimestamp;
+	return arrival > before ? arrival - before : 0;
+}
+
+// Writes the frame with its stage position, or returns false to be asked
+// again once more stage samples are in. final gives up waiting.
+bool DataAcquisition::align(size_t index, const Frame& frame, bool final) {
+	Source& source = *sources[index];
+	bool clockTimed = false;
+	const uint64_t midpoint = midpointOf(source, frame, clockTimed);
+	CameraSample sample;
+	sample.source = static_cast<uint32_t>(index);
+	sample.frameId = frame.frameId();
+	sample.timestamp = frame.timestamp();
+	sample.hostTimestamp = frame.info().hostTimestamp;
+
+	const uint64_t now = hostNanos();
+	StageAlignment alignment = StageAlignment::Expired;
+	if (stage) {
+		alignment = interpolator.at(midpoint, sample.stage);
+		const uint64_t waitNanos = static_cast<uint64_t>(config.stageWaitMs * 1e6);
+		if (alignment == StageAlignment::Pending && !final && stage->isSampling() && now < midpoint + waitNanos) {
+			return false;
+		}
+	}
+	if (alignment == StageAlignment::Interpolated) {
+		source.interpolated++;
+	}
+	else if (stage && interpolator.nearest(midpoint, static_cast<uint64_t>(config.maxStageGapMs * 1e6), sample.stage)) {
+		sample.stage.hostTimestamp = midpoint;
+		sample.stage.status |= STAGE_STATUS_NOT_INTERPOLATED;
+		source.nearest++;
+	}
+	else {
+		sample.stage = StageSample();
+		source.unaligned++;
+	}
+	alignmentDelay.record(now > sample.hostTimestamp ? now - sample.hostTimestamp : 0);
+	source.clockTimed += clockTimed ? 1 : 0;
+
+	recorder.submitCamera(sample);
+	if (!recorder.submit(index, frame)) {
+		source.dropped++;
+	}
+	source.frames++;
+	return true;
+}
+
+size_t DataAcquisition::drainStage() {
+	size_t work = 0;
+	StageSample sample;
+	while (stage && work < STAGE_BATCH && stage->tryPopSample(sample)) {
+		interpolator.add(sample);
+		stageSamples++;
+		if (!recorder.submitStage(sample)) {
+			stageDropped++;
+		}
+		work++;
+	}
+	return work;
+}
+
+// Frames of one camera, oldest first, until one has to wait for the stage.
+size_t DataAcquisition::drainCamera(size_t index, bool final) {
+	Source& source = *sources[index];
+	size_t work = 0;
+	while (source.waiting || source.camera.tryPopFrame(source.waiting)) {
+		if (!align(index, source.waiting, final)) {
+			break;
+		}
+		source.waiting.reset();
+		work++;
+	}
+	return work;
+}
+
+void DataAcquisition::acquisitionLoop() {
+	while (running) {
+		size_t work = drainStage();
+		for (size_t i = 0; i < sources.size(); i++) {
+			work += drainCamera(i, false);
+		}
+		if (work == 0) {
+			this_thread::sleep_for(chrono::microseconds(200));
+		}
+	}
+	// Whatever arrived before stop(): every stage sample first, so the last
+	// frames are aligned against all of them.
+	while (drainStage() > 0) {
+	}
+	for (size_t i = 0; i < sources.size(); i++) {
+		drainCamera(i, true);
+	}
+}
+
+bool DataAcquisition::start() {
+	if (running) {
+		return true;
+	}
+	if (!recorder.start()) {
+		return false;
+	}
+	interpolator.clear();
+	running = true;
+	acquisitionThread = thread(&DataAcquisition::acquisitionLoop, this);
+	return true;
+}
+
+void DataAcquisition::stop() {
+	if (!running) {
+		return;
+	}
+	running = false;
+	if (acquisitionThread.joinable()) {
+		acquisitionThread.join();
+	}
+	recorder.stop();
+}
+
+bool DataAcquisition::isRunning() const {
+	return running;
+}
+
+AcquisitionStats DataAcquisition::getStats() const {
+	AcquisitionStats stats;
+	stats.stageSamples = stageSamples;
+	stats.stageSamplesDropped = stageDropped;
+	stats.alignmentDelay = alignmentDelay.summary();
+	stats.recorder = recorder.getStats();
+	for (const auto& source : sources) {
+		AcquisitionSourceStats sourceStats;
+		sourceStats.name = source->camera.name();
+		sourceStats.frames = source->frames;
+		sourceStats.framesClockTimed = source->clockTimed;
+		sourceStats.framesInterpolated = source->interpolated;
+		sourceStats.framesNearest = source->nearest;
+		sourceStats.framesUnaligned = source->unaligned;
+		sourceStats.framesDropped = source->dropped;
+		stats.sources.push_back(sourceStats);
+	}
+	return stats;
+}
+
+AcquisitionStats collectData(const vector<ICamera*>& cameras, IStageSource* stage, const AcquisitionConfig& config,
+	double seconds) {
+	DataAcquisition acquisition(stage, config);
+	for (ICamera* camera : cameras) {
+		acquisition.addCamera(*camera);
+	}
+	if (acquisition.start()) {
+		this_thread::sleep_for(chrono::duration<double>(seconds));
+		acquisition.stop();
+	}
+	return acquisition.getStats();
+}
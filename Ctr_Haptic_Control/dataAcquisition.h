@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clockSync.h"
+#include "frame.h"
+#include "icamera.h"
+#include "istage.h"
+#include "latencyHistogram.h"
+#include "recorder.h"
+#include "stageInterpolator.h"
+
+using namespace std;
+
+
+struct AcquisitionConfig {
+	RecorderConfig recorder;
+	// Stage samples kept for interpolation; a few seconds at the stage rate
+	// covers any camera delivery latency.
+	size_t stageHistory = 1 << 12;
+	// How long a frame may wait for a stage sample past its exposure
+	// midpoint before it is written with the nearest one instead.
+	double stageWaitMs = 20.0;
+	// Furthest that nearest sample may be from the midpoint; beyond it the
+	// frame is written without a stage position.
+	double maxStageGapMs = 5.0;
+};
+
+struct AcquisitionSourceConfig {
+	bool compress = false;
+	// Places the exposure midpoint on the host clock. With a synchronised
+	// clock it is the frame's camera timestamp (start of exposure) in host
+	// time plus exposureUs / 2. Otherwise it is taken to lie latencyUs +
+	// exposureUs / 2 before the frame's host timestamp, where latencyUs
+	// covers sensor readout and transfer.
+	double exposureUs = 0.0;
+	double latencyUs = 0.0;
+	// Optional; must outlive the acquisition.
+	ClockSync* clock = nullptr;
+};
+
+struct AcquisitionSourceStats {
+	string name;
+	uint64_t frames = 0;
+	// Midpoint placed through the ClockSync rather than from arrival time.
+	uint64_t framesClockTimed = 0;
+	uint64_t framesInterpolated = 0;
+	// Written with the nearest stage sample (STAGE_STATUS_NOT_INTERPOLATED).
+	uint64_t framesNearest = 0;
+	// Written without a stage position.
+	uint64_t framesUnaligned = 0;
+	// Refused by the recorder.
+	uint64_t framesDropped = 0;
+};
+
+struct AcquisitionStats {
+	uint64_t stageSamples = 0;
+	// Refused by the recorder.
+	uint64_t stageSamplesDropped = 0;
+	// From a frame reaching the host to its stage position being known.
+	LatencySummary alignmentDelay;
+	RecorderStats recorder;
+	vector<AcquisitionSourceStats> sources;
+};
+
+// Records camera frames and stage feedback into one session, both on the
+// host clock, and gives every frame the stage position at the middle of its
+// exposure. One thread drains the stage source into a StageInterpolator
+// and the recorder, then pops each camera's frames in order. A frame whose
+// midpoint is not yet bracketed by stage samples stays at the head of its
+// camera until it is, so alignment is streaming: no frames are buffered
+// here and no pass over the session is needed afterwards. The position
+// goes out with the frame's CameraSample (telemetry.h).
+//
+// The cameras and the stage source must be streaming before start(); this
+// is their only consumer.
+class DataAcquisition {
+
+private:
+	struct Source {
+		ICamera& camera;
+		AcquisitionSourceConfig config;
+		// Popped, waiting for the stage to catch up with its midpoint.
+		Frame waiting;
+		atomic<uint64_t> frames{ 0 };
+		atomic<uint64_t> clockTimed{ 0 };
+		atomic<uint64_t> interpolated{ 0 };
+		atomic<uint64_t> nearest{ 0 };
+		atomic<uint64_t> unaligned{ 0 };
+		atomic<uint64_t> dropped{ 0 };
+
+		Source(ICamera& camera_, const AcquisitionSourceConfig& config_);
+	};
+
+	AcquisitionConfig config;
+	IStageSource* stage;
+	vector<unique_ptr<Source>> sources;
+	Recorder recorder;
+	StageInterpolator interpolator;
+
+	thread acquisitionThread;
+	atomic<bool> running;
+	atomic<uint64_t> stageSamples;
+	atomic<uint64_t> stageDropped;
+	LatencyHistogram alignmentDelay;
+
+	uint64_t midpointOf(const Source& source, const Frame& frame, bool& clockTimed) const;
+	bool align(size_t index, const Frame& frame, bool final);
+	size_t drainStage();
+	size_t drainCamera(size_t index, bool final);
+	void acquisitionLoop();
+
+public:
+	// stage may be null, in which case frames carry no stage position.
+	DataAcquisition(IStageSource* stage_, const AcquisitionConfig& config_);
+	~DataAcquisition();
+	DataAcquisition(const DataAcquisition&) = delete;
+	DataAcquisition& operator=(const DataAcquisition&) = delete;
+
+	// Add every camera before start(). Returns its source id in the session.
+	size_t addCamera(ICamera& camera, const AcquisitionSourceConfig& sourceConfig = AcquisitionSourceConfig());
+
+	bool start();
+	// Aligns and writes whatever the cameras and stage have delivered, then
+	// closes the session.
+	void stop();
+	bool isRunning() const;
+
+	AcquisitionStats getStats() const;
+};
+
+// Records the cameras and stage to config.recorder.path for the given time
+// and returns the statistics; blocking.
+AcquisitionStats collectData(const vector<ICamera*>& cameras, IStageSource* stage, const AcquisitionConfig& config,
+	double seconds);
@@ -0,0 +1,193 @@
+#include <chrono>
+#include <cstring>
+
+#include "Spinnaker.h"
+#include "exportPool.h"
+#include "pixelConvert.h"
+
+using namespace Spinnaker;
+
+
+static PixelFormatEnums toSpinnakerFormat(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::Mono8:
+		return PixelFormat_Mono8;
+	case PixelFormat::Mono16:
+		return PixelFormat_Mono16;
+	case PixelFormat::BayerRG8:
+		return PixelFormat_BayerRG8;
+	case PixelFormat::BayerRG16:
+		return PixelFormat_BayerRG16;
+	case PixelFormat::BGR8:
+		return PixelFormat_BGR8;
+	default:
+		return UNKNOWN_PIXELFORMAT;
+	}
+}
+
+
+ExportPool::ExportPool(size_t threads, size_t queueCapacity) :
+	jobs(queueCapacity > 0 ? queueCapacity : 1),
+	stopping{ false },
+	submitted{ 0 },
+	completed{ 0 },
+	failed{ 0 },
+	rejected{ 0 },
+	peakQueueDepth{ 0 }
+{
+	for (size_t i = 0; i < jobs.size(); i++) {
+		freeJobs.push_back(i);
+	}
+	for (size_t i = 0; i < (threads > 0 ? threads : 1); i++) {
+		workers.emplace_back(&ExportPool::workerLoop, this);
+	}
+}
+
+// Exports already queued are finished before the workers exit.
+ExportPool::~ExportPool() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+future<ExportResult> ExportPool::submit(const Frame& frame, const string& path, const ExportOptions& options) {
+	size_t index;
+	{
+		lock_guard<mutex> guard(lock);
+		submitted++;
+		if (freeJobs.empty() || stopping) {
+			rejected++;
+			promise<ExportResult> refused;
+			ExportResult result;
+			result.path = path;
+			result.error = "export queue full";
+			refused.set_value(result);
+			return refused.get_future();
+		}
+		index = freeJobs.back();
+		freeJobs.pop_back();
+	}
+
+	// The slot is ours until it is queued; copy outside the lock. Rows are
+	// packed because Image::Create assumes no row padding.
+	Job& job = jobs[index];
+	job.info = frame.info();
+	const size_t rowBytes = job.info.width * bytesPerPixel(job.info.pixelFormat);
+	job.pixels.resize(rowBytes * job.info.height);
+	for (size_t y = 0; y < job.info.height; y++) {
+		memcpy(job.pixels.data() + y * rowBytes, frame.data() + y * job.info.stride, rowBytes);
+	}
+	job.info.stride = rowBytes;
+	job.path = path;
+	job.options = options;
+	job.result = promise<ExportResult>();
+	future<ExportResult> result = job.result.get_future();
+
+	{
+		lock_guard<mutex> guard(lock);
+		queue.push_back(index);
+		if (queue.size() > peakQueueDepth) {
+			peakQueueDepth = queue.size();
+		}
+	}
+	wake.notify_one();
+	return result;
+}
+
+void ExportPool::workerLoop() {
+	unique_lock<mutex> guard(lock);
+	for (;;) {
+		wake.wait(guard, [&] { return stopping || !queue.empty(); });
+		if (queue.empty()) {
+			return;
+		}
+		const size_t index = queue.front();
+		queue.pop_front();
+		guard.unlock();
+
+		ExportResult result = encode(jobs[index]);
+		const bool saved = result.saved;
+		jobs[index].result.set_value(move(result));
+
+		guard.lock();
+		if (saved) {
+			completed++;
+		}
+		else {
+			failed++;
+		}
+		freeJobs.push_back(index);
+	}
+}
+
+ExportResult ExportPool::encode(Job& job) {
+	ExportResult result;
+	result.path = job.path;
+	const auto start = chrono::steady_clock::now();
+
+	const uint8_t* pixels = job.pixels.data();
+	PixelFormat format = job.info.pixelFormat;
+	vector<uint8_t> converted;
+	const PixelFormat target = job.options.outputFormat;
+	if (target != PixelFormat::Unknown && target != format) {
+		// A 1-thread converter has no per-call state and can be shared.
+		static PixelConverter converter(1);
+		const size_t stride = PixelConverter::requiredStride(job.info.width, target);
+		converted.resize(stride * job.info.height);
+		if (!converter.convert(pixels, job.info.stride, format, converted.data(), stride, target,
+			job.info.width, job.info.height)) {
+			result.error = string("cannot convert ") + pixelFormatName(format) + " to " + pixelFormatName(target);
+			return result;
+		}
+		pixels = converted.data();
+		format = target;
+	}
+
+	try {
+		ImagePtr image = Image::Create(job.info.width, job.info.height, 0, 0, toSpinnakerFormat(format),
+			const_cast<uint8_t*>(pixels));
+		switch (job.options.format) {
+		case ExportFormat::Png: {
+			PNGOption option;
+			option.compressionLevel = job.options.compressionLevel > 9 ? 9 : job.options.compressionLevel;
+			image->Save(job.path.c_str(), option);
+			break;
+		}
+		case ExportFormat::Tiff: {
+			TIFFOption option;
+			option.compression = job.options.compressionLevel == 0 ? TIFFOption::NONE : TIFFOption::DEFLATE;
+			image->Save(job.path.c_str(), option);
+			break;
+		}
+		case ExportFormat::Jpeg: {
+			JPEGOption option;
+			option.quality = job.options.jpegQuality > 100 ? 100 : job.options.jpegQuality;
+			image->Save(job.path.c_str(), option);
+			break;
+		}
+		}
+		result.saved = true;
+	}
+	catch (Spinnaker::Exception& e) {
+		result.error = e.what();
+	}
+	result.encodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+ExportStats ExportPool::getStats() {
+	lock_guard<mutex> guard(lock);
+	ExportStats stats;
+	stats.submitted = submitted;
+	stats.completed = completed;
+	stats.failed = failed;
+	stats.rejected = rejected;
+	stats.queueDepth = queue.size();
+	stats.peakQueueDepth = peakQueueDepth;
+	return stats;
+}
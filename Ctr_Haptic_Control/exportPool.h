@@ -0,0 +1,92 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+
+using namespace std;
+
+
+enum class ExportFormat {
+	Png,
+	Tiff,
+	Jpeg
+};
+
+struct ExportOptions {
+	ExportFormat format = ExportFormat::Png;
+	// PNG: zlib level 0-9. TIFF: 0 writes uncompressed, anything else deflate.
+	unsigned int compressionLevel = 6;
+	// JPEG only, 0-100.
+	unsigned int jpegQuality = 90;
+	// Convert before encoding (Mono8 or BGR8); Unknown saves the raw pixels.
+	PixelFormat outputFormat = PixelFormat::Unknown;
+};
+
+struct ExportResult {
+	bool saved = false;
+	string path;
+	string error;
+	double encodeMs = 0.0;
+};
+
+struct ExportStats {
+	uint64_t submitted = 0;
+	uint64_t completed = 0;
+	uint64_t failed = 0;
+	// Refused because every queue slot was taken.
+	uint64_t rejected = 0;
+	size_t queueDepth = 0;
+	size_t peakQueueDepth = 0;
+};
+
+// Encodes frames to PNG/TIFF/JPEG through Image::Save on a worker pool, off
+// the acquisition path. submit() copies the pixels into one of a fixed set
+// of job buffers, so the camera's buffer is free again immediately and a
+// slow disk cannot pin driver memory. When every buffer is busy the export
+// is rejected rather than queued.
+class ExportPool {
+
+private:
+	struct Job {
+		vector<uint8_t> pixels;
+		FrameInfo info;
+		string path;
+		ExportOptions options;
+		promise<ExportResult> result;
+	};
+
+	vector<Job> jobs;
+	vector<size_t> freeJobs;
+	deque<size_t> queue;
+	mutex lock;
+	condition_variable wake;
+	vector<thread> workers;
+	bool stopping;
+
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t failed;
+	uint64_t rejected;
+	size_t peakQueueDepth;
+
+	void workerLoop();
+	ExportResult encode(Job& job);
+
+public:
+	ExportPool(size_t threads = 2, size_t queueCapacity = 8);
+	~ExportPool();
+	ExportPool(const ExportPool&) = delete;
+	ExportPool& operator=(const ExportPool&) = delete;
+
+	future<ExportResult> submit(const Frame& frame, const string& path, const ExportOptions& options = ExportOptions());
+
+	ExportStats getStats();
+};
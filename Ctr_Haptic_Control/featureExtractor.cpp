@@ -0,0 +1,94 @@
+#include "featureExtractor.h"
+
+
+CentroidExtractor::CentroidExtractor(const CentroidConfig& config_) :
+	config{ config_ },
+	tracking{ false },
+	lastX{ 0.0 },
+	lastY{ 0.0 }
+{
+	config.coarseStep = config.coarseStep == 0 ? 1 : config.coarseStep;
+}
+
+// Centroid of the pixels at or above threshold in [x0, x1) x [y0, y1),
+// sampling every step-th row and column. area counts sampled pixels.
+bool CentroidExtractor::centroid(const uint8_t* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1,
+	size_t step, uint8_t threshold, Feature& feature) {
+	uint64_t count = 0;
+	uint64_t sumX = 0;
+	uint64_t sumY = 0;
+	for (size_t y = y0; y < y1; y += step) {
+		const uint8_t* row = pixels + y * stride;
+		uint64_t rowCount = 0;
+		uint64_t rowSumX = 0;
+		for (size_t x = x0; x < x1; x += step) {
+			const uint64_t hit = row[x] >= threshold ? 1 : 0;
+			rowCount += hit;
+			rowSumX += hit * x;
+		}
+		count += rowCount;
+		sumX += rowSumX;
+		sumY += rowCount * y;
+	}
+	if (count == 0) {
+		return false;
+	}
+	feature.x = static_cast<double>(sumX) / count;
+	feature.y = static_cast<double>(sumY) / count;
+	feature.area = static_cast<size_t>(count);
+	return true;
+}
+
+string CentroidExtractor::name() const {
+	return "centroid";
+}
+
+bool CentroidExtractor::extract(const Frame& frame, Feature& feature) {
+	const uint8_t* pixels = nullptr;
+	size_t stride = 0;
+	if (frame.pixelFormat() == PixelFormat::Mono8 || frame.pixelFormat() == PixelFormat::BayerRG8) {
+		pixels = frame.data();
+		stride = frame.stride();
+	}
+	else {
+		pixels = frame.converted(PixelFormat::Mono8);
+		stride = frame.convertedStride(PixelFormat::Mono8);
+	}
+	const size_t width = frame.width();
+	const size_t height = frame.height();
+	if (!pixels || width == 0 || height == 0) {
+		return false;
+	}
+
+	double centreX = lastX;
+	double centreY = lastY;
+	if (!tracking) {
+		Feature coarse;
+		if (!centroid(pixels, stride, 0, 0, width, height, config.coarseStep, config.threshold, coarse)) {
+			return false;
+		}
+		centreX = coarse.x;
+		centreY = coarse.y;
+	}
+
+	const size_t radius = config.searchRadius;
+	const size_t cx = static_cast<size_t>(centreX < 0.0 ? 0.0 : centreX);
+	const size_t cy = static_cast<size_t>(centreY < 0.0 ? 0.0 : centreY);
+	const size_t x0 = cx > radius ? cx - radius : 0;
+	const size_t y0 = cy > radius ? cy - radius : 0;
+	const size_t x1 = cx + radius + 1 < width ? cx + radius + 1 : width;
+	const size_t y1 = cy + radius + 1 < height ? cy + radius + 1 : height;
+	if (x0 >= x1 || y0 >= y1 || !centroid(pixels, stride, x0, y0, x1, y1, 1, config.threshold, feature)
+		|| feature.area < config.minArea) {
+		tracking = false;
+		return false;
+	}
+	tracking = true;
+	lastX = feature.x;
+	lastY = feature.y;
+	return true;
+}
+
+void CentroidExtractor::reset() {
+	tracking = false;
+}
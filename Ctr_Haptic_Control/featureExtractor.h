@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "frame.h"
+
+using namespace std;
+
+
+// Image position of whatever the closed loop steers, in pixels.
+struct Feature {
+	double x = 0.0;
+	double y = 0.0;
+	// Pixels that made up the feature.
+	size_t area = 0;
+};
+
+// Finds the feature in a frame; called on the control thread, inside the
+// latency budget.
+class IFeatureExtractor {
+
+public:
+	virtual ~IFeatureExtractor() = default;
+	virtual string name() const = 0;
+	virtual bool extract(const Frame& frame, Feature& feature) = 0;
+};
+
+struct CentroidConfig {
+	// Pixels at or above this are part of the feature.
+	uint8_t threshold = 128;
+	// Half-size of the window searched around the last position.
+	size_t searchRadius = 64;
+	// Sampling step of the full-frame search used until the feature is found.
+	size_t coarseStep = 4;
+	size_t minArea = 4;
+};
+
+// Centroid of the bright pixels of a spot or fiducial. Once found, only a
+// window around the last position is scanned, so the cost is independent
+// of the frame size; a full-frame search at coarseStep runs when the
+// feature is lost. Mono8 and BayerRG8 frames are thresholded in place (a
+// bright spot is bright in every Bayer channel); other formats go through
+// Frame::converted().
+class CentroidExtractor : public IFeatureExtractor {
+
+private:
+	CentroidConfig config;
+	bool tracking;
+	double lastX;
+	double lastY;
+
+	static bool centroid(const uint8_t* pixels, size_t stride, size_t x0, size_t y0, size_t x1, size_t y1,
+		size_t step, uint8_t threshold, Feature& feature);
+
+public:
+	explicit CentroidExtractor(const CentroidConfig& config_);
+
+	string name() const override;
+	bool extract(const Frame& frame, Feature& feature) override;
+	// Forget the last position; the next frame is searched in full.
+	void reset();
+};
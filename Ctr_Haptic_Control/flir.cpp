@@ -1,40 +1,549 @@
+#include <algorithm>
 #include <iterator>
 #include <sstream>
 
 #include "flir.h"
+#include "utilities.h"
 
 
-Flir::Flir(CameraPtr pCam_) : 
+Flir::Flir(CameraPtr pCam_, size_t ringCapacity) :
 		pCam{ pCam_ },
-		nodeMap{ pCam->GetTLDeviceNodeMap() },
-		nodeMapTLDevice{ pCam->GetTLDeviceNodeMap() }
+		nodeMapTLDevice{ pCam->GetTLDeviceNodeMap() },
+		nodeMap{ initCamera(pCam) },
+		userBuffersEnabled{ false },
+		userBufferCount{ 0 },
+		userBufferHugePages{ false },
+		pool{ 2 * ringCapacity, this },
+		heldImages(2 * ringCapacity),
+		frames{ ringCapacity },
+		deliveryMode{ DeliveryMode::Polling },
+		imageHandler{ *this },
+		streaming{ false },
+		framesGrabbed{ 0 },
+		framesIncomplete{ 0 },
+		framesDropped{ 0 },
+		roiWindowFrames{ 0 },
+		roiWindowStart{ 0 },
+		roiWindowEnd{ 0 },
+		roiResultingFrameRate{ 0.0 }
 	{
 	printDeviceInformation(nodeMapTLDevice);
-	pCam->Init();
-	nodeMap = pCam->GetNodeMap();
-	CEnumerationPtr ptrAcquisitionMode = pCam->GetNodeMap().GetNode("AcquisitionMode");
-	CEnumEntryPtr ptrAcquisitionModeContinuous = ptrAcquisitionMode->GetEntryByName("Continuous");
-	const int64_t acquisitionModeContinuous = ptrAcquisitionModeContinuous->GetValue();
-	ptrAcquisitionMode->SetIntValue(acquisitionModeContinuous);
+	setEnumNode(nodeMap, "AcquisitionMode", "Continuous");
+	setEnumNode(pCam->GetTLStreamNodeMap(), "StreamBufferHandlingMode", "OldestFirst");
 }
 
 Flir::~Flir() {
-	
+	stopStreaming();
+	pCam->DeInit();
+}
+
+Flir::ImageHandler::ImageHandler(Flir& owner_) :
+	owner{ owner_ }
+{}
+
+void Flir::ImageHandler::OnImageEvent(ImagePtr image) {
+	owner.publishImage(image);
+}
+
+INodeMap& Flir::initCamera(CameraPtr pCam) {
+	pCam->Init();
+	return pCam->GetNodeMap();
 }
 
-vector<char> Flir::acquireImage() {
+void Flir::setEnumNode(INodeMap& map, const char* node, const char* entry) {
+	CEnumerationPtr ptrEnum = map.GetNode(node);
+	if (!IsAvailable(ptrEnum) || !IsWritable(ptrEnum)) {
+		cout << "Unable to set " << node << " (node not writable)." << endl;
+		return;
+	}
+	CEnumEntryPtr ptrEntry = ptrEnum->GetEntryByName(entry);
+	if (!IsAvailable(ptrEntry) || !IsReadable(ptrEntry)) {
+		cout << "Unable to set " << node << " to " << entry << " (entry not available)." << endl;
+		return;
+	}
+	ptrEnum->SetIntValue(ptrEntry->GetValue());
+}
+
+void Flir::setDeliveryMode(DeliveryMode mode) {
+	if (!streaming) {
+		deliveryMode = mode;
+	}
+}
+
+void Flir::startStreaming() {
+	if (streaming) {
+		return;
+	}
+	if (userBuffersEnabled && !configureUserBuffers()) {
+		cout << "Falling back to driver-owned stream buffers." << endl;
+		pCam->SetBufferOwnership(BUFFER_OWNERSHIP_SYSTEM);
+	}
+	beginAcquisition();
+}
+
+void Flir::beginAcquisition() {
+	CFloatPtr ptrResultingRate = nodeMap.GetNode("AcquisitionResultingFrameRate");
+	roiResultingFrameRate = IsAvailable(ptrResultingRate) && IsReadable(ptrResultingRate) ? ptrResultingRate->GetValue() : 0.0;
+	if (deliveryMode == DeliveryMode::Event) {
+		pCam->RegisterEventHandler(imageHandler);
+		streaming = true;
+	}
 	pCam->BeginAcquisition();
-	ImagePtr pResultImage = pCam->GetNextImage(1000);
-	if (pResultImage->IsIncomplete()) {
-		return vector<char>();
+	if (userBuffersEnabled && arena.isAllocated()) {
+		CIntegerPtr ptrCountResult = pCam->GetTLStreamNodeMap().GetNode("StreamBufferCountResult");
+		if (IsAvailable(ptrCountResult) && IsReadable(ptrCountResult)
+			&& static_cast<size_t>(ptrCountResult->GetValue()) != arena.getBufferCount()) {
+			cout << "Driver is using " << ptrCountResult->GetValue() << " of " << arena.getBufferCount()
+				 << " arena buffers." << endl;
+		}
+	}
+	if (deliveryMode == DeliveryMode::Polling) {
+		streaming = true;
+		grabThread = thread(&Flir::grabLoop, this);
+	}
+}
+
+void Flir::stopStreaming() {
+	if (!streaming) {
+		return;
+	}
+	streaming = false;
+	if (grabThread.joinable()) {
+		grabThread.join();
+	}
+	Frame frame;
+	while (frames.tryPop(frame)) {
+		frame.reset();
+	}
+	if (pool.inUse() > 0) {
+		cout << "Warning: " << pool.inUse() << " frames still referenced when stopping the stream." << endl;
+	}
+	endAcquisition();
+	closeRoiWindow();
+}
+
+void Flir::endAcquisition() {
+	pCam->EndAcquisition();
+	if (deliveryMode == DeliveryMode::Event) {
+		pCam->UnregisterEventHandler(imageHandler);
+	}
+}
+
+void Flir::useUserBuffers(size_t bufferCount, bool hugePages) {
+	userBuffersEnabled = true;
+	userBufferCount = bufferCount;
+	userBufferHugePages = hugePages;
+}
+
+bool Flir::configureUserBuffers() {
+	INodeMap& streamNodeMap = pCam->GetTLStreamNodeMap();
+	CIntegerPtr ptrPayloadSize = nodeMap.GetNode("PayloadSize");
+	if (!IsAvailable(ptrPayloadSize) || !IsReadable(ptrPayloadSize)) {
+		cout << "Unable to determine the payload size from the nodemap." << endl;
+		return false;
+	}
+	size_t count = userBufferCount;
+	if (count == 0) {
+		CIntegerPtr ptrCountResult = streamNodeMap.GetNode("StreamBufferCountResult");
+		count = IsAvailable(ptrCountResult) && IsReadable(ptrCountResult)
+			? static_cast<size_t>(ptrCountResult->GetValue())
+			: pool.capacity();
+	}
+	setEnumNode(streamNodeMap, "StreamBufferCountMode", "Manual");
+	if (!arena.allocate(static_cast<size_t>(ptrPayloadSize->GetValue()), count, userBufferHugePages)) {
+		return false;
+	}
+	pCam->SetBufferOwnership(BUFFER_OWNERSHIP_USER);
+	pCam->SetUserBuffers(arena.buffers(), arena.getBufferCount(), arena.getBufferSize());
+	return true;
+}
+
+ArenaReport Flir::getArenaReport() const {
+	ArenaReport report;
+	report.totalBytes = arena.getTotalSize();
+	report.bufferSize = arena.getBufferSize();
+	report.bufferCount = arena.getBufferCount();
+	report.buffersInUse = pool.inUse();
+	report.peakBuffersInUse = pool.peakInUse();
+	report.hugePages = arena.usesHugePages();
+	return report;
+}
+
+bool Flir::isStreaming() const {
+	return streaming;
+}
+
+PixelFormat Flir::toPixelFormat(PixelFormatEnums format) {
+	switch (format) {
+	case PixelFormat_Mono8:
+		return PixelFormat::Mono8;
+	case PixelFormat_Mono16:
+		return PixelFormat::Mono16;
+	case PixelFormat_BayerRG8:
+		return PixelFormat::BayerRG8;
+	case PixelFormat_BayerRG16:
+		return PixelFormat::BayerRG16;
+	case PixelFormat_BGR8:
+		return PixelFormat::BGR8;
+	default:
+		return PixelFormat::Unknown;
+	}
+}
+
+void Flir::grabLoop() {
+	while (streaming) {
+		try {
+			publishImage(pCam->GetNextImage(GRAB_TIMEOUT_MS));
+		}
+		catch (Spinnaker::Exception& e) {
+			if (e.GetError() != SPINNAKER_ERR_TIMEOUT) {
+				cout << "Error: " << e.what() << endl;
+			}
+		}
+	}
+}
+
+// Runs on the grab thread or the driver's event thread; keep it short.
+void Flir::publishImage(ImagePtr image) {
+	const uint64_t arrival = hostNanos();
+	if (!streaming) {
+		releaseImage(image);
+		return;
+	}
+	if (image->IsIncomplete()) {
+		framesIncomplete++;
+		releaseImage(image);
+		return;
+	}
+	FrameInfo info;
+	info.width = image->GetWidth();
+	info.height = image->GetHeight();
+	info.stride = image->GetStride();
+	info.offsetX = image->GetXOffset();
+	info.offsetY = image->GetYOffset();
+	info.pixelFormat = toPixelFormat(image->GetPixelFormat());
+	info.timestamp = image->GetTimeStamp();
+	info.frameId = image->GetFrameID();
+	info.hostTimestamp = arrival;
+
+	// The grab thread may wait briefly for a consumer; the driver's event
+	// thread must not, so an event that finds no room is dropped at once.
+	const auto deadline = chrono::steady_clock::now()
+		+ (deliveryMode == DeliveryMode::Polling ? HANDOFF_TIMEOUT : chrono::milliseconds(0));
+	Frame frame;
+	while (!(frame = pool.acquire(image->GetData(), image->GetImageSize(), info))) {
+		if (!streaming || chrono::steady_clock::now() >= deadline) {
+			framesDropped++;
+			releaseImage(image);
+			return;
+		}
+		this_thread::yield();
+	}
+	heldImages[frame.slotIndex()] = image;
+	while (!frames.tryPush(move(frame))) {
+		if (!streaming || chrono::steady_clock::now() >= deadline) {
+			framesDropped++;
+			return;
+		}
+		this_thread::yield();
+	}
+	framesGrabbed++;
+	if (roiWindowFrames.load(memory_order_relaxed) == 0) {
+		roiWindowStart.store(arrival, memory_order_relaxed);
+	}
+	roiWindowEnd.store(arrival, memory_order_relaxed);
+	roiWindowFrames.fetch_add(1, memory_order_release);
+}
+
+// Polled images go back with Release(); event images are requeued by the
+// driver once the last ImagePtr to them is dropped.
+void Flir::releaseImage(ImagePtr& image) {
+	try {
+		if (deliveryMode == DeliveryMode::Polling) {
+			image->Release();
+		}
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+	}
+	image = nullptr;
+}
+
+void Flir::releaseFrame(size_t slot) {
+	releaseImage(heldImages[slot]);
+}
+
+static int64_t alignToNode(CIntegerPtr node, int64_t value) {
+	const int64_t minimum = node->GetMin();
+	const int64_t maximum = node->GetMax();
+	const int64_t increment = node->GetInc() > 0 ? node->GetInc() : 1;
+	if (value < minimum) {
+		value = minimum;
+	}
+	if (value > maximum) {
+		value = maximum;
+	}
+	return minimum + (value - minimum) / increment * increment;
+}
+
+Roi Flir::getRoi() const {
+	Roi roi;
+	try {
+		roi.offsetX = static_cast<size_t>(CIntegerPtr(nodeMap.GetNode("OffsetX"))->GetValue());
+		roi.offsetY = static_cast<size_t>(CIntegerPtr(nodeMap.GetNode("OffsetY"))->GetValue());
+		roi.width = static_cast<size_t>(CIntegerPtr(nodeMap.GetNode("Width"))->GetValue());
+		roi.height = static_cast<size_t>(CIntegerPtr(nodeMap.GetNode("Height"))->GetValue());
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+	}
+	return roi;
+}
+
+bool Flir::latchTimestamp(ClockLatch& latch) {
+	try {
+		CCommandPtr ptrLatch = nodeMap.GetNode("TimestampLatch");
+		CIntegerPtr ptrValue = nodeMap.GetNode("TimestampLatchValue");
+		if (!IsAvailable(ptrLatch) || !IsWritable(ptrLatch)) {
+			ptrLatch = nodeMap.GetNode("GevTimestampControlLatch");
+			ptrValue = nodeMap.GetNode("GevTimestampValue");
+		}
+		if (!IsAvailable(ptrLatch) || !IsWritable(ptrLatch) || !IsAvailable(ptrValue) || !IsReadable(ptrValue)) {
+			return false;
+		}
+		latch.hostBefore = hostNanos();
+		ptrLatch->Execute();
+		latch.hostAfter = hostNanos();
+		latch.timestamp = static_cast<uint64_t>(ptrValue->GetValue());
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+		return false;
+	}
+	return true;
+}
+
+Roi Flir::getSensorRoi() const {
+	Roi roi;
+	try {
+		roi.width = static_cast<size_t>(CIntegerPtr(nodeMap.GetNode("WidthMax"))->GetValue());
+		roi.height = static_cast<size_t>(CIntegerPtr(nodeMap.GetNode("HeightMax"))->GetValue());
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+	}
+	return roi;
+}
+
+// Writes the nodes in an order the camera accepts whatever the current
+// window: offsets to zero, then size, then the new offsets.
+bool Flir::applyRoi(const Roi& roi) {
+	try {
+		CIntegerPtr ptrOffsetX = nodeMap.GetNode("OffsetX");
+		CIntegerPtr ptrOffsetY = nodeMap.GetNode("OffsetY");
+		CIntegerPtr ptrWidth = nodeMap.GetNode("Width");
+		CIntegerPtr ptrHeight = nodeMap.GetNode("Height");
+		if (!IsWritable(ptrOffsetX) || !IsWritable(ptrOffsetY) || !IsWritable(ptrWidth) || !IsWritable(ptrHeight)) {
+			cout << "Unable to set the ROI (nodes not writable)." << endl;
+			return false;
+		}
+		ptrOffsetX->SetValue(ptrOffsetX->GetMin());
+		ptrOffsetY->SetValue(ptrOffsetY->GetMin());
+		ptrWidth->SetValue(alignToNode(ptrWidth, static_cast<int64_t>(roi.width)));
+		ptrHeight->SetValue(alignToNode(ptrHeight, static_cast<int64_t>(roi.height)));
+		ptrOffsetX->SetValue(alignToNode(ptrOffsetX, static_cast<int64_t>(roi.offsetX)));
+		ptrOffsetY->SetValue(alignToNode(ptrOffsetY, static_cast<int64_t>(roi.offsetY)));
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+		return false;
+	}
+	return true;
+}
+
+bool Flir::setRoi(const Roi& roi) {
+	const Roi current = getRoi();
+	try {
+		CIntegerPtr ptrWidth = nodeMap.GetNode("Width");
+		CIntegerPtr ptrHeight = nodeMap.GetNode("Height");
+		const size_t width = static_cast<size_t>(alignToNode(ptrWidth, static_cast<int64_t>(roi.width)));
+		const size_t height = static_cast<size_t>(alignToNode(ptrHeight, static_cast<int64_t>(roi.height)));
+
+		// Same size: move the window between frames if the camera allows
+		// offset writes during acquisition.
+		if (width == current.width && height == current.height) {
+			CIntegerPtr ptrOffsetX = nodeMap.GetNode("OffsetX");
+			CIntegerPtr ptrOffsetY = nodeMap.GetNode("OffsetY");
+			if (IsWritable(ptrOffsetX) && IsWritable(ptrOffsetY)) {
+				ptrOffsetX->SetValue(alignToNode(ptrOffsetX, static_cast<int64_t>(roi.offsetX)));
+				ptrOffsetY->SetValue(alignToNode(ptrOffsetY, static_cast<int64_t>(roi.offsetY)));
+				return true;
+			}
+		}
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+		return false;
+	}
+
+	// A size change restarts acquisition, which hands every arena buffer
+	// back to the driver: nothing may still be reading one. Stop publishing,
+	// drop what nobody has popped yet and give consumers a moment to let go.
+	const bool wasStreaming = streaming;
+	if (wasStreaming) {
+		streaming = false;
+		if (grabThread.joinable()) {
+			grabThread.join();
+		}
+		if (!drainFrames(ROI_DRAIN_TIMEOUT)) {
+			cout << "ROI change refused: " << pool.inUse() << " frames are still referenced." << endl;
+			streaming = true;
+			if (deliveryMode == DeliveryMode::Polling) {
+				grabThread = thread(&Flir::grabLoop, this);
+			}
+			return false;
+		}
+		endAcquisition();
+		// An event delivered while draining may have slipped into the ring.
+		if (!drainFrames(chrono::milliseconds(0))) {
+			cout << "Error: " << pool.inUse() << " frames referenced after acquisition ended; stream left stopped." << endl;
+			closeRoiWindow();
+			return false;
+		}
+		// Every slot is free, so nothing here is still referenced; these
+		// images belong to the acquisition just ended.
+		fill(heldImages.begin(), heldImages.end(), nullptr);
+	}
+	closeRoiWindow();
+
+	bool applied = applyRoi(roi);
+	if (applied && wasStreaming && userBuffersEnabled && arena.isAllocated() && !configureUserBuffers()) {
+		pCam->SetBufferOwnership(BUFFER_OWNERSHIP_SYSTEM);
+	}
+
+	if (wasStreaming) {
+		beginAcquisition();
+	}
+	return applied;
+}
+
+// Empties the ring and waits up to timeout for consumers to release the
+// frames they hold; true once no frame is referenced.
+bool Flir::drainFrames(chrono::milliseconds timeout) {
+	const auto deadline = chrono::steady_clock::now() + timeout;
+	Frame frame;
+	while (true) {
+		while (frames.tryPop(frame)) {
+			frame.reset();
+		}
+		if (pool.inUse() == 0) {
+			return true;
+		}
+		if (chrono::steady_clock::now() >= deadline) {
+			return false;
+		}
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
+
+bool Flir::trackRoi(size_t centerX, size_t centerY) {
+	const Roi sensor = getSensorRoi();
+	Roi roi = getRoi();
+	const size_t halfWidth = roi.width / 2;
+	const size_t halfHeight = roi.height / 2;
+	roi.offsetX = centerX > halfWidth ? centerX - halfWidth : 0;
+	roi.offsetY = centerY > halfHeight ? centerY - halfHeight : 0;
+	if (roi.offsetX + roi.width > sensor.width) {
+		roi.offsetX = sensor.width > roi.width ? sensor.width - roi.width : 0;
+	}
+	if (roi.offsetY + roi.height > sensor.height) {
+		roi.offsetY = sensor.height > roi.height ? sensor.height - roi.height : 0;
+	}
+	return setRoi(roi);
+}
+
+// Time covered by count arrivals, counting a full frame period for the
+// first one as well.
+static double windowSeconds(uint64_t count, uint64_t start, uint64_t end) {
+	if (count < 2 || end <= start) {
+		return 0.0;
+	}
+	return (end - start) / 1e9 * count / (count - 1);
+}
+
+// Folds the arrivals since the last size change into the per-size totals.
+// Only called while acquisition is stopped.
+void Flir::closeRoiWindow() {
+	const uint64_t count = roiWindowFrames.exchange(0);
+	if (count == 0) {
+		return;
+	}
+	const Roi roi = getRoi();
+	lock_guard<mutex> lock(roiLock);
+	RoiRate& rate = roiRates[make_pair(roi.width, roi.height)];
+	rate.width = roi.width;
+	rate.height = roi.height;
+	rate.frames += count;
+	rate.seconds += windowSeconds(count, roiWindowStart, roiWindowEnd);
+	rate.resultingFrameRate = roiResultingFrameRate;
+}
+
+vector<RoiRate> Flir::getRoiRates() const {
+	map<pair<size_t, size_t>, RoiRate> rates;
+	{
+		lock_guard<mutex> lock(roiLock);
+		rates = roiRates;
+	}
+	const uint64_t count = roiWindowFrames.load(memory_order_acquire);
+	if (count > 0) {
+		const Roi roi = getRoi();
+		RoiRate& rate = rates[make_pair(roi.width, roi.height)];
+		rate.width = roi.width;
+		rate.height = roi.height;
+		rate.frames += count;
+		rate.seconds += windowSeconds(count, roiWindowStart, roiWindowEnd);
+		rate.resultingFrameRate = roiResultingFrameRate;
 	}
-	else {
-		ImagePtr convertedImage = pResultImage->Convert(PixelFormat_Mono8, EDGE_SENSING);
-		//ostringstream filename{ "test.png" };
-		//convertedImage->Save(filename.str().c_str());
-		char* data = (char*)convertedImage->GetData();
-		return vector<char>(data, data + strlen(data));
+
+	vector<RoiRate> result;
+	for (auto& entry : rates) {
+		RoiRate rate = entry.second;
+		rate.fps = rate.seconds > 0.0 ? rate.frames / rate.seconds : 0.0;
+		result.push_back(rate);
 	}
+	return result;
+}
+
+bool Flir::tryPopFrame(Frame& frame) {
+	if (!frames.tryPop(frame)) {
+		return false;
+	}
+	deliveryLatency.record(hostNanos() - frame.info().hostTimestamp);
+	return true;
+}
+
+CameraStats Flir::getStats() const {
+	CameraStats stats;
+	stats.framesGrabbed = framesGrabbed;
+	stats.framesIncomplete = framesIncomplete;
+	stats.framesDropped = framesDropped;
+	stats.deliveryLatency = deliveryLatency.summary();
+	return stats;
+}
+
+Frame Flir::acquireImage() {
+	startStreaming();
+	Frame frame;
+	waitForFrame(frame, chrono::milliseconds(1000));
+	return frame;
+}
+
+string Flir::name() const {
+	CStringPtr ptrSerial = nodeMapTLDevice.GetNode("DeviceSerialNumber");
+	if (IsAvailable(ptrSerial) && IsReadable(ptrSerial)) {
+		return string(ptrSerial->GetValue().c_str());
+	}
+	return "flir";
 }
 
 const void Flir::printDeviceInformation(INodeMap& nodeMap) {
@@ -64,4 +573,4 @@ const void Flir::printDeviceInformation(INodeMap& nodeMap) {
 		cout << "Error: " << e.what() << endl;
 	}
 
-}
\ No newline at end of file
+}
@@ -1,11 +1,22 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "Spinnaker.h"
 #include "SpinGenApi/SpinnakerGenApi.h"
+#include "bufferArena.h"
+#include "frame.h"
+#include "icamera.h"
+#include "latencyHistogram.h"
+#include "ringBuffer.h"
 
 using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
@@ -13,16 +24,138 @@ using namespace Spinnaker::GenICam;
 using namespace std;
 
 
-class Flir {
+enum class DeliveryMode {
+	Polling,
+	Event
+};
+
+// Sensor readout window, in pixels.
+struct Roi {
+	size_t offsetX = 0;
+	size_t offsetY = 0;
+	size_t width = 0;
+	size_t height = 0;
+};
+
+// Frame rate achieved while streaming at one ROI size.
+struct RoiRate {
+	size_t width = 0;
+	size_t height = 0;
+	uint64_t frames = 0;
+	double seconds = 0.0;
+	double fps = 0.0;
+	// AcquisitionResultingFrameRate reported when the size was applied.
+	double resultingFrameRate = 0.0;
+};
+
+class Flir : public ICamera, public ICameraClock, private FrameReleaser {
 
 private:
+	class ImageHandler : public ImageEventHandler {
+
+	private:
+		Flir& owner;
+
+	public:
+		explicit ImageHandler(Flir& owner_);
+		void OnImageEvent(ImagePtr image) override;
+	};
+
+	static constexpr uint64_t GRAB_TIMEOUT_MS = 100;
+	// How long a full handoff queue may hold up the polling grab thread
+	// before the frame is dropped. The driver keeps queueing into its own
+	// buffers meanwhile, so short consumer stalls lose nothing. Event
+	// delivery never waits: the driver's callback drops at once.
+	static constexpr chrono::milliseconds HANDOFF_TIMEOUT{ 50 };
+	static constexpr chrono::milliseconds ROI_DRAIN_TIMEOUT{ 100 };
+
 	CameraPtr pCam;
-	INodeMap& nodeMap;
 	INodeMap& nodeMapTLDevice;
+	INodeMap& nodeMap;
+
+	BufferArena arena;
+	bool userBuffersEnabled;
+	size_t userBufferCount;
+	bool userBufferHugePages;
+
+	FramePool pool;
+	vector<ImagePtr> heldImages;
+	RingBuffer<Frame> frames;
+	DeliveryMode deliveryMode;
+	ImageHandler imageHandler;
+	thread grabThread;
+	atomic<bool> streaming;
+	atomic<uint64_t> framesGrabbed;
+	atomic<uint64_t> framesIncomplete;
+	atomic<uint64_t> framesDropped;
+	LatencyHistogram deliveryLatency;
+
+	// Arrival window for the current ROI size, written by publishImage().
+	atomic<uint64_t> roiWindowFrames;
+	atomic<uint64_t> roiWindowStart;
+	atomic<uint64_t> roiWindowEnd;
+	// Set when acquisition begins; read by getRoiRates() from any thread.
+	atomic<double> roiResultingFrameRate;
+	mutable mutex roiLock;
+	map<pair<size_t, size_t>, RoiRate> roiRates;
+
+	static INodeMap& initCamera(CameraPtr pCam);
+	static void setEnumNode(INodeMap& map, const char* node, const char* entry);
+	static PixelFormat toPixelFormat(PixelFormatEnums format);
+	bool configureUserBuffers();
+	void beginAcquisition();
+	void endAcquisition();
+	bool drainFrames(chrono::milliseconds timeout);
+	bool applyRoi(const Roi& roi);
+	void closeRoiWindow();
+	void grabLoop();
+	void publishImage(ImagePtr image);
+	void releaseImage(ImagePtr& image);
+	void releaseFrame(size_t slot) override;
+
 public:
-	Flir(CameraPtr pCam_);
+	Flir(CameraPtr pCam_, size_t ringCapacity = 64);
 	~Flir();
-	
+	Flir(const Flir&) = delete;
+	Flir& operator=(const Flir&) = delete;
+
 	const void printDeviceInformation(INodeMap& nodeMap);
-	vector<char> acquireImage();
-};
\ No newline at end of file
+	string name() const override;
+
+	// Stream into a preallocated BufferArena instead of driver-owned memory.
+	// A bufferCount of 0 keeps the camera's current StreamBufferCountResult.
+	// Takes effect on the next startStreaming().
+	void useUserBuffers(size_t bufferCount = 0, bool hugePages = false);
+	ArenaReport getArenaReport() const;
+
+	// Event delivery pushes frames from the driver's ImageEventHandler
+	// callback instead of a grab thread. Takes effect on the next startStreaming().
+	void setDeliveryMode(DeliveryMode mode);
+
+	// Values are clamped to the sensor and rounded down to the node
+	// increments. An offset-only change is applied between frames without
+	// stopping the stream when the camera allows it; a size change restarts
+	// acquisition, and fails, leaving the stream as it was, if consumers
+	// still hold frames after ROI_DRAIN_TIMEOUT.
+	bool setRoi(const Roi& roi);
+	Roi getRoi() const;
+	Roi getSensorRoi() const;
+	// Keeps the current ROI size and centres it on a sensor position.
+	bool trackRoi(size_t centerX, size_t centerY);
+	vector<RoiRate> getRoiRates() const;
+
+	void startStreaming() override;
+	void stopStreaming() override;
+	bool isStreaming() const override;
+
+	// Frames reference driver buffers in place; drop them before stopStreaming().
+	bool tryPopFrame(Frame& frame) override;
+	CameraStats getStats() const override;
+
+	// TimestampLatch / TimestampLatchValue, or the GigE Vision
+	// GevTimestampControlLatch / GevTimestampValue on older models; the same
+	// counter Image::GetTimeStamp() reports.
+	bool latchTimestamp(ClockLatch& latch) override;
+
+	Frame acquireImage();
+};
@@ -0,0 +1,278 @@
+#include <thread>
+#include <utility>
+
+#include "frame.h"
+#include "pixelConvert.h"
+
+
+size_t bytesPerPixel(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::Mono8:
+	case PixelFormat::BayerRG8:
+		return 1;
+	case PixelFormat::Mono16:
+	case PixelFormat::BayerRG16:
+		return 2;
+	case PixelFormat::BGR8:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+const char* pixelFormatName(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::Mono8:
+		return "Mono8";
+	case PixelFormat::Mono16:
+		return "Mono16";
+	case PixelFormat::BayerRG8:
+		return "BayerRG8";
+	case PixelFormat::BayerRG16:
+		return "BayerRG16";
+	case PixelFormat::BGR8:
+		return "BGR8";
+	default:
+		return "Unknown";
+	}
+}
+
+
+FramePool::FramePool(size_t capacity, FrameReleaser* releaser_) :
+	slots{ new Slot[capacity] },
+	count{ capacity },
+	cursor{ 0 },
+	releaser{ releaser_ },
+	outstanding{ 0 },
+	peakOutstanding{ 0 },
+	converter{ nullptr },
+	conversionCount{ 0 },
+	conversionHits{ 0 }
+{
+	for (size_t i = 0; i < count; i++) {
+		slots[i].pool = this;
+		slots[i].index = i;
+	}
+}
+
+Frame FramePool::acquire(const void* data, size_t size, const FrameInfo& info) {
+	for (size_t n = 0; n < count; n++) {
+		Slot& slot = slots[cursor];
+		cursor = (cursor + 1) % count;
+		if (slot.inUse.load(memory_order_acquire)) {
+			continue;
+		}
+		slot.inUse.store(true, memory_order_relaxed);
+		slot.data = static_cast<const uint8_t*>(data);
+		slot.size = size;
+		slot.info = info;
+		for (Conversion& conversion : slot.conversions) {
+			conversion.state.store(ConversionEmpty, memory_order_relaxed);
+		}
+		slot.refs.store(1, memory_order_release);
+		const size_t held = ++outstanding;
+		if (held > peakOutstanding.load(memory_order_relaxed)) {
+			peakOutstanding.store(held, memory_order_relaxed);
+		}
+		return Frame(&slot);
+	}
+	return Frame();
+}
+
+void FramePool::bindBuffer(size_t slot, const void* data) {
+	slots[slot].boundData = static_cast<const uint8_t*>(data);
+}
+
+Frame FramePool::acquire(size_t size, const FrameInfo& info) {
+	for (size_t n = 0; n < count; n++) {
+		const Slot& slot = slots[cursor];
+		if (!slot.inUse.load(memory_order_acquire)) {
+			return acquire(slot.boundData, size, info);
+		}
+		cursor = (cursor + 1) % count;
+	}
+	return Frame();
+}
+
+void FramePool::release(Slot& slot) {
+	if (releaser) {
+		releaser->releaseFrame(slot.index);
+	}
+	slot.data = nullptr;
+	outstanding--;
+	slot.inUse.store(false, memory_order_release);
+}
+
+const uint8_t* FramePool::convert(Slot& slot, PixelFormat format) {
+	Conversion& conversion = slot.conversions[static_cast<size_t>(format)];
+	int state = ConversionEmpty;
+	if (!conversion.state.compare_exchange_strong(state, ConversionBusy, memory_order_acquire)) {
+		while (state == ConversionBusy) {
+			this_thread::yield();
+			state = conversion.state.load(memory_order_acquire);
+		}
+		if (state != ConversionReady) {
+			return nullptr;
+		}
+		conversionHits++;
+		return conversion.buffer.get();
+	}
+
+	// A 1-thread converter keeps no per-call state, so concurrent frames
+	// can share it.
+	static PixelConverter defaultConverter(1);
+	PixelConverter& active = converter ? *converter : defaultConverter;
+
+	const size_t stride = PixelConverter::requiredStride(slot.info.width, format);
+	const size_t bytes = stride * slot.info.height;
+	if (conversion.capacity < bytes) {
+		conversion.buffer.reset(new uint8_t[bytes]);
+		conversion.capacity = bytes;
+	}
+	const bool converted = active.convert(slot.data, slot.info.stride, slot.info.pixelFormat,
+		conversion.buffer.get(), stride, format, slot.info.width, slot.info.height);
+	conversionCount++;
+	conversion.state.store(converted ? ConversionReady : ConversionFailed, memory_order_release);
+	return converted ? conversion.buffer.get() : nullptr;
+}
+
+size_t FramePool::capacity() const {
+	return count;
+}
+
+size_t FramePool::inUse() const {
+	return outstanding;
+}
+
+size_t FramePool::peakInUse() const {
+	return peakOutstanding;
+}
+
+void FramePool::setConverter(PixelConverter* converter_) {
+	converter = converter_;
+}
+
+uint64_t FramePool::getConversionCount() const {
+	return conversionCount;
+}
+
+uint64_t FramePool::getConversionHits() const {
+	return conversionHits;
+}
+
+
+Frame::Frame() :
+	slot{ nullptr }
+{}
+
+Frame::Frame(FramePool::Slot* slot_) :
+	slot{ slot_ }
+{}
+
+Frame::Frame(const Frame& other) :
+	slot{ other.slot }
+{
+	if (slot) {
+		slot->refs.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+Frame::Frame(Frame&& other) noexcept :
+	slot{ other.slot }
+{
+	other.slot = nullptr;
+}
+
+Frame& Frame::operator=(const Frame& other) {
+	if (slot != other.slot) {
+		Frame copy(other);
+		swap(slot, copy.slot);
+	}
+	return *this;
+}
+
+Frame& Frame::operator=(Frame&& other) noexcept {
+	if (this != &other) {
+		reset();
+		slot = other.slot;
+		other.slot = nullptr;
+	}
+	return *this;
+}
+
+Frame::~Frame() {
+	reset();
+}
+
+Frame::operator bool() const {
+	return slot != nullptr;
+}
+
+void Frame::reset() {
+	if (slot && slot->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+		slot->pool->release(*slot);
+	}
+	slot = nullptr;
+}
+
+const uint8_t* Frame::data() const {
+	return slot->data;
+}
+
+size_t Frame::size() const {
+	return slot->size;
+}
+
+const FrameInfo& Frame::info() const {
+	return slot->info;
+}
+
+FrameInfo& Frame::mutableInfo() {
+	return slot->info;
+}
+
+size_t Frame::width() const {
+	return slot->info.width;
+}
+
+size_t Frame::height() const {
+	return slot->info.height;
+}
+
+size_t Frame::stride() const {
+	return slot->info.stride;
+}
+
+PixelFormat Frame::pixelFormat() const {
+	return slot->info.pixelFormat;
+}
+
+uint64_t Frame::timestamp() const {
+	return slot->info.timestamp;
+}
+
+uint64_t Frame::frameId() const {
+	return slot->info.frameId;
+}
+
+size_t Frame::slotIndex() const {
+	return slot->index;
+}
+
+size_t Frame::useCount() const {
+	return slot ? slot->refs.load(memory_order_acquire) : 0;
+}
+
+const uint8_t* Frame::converted(PixelFormat format) const {
+	if (format == slot->info.pixelFormat) {
+		return slot->data;
+	}
+	if (!PixelConverter::isSupported(slot->info.pixelFormat, format)) {
+		return nullptr;
+	}
+	return slot->pool->convert(*slot, format);
+}
+
+size_t Frame::convertedStride(PixelFormat format) const {
+	return format == slot->info.pixelFormat ? slot->info.stride : PixelConverter::requiredStride(slot->info.width, format);
+}
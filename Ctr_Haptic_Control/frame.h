@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+
+enum class PixelFormat {
+	Unknown,
+	Mono8,
+	Mono16,
+	BayerRG8,
+	BayerRG16,
+	BGR8
+};
+
+size_t bytesPerPixel(PixelFormat format);
+const char* pixelFormatName(PixelFormat format);
+
+struct FrameInfo {
+	size_t width = 0;
+	size_t height = 0;
+	size_t stride = 0;
+	// Position of the readout window on the sensor.
+	size_t offsetX = 0;
+	size_t offsetY = 0;
+	PixelFormat pixelFormat = PixelFormat::Unknown;
+	uint64_t timestamp = 0;
+	uint64_t frameId = 0;
+	// hostNanos() when the frame reached the host.
+	uint64_t hostTimestamp = 0;
+};
+
+// Implemented by whatever owns the pixel memory behind a FramePool; called
+// once the last Frame referencing a slot goes away.
+class FrameReleaser {
+
+public:
+	virtual ~FrameReleaser() = default;
+	virtual void releaseFrame(size_t slot) = 0;
+};
+
+class Frame;
+class PixelConverter;
+
+// Fixed set of reference-counted frame slots. Slots are preallocated so
+// handing out a Frame never touches the heap. acquire() is single-producer;
+// frames may be released from any thread.
+//
+// Frames stay in the sensor's format. Frame::converted() converts on first
+// request and caches the result on the slot, so every consumer asking for the
+// same format shares one conversion. Conversion buffers are allocated the
+// first time a slot is converted to a format and reused after that.
+class FramePool {
+
+private:
+	friend class Frame;
+
+	static const size_t FORMAT_COUNT = 6;
+
+	enum ConversionState {
+		ConversionEmpty,
+		ConversionBusy,
+		ConversionReady,
+		ConversionFailed
+	};
+
+	struct Conversion {
+		atomic<int> state{ ConversionEmpty };
+		unique_ptr<uint8_t[]> buffer;
+		size_t capacity = 0;
+	};
+
+	struct Slot {
+		FramePool* pool = nullptr;
+		size_t index = 0;
+		atomic<bool> inUse{ false };
+		atomic<uint32_t> refs{ 0 };
+		const uint8_t* data = nullptr;
+		const uint8_t* boundData = nullptr;
+		size_t size = 0;
+		FrameInfo info;
+		Conversion conversions[FORMAT_COUNT];
+	};
+
+	unique_ptr<Slot[]> slots;
+	size_t count;
+	size_t cursor;
+	FrameReleaser* releaser;
+	atomic<size_t> outstanding;
+	atomic<size_t> peakOutstanding;
+
+	PixelConverter* converter;
+	atomic<uint64_t> conversionCount;
+	atomic<uint64_t> conversionHits;
+
+	void release(Slot& slot);
+	const uint8_t* convert(Slot& slot, PixelFormat format);
+
+public:
+	FramePool(size_t capacity, FrameReleaser* releaser_);
+	FramePool(const FramePool&) = delete;
+	FramePool& operator=(const FramePool&) = delete;
+
+	// Returns an empty Frame when every slot is still referenced.
+	Frame acquire(const void* data, size_t size, const FrameInfo& info);
+	// For owners that keep one fixed buffer per slot: bind it once, then
+	// acquire() without a pointer and fill the buffer before publishing.
+	void bindBuffer(size_t slot, const void* data);
+	Frame acquire(size_t size, const FrameInfo& info);
+
+	size_t capacity() const;
+	size_t inUse() const;
+	size_t peakInUse() const;
+
+	// Defaults to a shared single-threaded converter. The converter must
+	// outlive the pool.
+	void setConverter(PixelConverter* converter_);
+	// Conversions actually run, and requests served a converted buffer from
+	// the cache; asking again after a failed conversion is not a hit.
+	uint64_t getConversionCount() const;
+	uint64_t getConversionHits() const;
+};
+
+// Handle to pixel memory owned by a FramePool. Copies share the same
+// buffer; the buffer goes back to its owner when the last copy is dropped.
+// Frames must not outlive the pool (i.e. the camera) that produced them.
+class Frame {
+
+private:
+	friend class FramePool;
+
+	FramePool::Slot* slot;
+
+	explicit Frame(FramePool::Slot* slot_);
+
+public:
+	Frame();
+	Frame(const Frame& other);
+	Frame(Frame&& other) noexcept;
+	Frame& operator=(const Frame& other);
+	Frame& operator=(Frame&& other) noexcept;
+	~Frame();
+
+	explicit operator bool() const;
+	void reset();
+
+	const uint8_t* data() const;
+	size_t size() const;
+	const FrameInfo& info() const;
+	// Producer only, before the frame has been shared.
+	FrameInfo& mutableInfo();
+	size_t width() const;
+	size_t height() const;
+	size_t stride() const;
+	PixelFormat pixelFormat() const;
+	uint64_t timestamp() const;
+	uint64_t frameId() const;
+	size_t slotIndex() const;
+	// Copies of this frame alive, this one included; 0 for an empty frame.
+	size_t useCount() const;
+
+	// The frame's pixels in the given format, converted on first use and
+	// cached for other holders of the same frame. Returns data() when the
+	// frame is already in that format and nullptr when the conversion is
+	// not supported. Rows are convertedStride(format) bytes apart.
+	const uint8_t* converted(PixelFormat format) const;
+	size_t convertedStride(PixelFormat format) const;
+};
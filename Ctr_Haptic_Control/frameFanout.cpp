@@ -0,0 +1,241 @@
+#include <chrono>
+#include <stdexcept>
+
+#include "frameFanout.h"
+
+
+FrameSubscriber::FrameSubscriber(FrameFanout& fanout_, const string& name_, SubscriberPolicy policy_, size_t capacity) :
+	fanout{ fanout_ },
+	subscriberName{ name_ },
+	policy{ policy_ },
+	queue{ policy_ == SubscriberPolicy::Lossless ? capacity : 1 },
+	latestUnread{ false },
+	delivered{ 0 },
+	skipped{ 0 },
+	dropped{ 0 },
+	peakQueueDepth{ 0 },
+	peakBacklog{ 0 }
+{}
+
+void FrameSubscriber::publish(const Frame& frame) {
+	if (policy == SubscriberPolicy::LatestOnly) {
+		Frame replaced = frame;
+		{
+			lock_guard<mutex> lock(latestLock);
+			swap(latest, replaced);
+			if (latestUnread) {
+				skipped++;
+			}
+			latestUnread = true;
+		}
+		// replaced (the old frame) is released here, outside the lock.
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(backlogLock);
+		backlog.push_back(frame);
+	}
+	flushBacklog();
+}
+
+bool FrameSubscriber::flushBacklog() {
+	lock_guard<mutex> lock(backlogLock);
+	if (backlog.size() > peakBacklog) {
+		peakBacklog = backlog.size();
+	}
+	while (!backlog.empty() && queue.tryPush(move(backlog.front()))) {
+		backlog.pop_front();
+	}
+	const size_t depth = queue.size();
+	if (depth > peakQueueDepth) {
+		peakQueueDepth = depth;
+	}
+	return !backlog.empty();
+}
+
+void FrameSubscriber::clear() {
+	{
+		lock_guard<mutex> lock(backlogLock);
+		backlog.clear();
+	}
+	Frame frame;
+	while (queue.tryPop(frame)) {
+		frame.reset();
+	}
+	lock_guard<mutex> lock(latestLock);
+	latest.reset();
+	latestUnread = false;
+}
+
+string FrameSubscriber::name() const {
+	return subscriberName;
+}
+
+SubscriberPolicy FrameSubscriber::getPolicy() const {
+	return policy;
+}
+
+void FrameSubscriber::startStreaming() {
+	fanout.start();
+}
+
+void FrameSubscriber::stopStreaming() {
+	clear();
+}
+
+bool FrameSubscriber::isStreaming() const {
+	return fanout.isRunning();
+}
+
+bool FrameSubscriber::tryPopFrame(Frame& frame) {
+	if (policy == SubscriberPolicy::LatestOnly) {
+		lock_guard<mutex> lock(latestLock);
+		if (!latestUnread) {
+			return false;
+		}
+		frame = latest;
+		latestUnread = false;
+	}
+	else if (!queue.tryPop(frame)) {
+		return false;
+	}
+	delivered++;
+	return true;
+}
+
+CameraStats FrameSubscriber::getStats() const {
+	CameraStats stats = fanout.getCamera().getStats();
+	stats.framesGrabbed = delivered;
+	return stats;
+}
+
+SubscriberStats FrameSubscriber::getSubscriberStats() const {
+	SubscriberStats stats;
+	stats.delivered = delivered;
+	stats.skipped = skipped;
+	stats.dropped = dropped;
+	stats.queueDepth = queue.size();
+	stats.peakQueueDepth = peakQueueDepth;
+	{
+		lock_guard<mutex> lock(backlogLock);
+		stats.backlog = backlog.size();
+	}
+	stats.peakBacklog = peakBacklog;
+	return stats;
+}
+
+
+FrameFanout::FrameFanout(ICamera& camera_, size_t poolCapacity_) :
+	camera{ camera_ },
+	poolCapacity{ poolCapacity_ },
+	losslessLimit{ 0 },
+	running{ false }
+{}
+
+FrameFanout::~FrameFanout() {
+	stop();
+}
+
+FrameSubscriber& FrameFanout::subscribe(const string& name, SubscriberPolicy policy, size_t capacity) {
+	if (running) {
+		throw logic_error("FrameFanout::subscribe called while running");
+	}
+	subscribers.push_back(make_unique<FrameSubscriber>(*this, name, policy, capacity));
+	return *subscribers.back();
+}
+
+void FrameFanout::start() {
+	if (running.exchange(true)) {
+		return;
+	}
+	size_t reserved = 2;
+	for (auto& subscriber : subscribers) {
+		if (subscriber->policy == SubscriberPolicy::LatestOnly) {
+			reserved += 2;
+		}
+	}
+	losslessLimit = poolCapacity > reserved ? poolCapacity - reserved : 0;
+	camera.startStreaming();
+	dispatchThread = thread(&FrameFanout::dispatchLoop, this);
+}
+
+void FrameFanout::stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	if (dispatchThread.joinable()) {
+		dispatchThread.join();
+	}
+	for (auto& subscriber : subscribers) {
+		subscriber->clear();
+	}
+	losslessHeld.clear();
+	camera.stopStreaming();
+}
+
+bool FrameFanout::isRunning() const {
+	return running;
+}
+
+ICamera& FrameFanout::getCamera() {
+	return camera;
+}
+
+void FrameFanout::pruneLosslessHeld() {
+	size_t kept = 0;
+	for (size_t i = 0; i < losslessHeld.size(); i++) {
+		if (losslessHeld[i].useCount() > 1) {
+			losslessHeld[kept++] = move(losslessHeld[i]);
+		}
+	}
+	losslessHeld.resize(kept);
+}
+
+void FrameFanout::dispatchLoop() {
+	bool hasLossless = false;
+	for (auto& subscriber : subscribers) {
+		hasLossless = hasLossless || subscriber->policy == SubscriberPolicy::Lossless;
+	}
+	Frame frame;
+	while (running) {
+		// A backlog drains as its consumer catches up, so poll while any
+		// remains instead of blocking on the camera.
+		bool backlogged = false;
+		for (auto& subscriber : subscribers) {
+			if (subscriber->policy == SubscriberPolicy::Lossless) {
+				backlogged = subscriber->flushBacklog() || backlogged;
+			}
+		}
+		if (backlogged ? !camera.tryPopFrame(frame) : !camera.waitForFrame(frame, chrono::milliseconds(100))) {
+			if (backlogged) {
+				this_thread::sleep_for(chrono::microseconds(200));
+			}
+			continue;
+		}
+		for (auto& subscriber : subscribers) {
+			if (subscriber->policy == SubscriberPolicy::LatestOnly) {
+				subscriber->publish(frame);
+			}
+		}
+		if (hasLossless) {
+			pruneLosslessHeld();
+			const bool admit = losslessHeld.size() < losslessLimit;
+			for (auto& subscriber : subscribers) {
+				if (subscriber->policy != SubscriberPolicy::Lossless) {
+					continue;
+				}
+				if (admit) {
+					subscriber->publish(frame);
+				}
+				else {
+					subscriber->dropped++;
+				}
+			}
+			if (admit) {
+				losslessHeld.push_back(frame);
+			}
+		}
+		frame.reset();
+	}
+}
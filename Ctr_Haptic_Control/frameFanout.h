@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "icamera.h"
+#include "ringBuffer.h"
+
+using namespace std;
+
+
+enum class SubscriberPolicy {
+	// Only the newest frame is kept; unread frames are overwritten.
+	LatestOnly,
+	// Every frame, oldest first, as long as the lossless consumers leave
+	// the camera enough buffers for the LatestOnly ones. Frames the consumer
+	// is not ready for wait in a backlog.
+	Lossless
+};
+
+struct SubscriberStats {
+	uint64_t delivered = 0;
+	// LatestOnly: frames replaced before they were read.
+	uint64_t skipped = 0;
+	size_t queueDepth = 0;
+	size_t peakQueueDepth = 0;
+	// Lossless: frames held back because the queue was full.
+	size_t backlog = 0;
+	size_t peakBacklog = 0;
+	// Lossless: frames not delivered because the lossless consumers already
+	// held their share of the camera's buffers.
+	uint64_t dropped = 0;
+};
+
+class FrameFanout;
+
+// One consumer's view of a fanned-out stream. It is itself an ICamera, so
+// anything written against ICamera (CameraGroup, ...) can sit behind a
+// subscription. Starting a subscriber starts the shared stream; stopping it
+// only discards what it has queued, the stream is stopped through the fanout.
+class FrameSubscriber : public ICamera {
+
+private:
+	friend class FrameFanout;
+
+	FrameFanout& fanout;
+	string subscriberName;
+	SubscriberPolicy policy;
+
+	RingBuffer<Frame> queue;
+	// Frames for a full Lossless queue, oldest first; bounded by the
+	// fanout's lossless share of the camera's buffers.
+	mutable mutex backlogLock;
+	deque<Frame> backlog;
+
+	mutex latestLock;
+	Frame latest;
+	bool latestUnread;
+
+	atomic<uint64_t> delivered;
+	atomic<uint64_t> skipped;
+	atomic<uint64_t> dropped;
+	atomic<size_t> peakQueueDepth;
+	atomic<size_t> peakBacklog;
+
+	void publish(const Frame& frame);
+	// Moves backlogged frames into the queue; true while some remain.
+	bool flushBacklog();
+	void clear();
+
+public:
+	FrameSubscriber(FrameFanout& fanout_, const string& name_, SubscriberPolicy policy_, size_t capacity);
+	FrameSubscriber(const FrameSubscriber&) = delete;
+	FrameSubscriber& operator=(const FrameSubscriber&) = delete;
+
+	string name() const override;
+	SubscriberPolicy getPolicy() const;
+
+	void startStreaming() override;
+	void stopStreaming() override;
+	bool isStreaming() const override;
+
+	bool tryPopFrame(Frame& frame) override;
+	CameraStats getStats() const override;
+	SubscriberStats getSubscriberStats() const;
+};
+
+// Pulls frames from one camera on a dispatch thread and hands each one to
+// every subscriber. Frames are shared by reference, never copied. LatestOnly
+// subscribers are served first and publishing never waits on a Lossless
+// queue: frames a Lossless consumer is not ready for go to its backlog.
+//
+// Every camera buffer a lossless frame holds, in a subscriber's queue or
+// backlog or anywhere downstream (a recorder's queue, say), counts against
+// a share of the camera's pool that leaves two buffers per LatestOnly
+// subscriber and two for the camera and the dispatcher. A frame arriving
+// while that share is used up is not given to the Lossless subscribers and
+// counts as dropped for each, so a stalled recorder can never starve the
+// control path of fresh frames.
+class FrameFanout {
+
+private:
+	ICamera& camera;
+	size_t poolCapacity;
+	vector<unique_ptr<FrameSubscriber>> subscribers;
+	// Dispatch thread only: a copy of every frame given to the Lossless
+	// subscribers that something downstream still holds.
+	vector<Frame> losslessHeld;
+	size_t losslessLimit;
+	thread dispatchThread;
+	atomic<bool> running;
+
+	// Forgets frames nothing but losslessHeld refers to any more.
+	void pruneLosslessHeld();
+	void dispatchLoop();
+
+public:
+	// poolCapacity is how many frames the camera can have outstanding at
+	// once (SimCameraConfig::bufferCount, the FLIR stream buffer count).
+	explicit FrameFanout(ICamera& camera_, size_t poolCapacity_ = 32);
+	~FrameFanout();
+	FrameFanout(const FrameFanout&) = delete;
+	FrameFanout& operator=(const FrameFanout&) = delete;
+
+	// Subscribe before start(); subscribers live as long as the fanout.
+	FrameSubscriber& subscribe(const string& name, SubscriberPolicy policy, size_t capacity = 32);
+
+	void start();
+	void stop();
+	bool isRunning() const;
+
+	ICamera& getCamera();
+};
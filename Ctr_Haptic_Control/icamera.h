@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "frame.h"
+#include "latencyHistogram.h"
+
+using namespace std;
+
+
+struct CameraStats {
+	uint64_t framesGrabbed = 0;
+	uint64_t framesIncomplete = 0;
+	uint64_t framesDropped = 0;
+	// Host arrival to tryPopFrame().
+	LatencySummary deliveryLatency;
+};
+
+// One reading of a camera's timestamp counter, bracketed by hostNanos()
+// taken just before and after the latch command.
+struct ClockLatch {
+	uint64_t timestamp = 0;
+	uint64_t hostBefore = 0;
+	uint64_t hostAfter = 0;
+};
+
+// Camera whose timestamp counter, the one frames are stamped with, can be
+// latched on demand; what ClockSync works from.
+class ICameraClock {
+
+public:
+	virtual ~ICameraClock() = default;
+	virtual bool latchTimestamp(ClockLatch& latch) = 0;
+};
+
+// Frame source the acquisition pipeline is written against. Implementations
+// stream into a bounded ring from their own thread; consumers pop Frames.
+class ICamera {
+
+public:
+	virtual ~ICamera() = default;
+
+	virtual string name() const = 0;
+
+	virtual void startStreaming() = 0;
+	virtual void stopStreaming() = 0;
+	virtual bool isStreaming() const = 0;
+
+	virtual bool tryPopFrame(Frame& frame) = 0;
+	virtual CameraStats getStats() const = 0;
+
+	bool waitForFrame(Frame& frame, chrono::milliseconds timeout) {
+		const auto deadline = chrono::steady_clock::now() + timeout;
+		while (!tryPopFrame(frame)) {
+			if (!isStreaming() || chrono::steady_clock::now() >= deadline) {
+				return false;
+			}
+			this_thread::yield();
+		}
+		return true;
+	}
+};
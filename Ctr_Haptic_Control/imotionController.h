@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+#include "telemetry.h"
+
+using namespace std;
+
+
+// Stage status bits reported in StageSample::status by every controller.
+const uint32_t STAGE_STATUS_FAULT = 1u << 0;
+const uint32_t STAGE_STATUS_FOLLOWING_ERROR = 1u << 1;
+
+// Motion controller the stage side is written against, the counterpart of
+// ICamera. Positions are in millimetres and speeds in millimetres per
+// second, on the x, y and z axes. Commands return once the controller has
+// accepted them, not when the motion is done.
+class IMotionController {
+
+public:
+	virtual ~IMotionController() = default;
+
+	virtual string name() const = 0;
+
+	virtual bool connect() = 0;
+	virtual void disconnect() = 0;
+	virtual bool isConnected() const = 0;
+
+	virtual bool enable() = 0;
+	virtual bool moveAbsolute(double x, double y, double z, double speed) = 0;
+	virtual bool moveIncremental(double dx, double dy, double dz, double speed) = 0;
+	// Runs each axis at the given speed until the next command.
+	virtual bool setVelocity(double vx, double vy, double vz) = 0;
+	// Decelerates every axis to a stop.
+	virtual bool stop() = 0;
+
+	// Position feedback and status of every axis, in one round trip. Fills
+	// everything but hostTimestamp; controllerTimestamp stays 0 when the
+	// controller has no clock to report. Safe to call from a sampling thread
+	// while another thread commands.
+	virtual bool readFeedback(StageSample& sample) = 0;
+
+	virtual string lastError() const = 0;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "telemetry.h"
+
+using namespace std;
+
+
+// Source of stage position samples, the stage-side counterpart of ICamera.
+// Implementations sample on their own thread into a bounded ring; consumers
+// pop samples oldest first.
+class IStageSource {
+
+public:
+	virtual ~IStageSource() = default;
+
+	virtual string name() const = 0;
+
+	virtual void startSampling() = 0;
+	virtual void stopSampling() = 0;
+	virtual bool isSampling() const = 0;
+
+	virtual bool tryPopSample(StageSample& sample) = 0;
+
+	bool waitForSample(StageSample& sample, chrono::milliseconds timeout) {
+		const auto deadline = chrono::steady_clock::now() + timeout;
+		while (!tryPopSample(sample)) {
+			if (!isSampling() || chrono::steady_clock::now() >= deadline) {
+				return false;
+			}
+			this_thread::yield();
+		}
+		return true;
+	}
+};
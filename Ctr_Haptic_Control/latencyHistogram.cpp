@@ -0,0 +1,80 @@
+#include "latencyHistogram.h"
+
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+size_t LatencyHistogram::binOf(uint64_t ns) {
+	if (ns < SUB_BINS) {
+		return static_cast<size_t>(ns);
+	}
+	size_t msb = 0;
+	for (uint64_t v = ns; v > 1; v >>= 1) {
+		msb++;
+	}
+	const size_t sub = static_cast<size_t>((ns >> (msb - 3)) & (SUB_BINS - 1));
+	return (msb - 2) * SUB_BINS + sub;
+}
+
+uint64_t LatencyHistogram::upperBoundOf(size_t bin) {
+	if (bin < SUB_BINS) {
+		return bin;
+	}
+	const size_t msb = bin / SUB_BINS + 2;
+	const uint64_t sub = bin % SUB_BINS;
+	return ((SUB_BINS + sub + 1) << (msb - 3)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+	bins[binOf(ns)].fetch_add(1, memory_order_relaxed);
+	count.fetch_add(1, memory_order_relaxed);
+	total.fetch_add(ns, memory_order_relaxed);
+	uint64_t seen = maximum.load(memory_order_relaxed);
+	while (ns > seen && !maximum.compare_exchange_weak(seen, ns, memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::reset() {
+	for (auto& bin : bins) {
+		bin.store(0, memory_order_relaxed);
+	}
+	count.store(0, memory_order_relaxed);
+	total.store(0, memory_order_relaxed);
+	maximum.store(0, memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getCount() const {
+	return count.load(memory_order_relaxed);
+}
+
+double LatencyHistogram::percentileUs(double p) const {
+	const uint64_t n = getCount();
+	if (n == 0) {
+		return 0.0;
+	}
+	const uint64_t rank = static_cast<uint64_t>(p / 100.0 * (n - 1)) + 1;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BIN_COUNT; i++) {
+		seen += bins[i].load(memory_order_relaxed);
+		if (seen >= rank) {
+			const uint64_t bound = upperBoundOf(i);
+			const uint64_t largest = maximum.load(memory_order_relaxed);
+			return (bound < largest ? bound : largest) / 1000.0;
+		}
+	}
+	return maximum.load(memory_order_relaxed) / 1000.0;
+}
+
+LatencySummary LatencyHistogram::summary() const {
+	LatencySummary s;
+	s.count = getCount();
+	if (s.count == 0) {
+		return s;
+	}
+	s.meanUs = static_cast<double>(total.load(memory_order_relaxed)) / s.count / 1000.0;
+	s.p50Us = percentileUs(50.0);
+	s.p99Us = percentileUs(99.0);
+	s.maxUs = maximum.load(memory_order_relaxed) / 1000.0;
+	return s;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+
+struct LatencySummary {
+	uint64_t count = 0;
+	double meanUs = 0.0;
+	double p50Us = 0.0;
+	double p99Us = 0.0;
+	double maxUs = 0.0;
+};
+
+// Lock-free log-linear histogram of nanosecond latencies: each power of two
+// is split into eight linear bins, so percentiles are within 12.5%.
+// record() may be called from any thread.
+class LatencyHistogram {
+
+private:
+	static constexpr size_t SUB_BINS = 8;
+	static constexpr size_t BIN_COUNT = 64 * SUB_BINS;
+
+	atomic<uint64_t> bins[BIN_COUNT];
+	atomic<uint64_t> count;
+	atomic<uint64_t> total;
+	atomic<uint64_t> maximum;
+
+	static size_t binOf(uint64_t ns);
+	static uint64_t upperBoundOf(size_t bin);
+
+public:
+	LatencyHistogram();
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void record(uint64_t ns);
+	void reset();
+
+	uint64_t getCount() const;
+	double percentileUs(double p) const;
+	LatencySummary summary() const;
+};
@@ -0,0 +1,736 @@
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "losslessCodec.h"
+#include "utilities.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LOSSLESS_CODEC_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Encoded frame:
+//   FrameHeader
+//   uint32_t stripe sizes [stripeCount]
+//   stripes, each a byte-aligned bit stream: 5-bit shift, then per block of
+//   up to BLOCK residuals a 5-bit Rice parameter and the codes.
+
+static constexpr uint32_t CODEC_MAGIC = 0x3143524D;
+static constexpr size_t STRIPE_ROWS = 64;
+static constexpr size_t BLOCK = 16;
+// Quotients from here on are sent as a run of ones and the raw value.
+static constexpr uint32_t ESCAPE = 24;
+
+struct FrameHeader {
+	uint32_t magic;
+	uint16_t pixelFormat;
+	uint16_t stripeRows;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stripeCount;
+	uint32_t reserved;
+};
+
+static inline uint32_t countTrailingZeros(uint32_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return index;
+#else
+	return static_cast<uint32_t>(__builtin_ctz(value));
+#endif
+}
+
+// LSB-first bit stream. Every put() stores 8 bytes and advances by the
+// whole bytes it completed, so there is no branch on the buffer filling
+// up; the output needs 8 bytes of slack past the last code.
+class BitWriter {
+
+private:
+	uint8_t* out;
+	uint64_t bits;
+	uint32_t count;
+
+public:
+	explicit BitWriter(uint8_t* out_) :
+		out{ out_ },
+		bits{ 0 },
+		count{ 0 }
+	{}
+
+	// n <= 56, value below 2^n.
+	inline void put(uint64_t value, uint32_t n) {
+		bits |= value << count;
+		count += n;
+		memcpy(out, &bits, 8);
+		out += count >> 3;
+		bits >>= count & ~7u;
+		count &= 7;
+	}
+
+	uint8_t* finish() {
+		if (count > 0) {
+			*out++ = static_cast<uint8_t>(bits);
+		}
+		return out;
+	}
+};
+
+class BitReader {
+
+private:
+	const uint8_t* in;
+	const uint8_t* end;
+	uint64_t bits;
+	uint32_t count;
+
+public:
+	BitReader(const uint8_t* in_, const uint8_t* end_) :
+		in{ in_ },
+		end{ end_ },
+		bits{ 0 },
+		count{ 0 }
+	{}
+
+	// Leaves at least 56 bits buffered; reads past the end as zeros.
+	inline void refill() {
+		if (end - in >= 8) {
+			uint64_t word;
+			memcpy(&word, in, 8);
+			bits |= word << count;
+			in += (63 - count) >> 3;
+			count |= 56;
+		}
+		else {
+			while (count <= 56) {
+				const uint64_t byte = in < end ? *in++ : 0;
+				bits |= byte << count;
+				count += 8;
+			}
+		}
+	}
+
+	inline uint32_t peek() const {
+		return static_cast<uint32_t>(bits);
+	}
+
+	inline void skip(uint32_t n) {
+		bits >>= n;
+		count -= n;
+	}
+
+	// n <= 32, and no more than what refill() guaranteed.
+	inline uint32_t take(uint32_t n) {
+		const uint32_t value = static_cast<uint32_t>(bits & ((uint64_t(1) << n) - 1));
+		skip(n);
+		return value;
+	}
+};
+
+static inline uint32_t medianPredict(uint32_t a, uint32_t b, uint32_t c) {
+	const uint32_t lo = a < b ? a : b;
+	const uint32_t hi = a < b ? b : a;
+	if (c >= hi) {
+		return lo;
+	}
+	if (c <= lo) {
+		return hi;
+	}
+	return a + b - c;
+}
+
+static inline uint32_t countLeadingZeros(uint32_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return 31 - index;
+#else
+	return static_cast<uint32_t>(__builtin_clz(value));
+#endif
+}
+
+// Smallest k with n * 2^k >= sum, i.e. 2^k at least the block mean.
+static inline uint32_t riceParameter(uint32_t sum, uint32_t n, uint32_t maximum) {
+	const uint32_t mean = (sum + n - 1) / n;
+	const uint32_t k = mean > 1 ? 32 - countLeadingZeros(mean - 1) : 0;
+	return k < maximum ? k : maximum;
+}
+
+// Longest unary run before escaping, kept so a normal code fits one put().
+static inline uint32_t escapeLength(uint32_t k) {
+	return ESCAPE < 31 - k ? ESCAPE : 31 - k;
+}
+
+// Same-colour neighbours are distance apart in both directions (2 for
+// Bayer mosaics). Only rows of the current stripe are used, so up is null
+// for the first distance rows of each stripe.
+template <typename T>
+static inline uint32_t predict(const T* row, const T* up, size_t x, size_t distance, uint32_t shift) {
+	if (x >= distance) {
+		const uint32_t a = row[x - distance] >> shift;
+		if (!up) {
+			return a;
+		}
+		return medianPredict(a, up[x] >> shift, up[x - distance] >> shift);
+	}
+	return up ? up[x] >> shift : 0;
+}
+
+// Wrapped residual folded to signed, then zigzagged to unsigned. Fits the
+// sample width: at most 2 * (signBit - 1) + 1.
+static inline uint32_t zigzag(uint32_t residual, uint32_t mask, uint32_t signBit) {
+	return residual & signBit ? ((mask - residual) << 1) | 1 : residual << 1;
+}
+
+struct ResidualParams {
+	size_t distance;
+	uint32_t shift;
+	uint32_t mask;
+	uint32_t signBit;
+};
+
+// Residuals of row[begin, width); begin >= distance.
+template <typename T>
+static void rowResidualsScalar(const T* row, const T* up, size_t begin, size_t width, const ResidualParams& params,
+	uint16_t* out) {
+	const size_t distance = params.distance;
+	const uint32_t shift = params.shift;
+	if (up) {
+		for (size_t x = begin; x < width; x++) {
+			const uint32_t pred = medianPredict(row[x - distance] >> shift, up[x] >> shift, up[x - distance] >> shift);
+			out[x] = static_cast<uint16_t>(zigzag(((row[x] >> shift) - pred) & params.mask, params.mask, params.signBit));
+		}
+	}
+	else {
+		for (size_t x = begin; x < width; x++) {
+			const uint32_t pred = row[x - distance] >> shift;
+			out[x] = static_cast<uint16_t>(zigzag(((row[x] >> shift) - pred) & params.mask, params.mask, params.signBit));
+		}
+	}
+}
+
+#ifdef LOSSLESS_CODEC_X86
+
+// The vector paths work on samples widened to 16-bit lanes. The median
+// predictor picks lo or hi when c is outside them, and lo + hi - c, which
+// then lies between them and so cannot wrap, otherwise.
+
+TARGET_SSE41 static inline __m128i load8Sse41(const uint8_t* p) {
+	return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+TARGET_SSE41 static inline __m128i load8Sse41(const uint16_t* p) {
+	return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+TARGET_SSE41 static inline __m128i residual8Sse41(__m128i x, __m128i pred, __m128i mask, __m128i signBit) {
+	const __m128i d = _mm_and_si128(_mm_sub_epi16(x, pred), mask);
+	const __m128i negative = _mm_cmpeq_epi16(_mm_and_si128(d, signBit), signBit);
+	const __m128i folded = _mm_or_si128(_mm_slli_epi16(_mm_sub_epi16(mask, d), 1), _mm_set1_epi16(1));
+	return _mm_blendv_epi8(_mm_slli_epi16(d, 1), folded, negative);
+}
+
+template <typename T>
+TARGET_SSE41 static size_t rowResidualsSse41(const T* row, const T* up, size_t begin, size_t width,
+	const ResidualParams& params, uint16_t* out) {
+	const size_t distance = params.distance;
+	const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(params.shift));
+	const __m128i mask = _mm_set1_epi16(static_cast<short>(params.mask));
+	const __m128i signBit = _mm_set1_epi16(static_cast<short>(params.signBit));
+	size_t x = begin;
+	for (; x + 8 <= width; x += 8) {
+		const __m128i value = _mm_srl_epi16(load8Sse41(row + x), shift);
+		const __m128i a = _mm_srl_epi16(load8Sse41(row + x - distance), shift);
+		__m128i pred = a;
+		if (up) {
+			const __m128i b = _mm_srl_epi16(load8Sse41(up + x), shift);
+			const __m128i c = _mm_srl_epi16(load8Sse41(up + x - distance), shift);
+			const __m128i lo = _mm_min_epu16(a, b);
+			const __m128i hi = _mm_max_epu16(a, b);
+			const __m128i aboveHi = _mm_cmpeq_epi16(_mm_max_epu16(c, hi), c);
+			const __m128i belowLo = _mm_cmpeq_epi16(_mm_min_epu16(c, lo), c);
+			pred = _mm_sub_epi16(_mm_add_epi16(lo, hi), c);
+			pred = _mm_blendv_epi8(pred, hi, belowLo);
+			pred = _mm_blendv_epi8(pred, lo, aboveHi);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), residual8Sse41(value, pred, mask, signBit));
+	}
+	return x;
+}
+
+TARGET_AVX2 static inline __m256i load16Avx2(const uint8_t* p) {
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+TARGET_AVX2 static inline __m256i load16Avx2(const uint16_t* p) {
+	return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+template <typename T>
+TARGET_AVX2 static size_t rowResidualsAvx2(const T* row, const T* up, size_t begin, size_t width,
+	const ResidualParams& params, uint16_t* out) {
+	const size_t distance = params.distance;
+	const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(params.shift));
+	const __m256i mask = _mm256_set1_epi16(static_cast<short>(params.mask));
+	const __m256i signBit = _mm256_set1_epi16(static_cast<short>(params.signBit));
+	const __m256i one = _mm256_set1_epi16(1);
+	size_t x = begin;
+	for (; x + 16 <= width; x += 16) {
+		const __m256i value = _mm256_srl_epi16(load16Avx2(row + x), shift);
+		const __m256i a = _mm256_srl_epi16(load16Avx2(row + x - distance), shift);
+		__m256i pred = a;
+		if (up) {
+			const __m256i b = _mm256_srl_epi16(load16Avx2(up + x), shift);
+			const __m256i c = _mm256_srl_epi16(load16Avx2(up + x - distance), shift);
+			const __m256i lo = _mm256_min_epu16(a, b);
+			const __m256i hi = _mm256_max_epu16(a, b);
+			const __m256i aboveHi = _mm256_cmpeq_epi16(_mm256_max_epu16(c, hi), c);
+			const __m256i belowLo = _mm256_cmpeq_epi16(_mm256_min_epu16(c, lo), c);
+			pred = _mm256_sub_epi16(_mm256_add_epi16(lo, hi), c);
+			pred = _mm256_blendv_epi8(pred, hi, belowLo);
+			pred = _mm256_blendv_epi8(pred, lo, aboveHi);
+		}
+		const __m256i d = _mm256_and_si256(_mm256_sub_epi16(value, pred), mask);
+		const __m256i negative = _mm256_cmpeq_epi16(_mm256_and_si256(d, signBit), signBit);
+		const __m256i folded = _mm256_or_si256(_mm256_slli_epi16(_mm256_sub_epi16(mask, d), 1), one);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x),
+			_mm256_blendv_epi8(_mm256_slli_epi16(d, 1), folded, negative));
+	}
+	return x;
+}
+
+// Sum of each full BLOCK of residuals: the low and high bytes of the 16-bit
+// lanes are summed separately with psadbw.
+TARGET_SSE41 static size_t blockSumsSse41(const uint16_t* residuals, size_t blocks, uint32_t* sums) {
+	const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+	const __m128i zero = _mm_setzero_si128();
+	for (size_t b = 0; b < blocks; b++) {
+		const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(residuals + b * BLOCK));
+		const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(residuals + b * BLOCK + 8));
+		const __m128i low = _mm_add_epi64(_mm_sad_epu8(_mm_and_si128(v0, lowBytes), zero),
+			_mm_sad_epu8(_mm_and_si128(v1, lowBytes), zero));
+		const __m128i high = _mm_add_epi64(_mm_sad_epu8(_mm_srli_epi16(v0, 8), zero),
+			_mm_sad_epu8(_mm_srli_epi16(v1, 8), zero));
+		const __m128i sum = _mm_add_epi64(low, _mm_slli_epi64(high, 8));
+		sums[b] = static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 2));
+	}
+	return blocks;
+}
+
+TARGET_AVX2 static size_t blockSumsAvx2(const uint16_t* residuals, size_t blocks, uint32_t* sums) {
+	const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+	const __m256i zero = _mm256_setzero_si256();
+	for (size_t b = 0; b < blocks; b++) {
+		const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(residuals + b * BLOCK));
+		const __m256i sum = _mm256_add_epi64(_mm256_sad_epu8(_mm256_and_si256(v, lowBytes), zero),
+			_mm256_slli_epi64(_mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero), 8));
+		const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		sums[b] = static_cast<uint32_t>(_mm_cvtsi128_si32(half) + _mm_extract_epi32(half, 2));
+	}
+	return blocks;
+}
+
+// Codes of a full block, merged into eight pairs (even sample in the low
+// bits). Returns false when a sample escapes; the caller codes it in scalar.
+TARGET_AVX2 static bool blockCodesAvx2(const uint16_t* block, uint32_t k, uint32_t limit, uint64_t* pairCodes,
+	uint64_t* pairLengths) {
+	const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(k));
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i low = _mm256_set1_epi32(static_cast<int>((1u << k) - 1));
+	const __m256i lastQuotient = _mm256_set1_epi32(static_cast<int>(limit - 1));
+	const __m256i prefix = _mm256_set1_epi32(static_cast<int>(k + 1));
+	const __m256i lowHalf = _mm256_set1_epi64x(0xFFFFFFFF);
+	__m256i escape = _mm256_setzero_si256();
+	for (size_t h = 0; h < 2; h++) {
+		const __m256i value = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 8 * h)));
+		const __m256i q = _mm256_srl_epi32(value, shift);
+		escape = _mm256_or_si256(escape, _mm256_cmpgt_epi32(q, lastQuotient));
+		const __m256i code = _mm256_or_si256(_mm256_sub_epi32(_mm256_sllv_epi32(one, q), one),
+			_mm256_sllv_epi32(_mm256_and_si256(value, low), _mm256_add_epi32(q, one)));
+		const __m256i length = _mm256_add_epi32(q, prefix);
+		const __m256i evenLength = _mm256_and_si256(length, lowHalf);
+		const __m256i pair = _mm256_or_si256(_mm256_and_si256(code, lowHalf),
+			_mm256_sllv_epi64(_mm256_srli_epi64(code, 32), evenLength));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pairCodes + 4 * h), pair);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pairLengths + 4 * h),
+			_mm256_add_epi64(evenLength, _mm256_srli_epi64(length, 32)));
+	}
+	return _mm256_testz_si256(escape, escape) != 0;
+}
+
+#endif
+
+// Residuals of a whole row into out.
+template <typename T>
+static void rowResiduals(SimdLevel level, const T* row, const T* up, size_t width, const ResidualParams& params,
+	uint16_t* out) {
+	const size_t distance = params.distance;
+	const size_t head = width < distance ? width : distance;
+	for (size_t x = 0; x < head; x++) {
+		const uint32_t value = row[x] >> params.shift;
+		const uint32_t pred = up ? up[x] >> params.shift : 0;
+		out[x] = static_cast<uint16_t>(zigzag((value - pred) & params.mask, params.mask, params.signBit));
+	}
+	size_t x = head;
+#ifdef LOSSLESS_CODEC_X86
+	if (level == SimdLevel::AVX2) {
+		x = rowResidualsAvx2(row, up, x, width, params, out);
+	}
+	else if (level == SimdLevel::SSE41) {
+		x = rowResidualsSse41(row, up, x, width, params, out);
+	}
+#endif
+	rowResidualsScalar(row, up, x, width, params, out);
+}
+
+// Rice parameter of every block in the row; the last block may be short.
+static void blockParameters(SimdLevel level, const uint16_t* residuals, size_t width, uint32_t maximum,
+	uint32_t* sums, uint8_t* parameters) {
+	const size_t fullBlocks = width / BLOCK;
+	size_t b = 0;
+#ifdef LOSSLESS_CODEC_X86
+	if (level == SimdLevel::AVX2) {
+		b = blockSumsAvx2(residuals, fullBlocks, sums);
+	}
+	else if (level == SimdLevel::SSE41) {
+		b = blockSumsSse41(residuals, fullBlocks, sums);
+	}
+#endif
+	for (; b < fullBlocks; b++) {
+		uint32_t sum = 0;
+		for (size_t i = 0; i < BLOCK; i++) {
+			sum += residuals[b * BLOCK + i];
+		}
+		sums[b] = sum;
+	}
+	for (b = 0; b < fullBlocks; b++) {
+		parameters[b] = static_cast<uint8_t>(riceParameter(sums[b], BLOCK, maximum));
+	}
+	if (fullBlocks * BLOCK < width) {
+		const uint32_t n = static_cast<uint32_t>(width - fullBlocks * BLOCK);
+		uint32_t sum = 0;
+		for (uint32_t i = 0; i < n; i++) {
+			sum += residuals[fullBlocks * BLOCK + i];
+		}
+		parameters[fullBlocks] = static_cast<uint8_t>(riceParameter(sum, n, maximum));
+	}
+}
+
+// q ones, a zero, then the low k bits; quotients from limit on are limit
+// ones and the raw value.
+static inline uint64_t riceCode(uint32_t value, uint32_t k, uint32_t limit, uint32_t sampleBits, uint32_t& length) {
+	const uint32_t q = value >> k;
+	if (q < limit) {
+		length = q + 1 + k;
+		return ((1u << q) - 1) | (static_cast<uint64_t>(value & ((1u << k) - 1)) << (q + 1));
+	}
+	length = limit + sampleBits;
+	return ((1u << limit) - 1) | (static_cast<uint64_t>(value) << limit);
+}
+
+struct StripeJob {
+	const uint8_t* pixels;
+	size_t stride;
+	size_t width;
+	size_t height;
+	size_t distance;
+	uint32_t bits;
+	uint8_t* scratch;
+	size_t scratchStride;
+	uint32_t* sizes;
+	const uint8_t* const* stripes;
+	SimdLevel level;
+};
+
+template <typename T>
+static void encodeStripe(void* context, size_t stripe) {
+	const StripeJob& job = *static_cast<const StripeJob*>(context);
+	const size_t firstRow = stripe * STRIPE_ROWS;
+	const size_t rows = job.height - firstRow < STRIPE_ROWS ? job.height - firstRow : STRIPE_ROWS;
+
+	T allBits = 0;
+	for (size_t r = 0; r < rows; r++) {
+		const T* row = reinterpret_cast<const T*>(job.pixels + (firstRow + r) * job.stride);
+		for (size_t x = 0; x < job.width; x++) {
+			allBits |= row[x];
+		}
+	}
+	const uint32_t shift = allBits ? countTrailingZeros(allBits) : 0;
+	const uint32_t sampleBits = job.bits - shift;
+	const ResidualParams params{ job.distance, shift, (1u << sampleBits) - 1, 1u << (sampleBits - 1) };
+
+	const size_t blocks = (job.width + BLOCK - 1) / BLOCK;
+	thread_local vector<uint16_t> residuals;
+	thread_local vector<uint32_t> sums;
+	thread_local vector<uint8_t> parameters;
+	if (residuals.size() < job.width) {
+		residuals.resize(job.width);
+	}
+	if (parameters.size() < blocks) {
+		sums.resize(blocks);
+		parameters.resize(blocks);
+	}
+
+	uint8_t* out = job.scratch + stripe * job.scratchStride;
+	BitWriter writer(out);
+	writer.put(shift, 5);
+	for (size_t r = 0; r < rows; r++) {
+		const T* row = reinterpret_cast<const T*>(job.pixels + (firstRow + r) * job.stride);
+		const T* up = r >= job.distance ? reinterpret_cast<const T*>(job.pixels + (firstRow + r - job.distance) * job.stride) : nullptr;
+		rowResiduals(job.level, row, up, job.width, params, residuals.data());
+		blockParameters(job.level, residuals.data(), job.width, sampleBits, sums.data(), parameters.data());
+
+		for (size_t x0 = 0, b = 0; x0 < job.width; x0 += BLOCK, b++) {
+			const uint16_t* block = residuals.data() + x0;
+			const size_t n = job.width - x0 < BLOCK ? job.width - x0 : BLOCK;
+			const uint32_t k = parameters[b];
+			const uint32_t limit = escapeLength(k);
+			writer.put(k, 5);
+#ifdef LOSSLESS_CODEC_X86
+			uint64_t pairCodes[BLOCK / 2];
+			uint64_t pairLengths[BLOCK / 2];
+			if (n == BLOCK && job.level == SimdLevel::AVX2 && blockCodesAvx2(block, k, limit, pairCodes, pairLengths)) {
+				for (size_t p = 0; p < BLOCK / 2; p += 2) {
+					const uint32_t first = static_cast<uint32_t>(pairLengths[p]);
+					const uint32_t total = first + static_cast<uint32_t>(pairLengths[p + 1]);
+					if (total <= 56) {
+						writer.put(pairCodes[p] | pairCodes[p + 1] << first, total);
+						continue;
+					}
+					for (size_t i = 2 * p; i < 2 * p + 4; i++) {
+						uint32_t length;
+						const uint64_t code = riceCode(block[i], k, limit, sampleBits, length);
+						writer.put(code, length);
+					}
+				}
+				continue;
+			}
+#endif
+			// Codes are built independently and merged four at a time, so
+			// the writer sees one put per group unless escapes make it too long.
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				uint32_t length[4];
+				uint64_t code[4];
+				for (size_t j = 0; j < 4; j++) {
+					code[j] = riceCode(block[i + j], k, limit, sampleBits, length[j]);
+				}
+				const uint32_t first = length[0] + length[1];
+				const uint32_t total = first + length[2] + length[3];
+				if (total <= 56) {
+					writer.put(code[0] | code[1] << length[0] | code[2] << first | code[3] << (first + length[2]), total);
+				}
+				else {
+					for (size_t j = 0; j < 4; j++) {
+						writer.put(code[j], length[j]);
+					}
+				}
+			}
+			for (; i < n; i++) {
+				uint32_t length;
+				const uint64_t code = riceCode(block[i], k, limit, sampleBits, length);
+				writer.put(code, length);
+			}
+		}
+	}
+	job.sizes[stripe] = static_cast<uint32_t>(writer.finish() - out);
+}
+
+template <typename T>
+static void decodeStripe(void* context, size_t stripe) {
+	const StripeJob& job = *static_cast<const StripeJob*>(context);
+	const size_t firstRow = stripe * STRIPE_ROWS;
+	const size_t rows = job.height - firstRow < STRIPE_ROWS ? job.height - firstRow : STRIPE_ROWS;
+
+	BitReader reader(job.stripes[stripe], job.stripes[stripe] + job.sizes[stripe]);
+	reader.refill();
+	const uint32_t shift = reader.take(5);
+	const uint32_t sampleBits = job.bits - (shift < job.bits ? shift : 0);
+	const uint32_t mask = (1u << sampleBits) - 1;
+	for (size_t r = 0; r < rows; r++) {
+		T* row = reinterpret_cast<T*>(job.scratch + (firstRow + r) * job.scratchStride);
+		const T* up = r >= job.distance ? reinterpret_cast<const T*>(job.scratch + (firstRow + r - job.distance) * job.scratchStride) : nullptr;
+		for (size_t x0 = 0; x0 < job.width; x0 += BLOCK) {
+			const size_t n = job.width - x0 < BLOCK ? job.width - x0 : BLOCK;
+			reader.refill();
+			const uint32_t k = reader.take(5);
+			const uint32_t limit = escapeLength(k < 31 ? k : 31);
+			for (size_t i = 0; i < n; i++) {
+				reader.refill();
+				const uint32_t q = countTrailingZeros(~reader.peek() | (1u << limit));
+				uint32_t code;
+				if (q < limit) {
+					reader.skip(q + 1);
+					code = (q << k) | reader.take(k);
+				}
+				else {
+					reader.skip(limit);
+					code = reader.take(sampleBits);
+				}
+				const uint32_t residual = code & 1 ? mask - (code >> 1) : code >> 1;
+				const size_t x = x0 + i;
+				const uint32_t sample = (predict(row, up, x, job.distance, shift) + residual) & mask;
+				row[x] = static_cast<T>(sample << shift);
+			}
+		}
+	}
+}
+
+
+LosslessCodec::LosslessCodec(size_t threads) :
+	level{ detectSimdLevel() },
+	pool{ threads },
+	frames{ 0 },
+	rawBytes{ 0 },
+	encodedBytes{ 0 },
+	encodeNanos{ 0 },
+	lastRawBytes{ 0 },
+	lastEncodedBytes{ 0 },
+	lastEncodeNanos{ 0 }
+{}
+
+bool LosslessCodec::isSupported(PixelFormat format) {
+	return format == PixelFormat::Mono8 || format == PixelFormat::Mono16
+		|| format == PixelFormat::BayerRG8 || format == PixelFormat::BayerRG16;
+}
+
+// Worst case per sample is ESCAPE ones plus the raw value; per block the
+// 5-bit parameter; per stripe the shift and the final partial word.
+size_t LosslessCodec::maxEncodedSize(const FrameInfo& info) {
+	const size_t stripes = (info.height + STRIPE_ROWS - 1) / STRIPE_ROWS;
+	const size_t samples = info.width * info.height;
+	const size_t blocks = (info.width + BLOCK - 1) / BLOCK * info.height;
+	const size_t sampleBits = 8 * bytesPerPixel(info.pixelFormat);
+	return sizeof(FrameHeader) + stripes * (sizeof(uint32_t) + 16)
+		+ (samples * (ESCAPE + sampleBits) + blocks * 5) / 8;
+}
+
+size_t LosslessCodec::encode(const uint8_t* src, const FrameInfo& info, uint8_t* dst, size_t capacity) {
+	if (!isSupported(info.pixelFormat) || info.width == 0 || info.height == 0 || capacity < maxEncodedSize(info)) {
+		return 0;
+	}
+	const uint64_t start = hostNanos();
+	const size_t stripes = (info.height + STRIPE_ROWS - 1) / STRIPE_ROWS;
+	FrameInfo stripeInfo = info;
+	stripeInfo.height = STRIPE_ROWS < info.height ? STRIPE_ROWS : info.height;
+	const size_t stripeCapacity = maxEncodedSize(stripeInfo);
+	if (scratch.size() < stripes * stripeCapacity) {
+		scratch.resize(stripes * stripeCapacity);
+	}
+	stripeSizes.resize(stripes);
+
+	const bool wide = bytesPerPixel(info.pixelFormat) == 2;
+	const bool bayer = info.pixelFormat == PixelFormat::BayerRG8 || info.pixelFormat == PixelFormat::BayerRG16;
+	StripeJob job{ src, info.stride, info.width, info.height, size_t(bayer ? 2 : 1), uint32_t(wide ? 16 : 8),
+		scratch.data(), stripeCapacity, stripeSizes.data(), nullptr, level };
+	pool.run(stripes, wide ? encodeStripe<uint16_t> : encodeStripe<uint8_t>, &job);
+
+	FrameHeader header{};
+	header.magic = CODEC_MAGIC;
+	header.pixelFormat = static_cast<uint16_t>(info.pixelFormat);
+	header.stripeRows = static_cast<uint16_t>(STRIPE_ROWS);
+	header.width = static_cast<uint32_t>(info.width);
+	header.height = static_cast<uint32_t>(info.height);
+	header.stripeCount = static_cast<uint32_t>(stripes);
+	uint8_t* out = dst;
+	memcpy(out, &header, sizeof(header));
+	out += sizeof(header);
+	memcpy(out, stripeSizes.data(), stripes * sizeof(uint32_t));
+	out += stripes * sizeof(uint32_t);
+	for (size_t i = 0; i < stripes; i++) {
+		memcpy(out, scratch.data() + i * stripeCapacity, stripeSizes[i]);
+		out += stripeSizes[i];
+	}
+
+	const size_t encoded = out - dst;
+	const size_t raw = info.width * info.height * bytesPerPixel(info.pixelFormat);
+	const uint64_t elapsed = hostNanos() - start;
+	frames++;
+	rawBytes += raw;
+	encodedBytes += encoded;
+	encodeNanos += elapsed;
+	lastRawBytes = raw;
+	lastEncodedBytes = encoded;
+	lastEncodeNanos = elapsed;
+	return encoded;
+}
+
+bool LosslessCodec::decode(const uint8_t* src, size_t size, uint8_t* dst, size_t dstStride, FrameInfo* info) {
+	FrameHeader header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, src, sizeof(header));
+	const PixelFormat format = static_cast<PixelFormat>(header.pixelFormat);
+	const size_t stripes = (header.height + STRIPE_ROWS - 1) / STRIPE_ROWS;
+	if (header.magic != CODEC_MAGIC || !isSupported(format) || header.stripeRows != STRIPE_ROWS
+		|| header.stripeCount != stripes || dstStride < header.width * bytesPerPixel(format)
+		|| size < sizeof(header) + stripes * sizeof(uint32_t)) {
+		return false;
+	}
+
+	vector<uint32_t> sizes(stripes);
+	vector<const uint8_t*> starts(stripes);
+	memcpy(sizes.data(), src + sizeof(header), stripes * sizeof(uint32_t));
+	const uint8_t* p = src + sizeof(header) + stripes * sizeof(uint32_t);
+	for (size_t i = 0; i < stripes; i++) {
+		if (sizes[i] > static_cast<size_t>(src + size - p)) {
+			return false;
+		}
+		starts[i] = p;
+		p += sizes[i];
+	}
+
+	const bool wide = bytesPerPixel(format) == 2;
+	const bool bayer = format == PixelFormat::BayerRG8 || format == PixelFormat::BayerRG16;
+	StripeJob job{ nullptr, 0, header.width, header.height, size_t(bayer ? 2 : 1), uint32_t(wide ? 16 : 8),
+		dst, dstStride, sizes.data(), starts.data(), level };
+	pool.run(stripes, wide ? decodeStripe<uint16_t> : decodeStripe<uint8_t>, &job);
+
+	if (info) {
+		info->width = header.width;
+		info->height = header.height;
+		info->stride = dstStride;
+		info->pixelFormat = format;
+	}
+	return true;
+}
+
+CodecStats LosslessCodec::getStats() const {
+	CodecStats stats;
+	stats.frames = frames;
+	stats.rawBytes = rawBytes;
+	stats.encodedBytes = encodedBytes;
+	if (stats.encodedBytes > 0) {
+		stats.ratio = static_cast<double>(stats.rawBytes) / stats.encodedBytes;
+	}
+	if (lastEncodedBytes > 0) {
+		stats.lastRatio = static_cast<double>(lastRawBytes) / lastEncodedBytes;
+	}
+	if (encodeNanos > 0) {
+		stats.encodeMBps = stats.rawBytes * 1e3 / encodeNanos;
+	}
+	if (lastEncodeNanos > 0) {
+		stats.lastEncodeMBps = lastRawBytes * 1e3 / lastEncodeNanos;
+	}
+	return stats;
+}
+
+void LosslessCodec::setSimdLevel(SimdLevel level_) {
+	const SimdLevel supported = detectSimdLevel();
+	level = static_cast<int>(level_) > static_cast<int>(supported) ? supported : level_;
+}
+
+SimdLevel LosslessCodec::getSimdLevel() const {
+	return level;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frame.h"
+#include "pixelConvert.h"
+#include "workerPool.h"
+
+using namespace std;
+
+
+struct CodecStats {
+	uint64_t frames = 0;
+	uint64_t rawBytes = 0;
+	uint64_t encodedBytes = 0;
+	// rawBytes / encodedBytes over all frames, and for the last frame.
+	double ratio = 0.0;
+	double lastRatio = 0.0;
+	// Raw bytes per second of encode time.
+	double encodeMBps = 0.0;
+	double lastEncodeMBps = 0.0;
+};
+
+// Lossless intra-frame codec for Mono8/16 and BayerRG8/16. Each frame is
+// coded on its own, so a recorded frame decodes without its neighbours.
+//
+// Pixels are predicted from same-colour neighbours (left, up, up-left; the
+// LOCO-I median predictor) and the residuals are Rice coded with a
+// parameter chosen per 16-pixel block. Frames are cut into stripes of rows
+// that code independently and are spread over a WorkerPool. Low bits that
+// are zero across a whole stripe (left-aligned 10/12-bit data in 16-bit
+// pixels) are dropped before coding.
+class LosslessCodec {
+
+private:
+	SimdLevel level;
+	WorkerPool pool;
+	vector<uint8_t> scratch;
+	vector<uint32_t> stripeSizes;
+
+	atomic<uint64_t> frames;
+	atomic<uint64_t> rawBytes;
+	atomic<uint64_t> encodedBytes;
+	atomic<uint64_t> encodeNanos;
+	atomic<uint64_t> lastRawBytes;
+	atomic<uint64_t> lastEncodedBytes;
+	atomic<uint64_t> lastEncodeNanos;
+
+public:
+	explicit LosslessCodec(size_t threads = 1);
+
+	static bool isSupported(PixelFormat format);
+	static size_t maxEncodedSize(const FrameInfo& info);
+
+	// Returns the encoded size, or 0 when the format is not supported or
+	// capacity is below maxEncodedSize(). Not reentrant: one encoder thread
+	// per codec.
+	size_t encode(const uint8_t* src, const FrameInfo& info, uint8_t* dst, size_t capacity);
+	// Fills dst (height rows of dstStride bytes). info, when given, receives
+	// the width, height and pixel format stored in the stream.
+	bool decode(const uint8_t* src, size_t size, uint8_t* dst, size_t dstStride, FrameInfo* info = nullptr);
+
+	CodecStats getStats() const;
+
+	// Residuals, Rice parameters and (AVX2) the codes of full blocks are SIMD;
+	// the stream is the same at every level.
+	// Benchmarking hook; levels above what the CPU supports are clamped.
+	void setSimdLevel(SimdLevel level_);
+	SimdLevel getSimdLevel() const;
+};
@@ -1,44 +1,464 @@
 #include <stdio.h>
-#include <tchar.h>
 #include <thread>
 #include <iostream>
 #include <sstream>
 #include <iterator>
-#include <future>
+#include <memory>
+#include <string>
 
-#include "A3200.h"
 #include "Spinnaker.h"
 #include "SpinGenApi/SpinnakerGenApi.h"
+#include "benchmark.h"
+#include "blackBox.h"
+#include "cameraGroup.h"
+#include "clockSync.h"
+#include "ctr.h"
+#include "exportPool.h"
 #include "flir.h"
+#include "frameFanout.h"
+#include "previewStream.h"
+#include "recorder.h"
+#include "simCamera.h"
+#include "simMotionController.h"
+#include "spinVideoBackend.h"
 
 using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
 using namespace Spinnaker::GenICam;
 using namespace std;
 
+// Stream buffers allocated per FLIR camera.
+static const size_t FLIR_STREAM_BUFFERS = 32;
+
 int main(int argc, char* argv[]) {
 
-	SystemPtr system = System::GetInstance();
-	const LibraryVersion spinnakerLibraryVersion = system->GetLibraryVersion();
-	cout << "Spinnaker library version: " << spinnakerLibraryVersion.major << "." << spinnakerLibraryVersion.minor
-		 << "." << spinnakerLibraryVersion.type << "." << spinnakerLibraryVersion.build << endl
-		 << endl;
-	CameraList camList = system->GetCameras();
-	unsigned int numCameras = camList.GetSize();
-	
-	cout << "Number of cameras detected: " << numCameras << endl << endl;
-	
-	vector<Flir> flirCameras;
-	vector<future<vector<char>>> flirFutures;
-	for (unsigned int i = 0; i < numCameras; i++) {
-		flirCameras.push_back(Flir(camList.GetByIndex(i)));	
-		flirFutures.push_back(async(launch::async, flirCameras.back().acquireImage));
+	// --sim N streams from N simulated cameras instead of the FLIR hardware.
+	// --benchmark convert times pixel conversion on a full-size frame and exits;
+	// --benchmark protobuf times metadata messages with and without an arena.
+	// --record PATH writes every matched frame set to a session file for
+	// --seconds S (default 5); --compress stores it losslessly compressed.
+	// --export PREFIX saves the first frame set as PREFIX<camera>.png.
+	// --video PREFIX streams the first camera to MJPG files PREFIX-0000.avi, ...
+	// while recording (same --seconds).
+	// --blackbox PREFIX keeps the last 2 s of frames in RAM while recording and
+	// triggers halfway through, writing PREFIX-0000.session.
+	// --preview FPS adds a quarter-scale Mono8 preview of every camera at FPS.
+	// --acquire PATH records every camera with the stage position at each
+	// exposure midpoint (a simulated stage with --sim) for --seconds, with
+	// camera timestamps mapped to host time by latching the camera clocks.
+	// --control runs the closed-loop visual servo on the first camera for
+	// --seconds; with --sim that camera sees a spot carried by the simulated
+	// stage, which is steered 2 mm off the centre of the image.
+	// --replay PATH plays a recorded session back at --speed X (default 1,
+	// 0 for as fast as possible) through the processing chain and exits.
+	size_t numSimCameras = 0;
+	string benchmark;
+	string recordPath;
+	double recordSeconds = 5.0;
+	bool compress = false;
+	string exportPrefix;
+	string videoPrefix;
+	string blackBoxPrefix;
+	double previewRate = 0.0;
+	string acquirePath;
+	bool closedLoopControl = false;
+	string replayPath;
+	double replaySpeed = 1.0;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--sim" && i + 1 < argc) {
+			numSimCameras = stoul(argv[++i]);
+		}
+		else if (string(argv[i]) == "--benchmark" && i + 1 < argc) {
+			benchmark = argv[++i];
+		}
+		else if (string(argv[i]) == "--record" && i + 1 < argc) {
+			recordPath = argv[++i];
+		}
+		else if (string(argv[i]) == "--seconds" && i + 1 < argc) {
+			recordSeconds = stod(argv[++i]);
+		}
+		else if (string(argv[i]) == "--compress") {
+			compress = true;
+		}
+		else if (string(argv[i]) == "--export" && i + 1 < argc) {
+			exportPrefix = argv[++i];
+		}
+		else if (string(argv[i]) == "--video" && i + 1 < argc) {
+			videoPrefix = argv[++i];
+		}
+		else if (string(argv[i]) == "--blackbox" && i + 1 < argc) {
+			blackBoxPrefix = argv[++i];
+		}
+		else if (string(argv[i]) == "--preview" && i + 1 < argc) {
+			previewRate = stod(argv[++i]);
+		}
+		else if (string(argv[i]) == "--acquire" && i + 1 < argc) {
+			acquirePath = argv[++i];
+		}
+		else if (string(argv[i]) == "--control") {
+			closedLoopControl = true;
+		}
+		else if (string(argv[i]) == "--replay" && i + 1 < argc) {
+			replayPath = argv[++i];
+		}
+		else if (string(argv[i]) == "--speed" && i + 1 < argc) {
+			replaySpeed = stod(argv[++i]);
+		}
+	}
+
+	if (benchmark == "convert") {
+		runConversionBenchmark(3072, 2048, 50);
+		return 0;
+	}
+	if (benchmark == "protobuf") {
+		runProtobufBenchmark(1000000);
+		return 0;
+	}
+	if (!replayPath.empty()) {
+		runReplayBenchmark(replayPath, replaySpeed);
+		return 0;
+	}
+
+	SystemPtr system;
+	CameraList camList;
+	vector<unique_ptr<ICamera>> cameras;
+	// Frames each camera can have outstanding; the fanout keeps part of
+	// them for the latest-only views.
+	vector<size_t> bufferCounts;
+	if (numSimCameras > 0) {
+		for (size_t i = 0; i < numSimCameras; i++) {
+			SimCameraConfig config;
+			config.name = "sim" + to_string(i);
+			if (closedLoopControl && i == 0) {
+				config.pattern = SimPattern::Spot;
+			}
+			cameras.push_back(make_unique<SimCamera>(config));
+			bufferCounts.push_back(config.bufferCount);
+		}
+	}
+	else {
+		system = System::GetInstance();
+		const LibraryVersion spinnakerLibraryVersion = system->GetLibraryVersion();
+		cout << "Spinnaker library version: " << spinnakerLibraryVersion.major << "." << spinnakerLibraryVersion.minor
+			 << "." << spinnakerLibraryVersion.type << "." << spinnakerLibraryVersion.build << endl
+			 << endl;
+		camList = system->GetCameras();
+		unsigned int numCameras = camList.GetSize();
+
+		cout << "Number of cameras detected: " << numCameras << endl << endl;
+
+		for (unsigned int i = 0; i < numCameras; i++) {
+			unique_ptr<Flir> flir = make_unique<Flir>(camList.GetByIndex(i));
+			flir->useUserBuffers(FLIR_STREAM_BUFFERS);
+			flir->setDeliveryMode(DeliveryMode::Event);
+			cameras.push_back(move(flir));
+			bufferCounts.push_back(FLIR_STREAM_BUFFERS);
+		}
+	}
+
+	// Each camera feeds a latest-only view for control and a lossless view
+	// for recording; the recording views are what the group matches. An
+	// operator preview, when asked for, reads a latest-only view of its own.
+	vector<unique_ptr<FrameFanout>> fanouts;
+	vector<FrameSubscriber*> controlViews;
+	vector<ICamera*> groupCameras;
+	vector<unique_ptr<PreviewStream>> previews;
+	vector<ICamera*> acquireViews;
+	for (size_t c = 0; c < cameras.size(); c++) {
+		ICamera* camera = cameras[c].get();
+		fanouts.push_back(make_unique<FrameFanout>(*camera, bufferCounts[c]));
+		controlViews.push_back(&fanouts.back()->subscribe(camera->name() + "-control", SubscriberPolicy::LatestOnly));
+		groupCameras.push_back(&fanouts.back()->subscribe(camera->name() + "-record", SubscriberPolicy::Lossless));
+		if (previewRate > 0.0) {
+			PreviewConfig previewConfig;
+			previewConfig.rate = previewRate;
+			FrameSubscriber& previewView = fanouts.back()->subscribe(camera->name() + "-preview", SubscriberPolicy::LatestOnly);
+			previews.push_back(make_unique<PreviewStream>(previewView, camera->name() + "-preview", previewConfig));
+		}
+		if (!acquirePath.empty()) {
+			acquireViews.push_back(&fanouts.back()->subscribe(camera->name() + "-acquire", SubscriberPolicy::Lossless));
+		}
+	}
+
+	if (!groupCameras.empty()) {
+		unique_ptr<Recorder> recorder;
+		if (!recordPath.empty()) {
+			RecorderConfig recorderConfig;
+			recorderConfig.path = recordPath;
+			recorder = make_unique<Recorder>(recorderConfig);
+			for (auto& camera : cameras) {
+				recorder->addSource(camera->name(), compress);
+			}
+			if (!recorder->start()) {
+				recorder.reset();
+			}
+		}
+		unique_ptr<VideoEncoder> videoEncoder;
+		if (!videoPrefix.empty()) {
+			VideoEncoderConfig videoConfig;
+			videoConfig.prefix = videoPrefix;
+			videoEncoder = make_unique<VideoEncoder>(videoConfig, make_unique<SpinVideoBackend>());
+			videoEncoder->start();
+		}
+
+		unique_ptr<BlackBox> blackBox;
+
+		CameraGroup cameraGroup(groupCameras, MatchMode::FrameId, 0);
+		cameraGroup.start();
+		for (auto& preview : previews) {
+			preview->startStreaming();
+		}
+
+		unique_ptr<Ctr> ctr;
+		unique_ptr<SimStageSpot> stageSpot;
+		vector<unique_ptr<ClockSync>> clockSyncs;
+		bool acquiring = false;
+		CtrConfig ctrConfig;
+		ctrConfig.control = closedLoopControl ? Control::CLOSED_LOOP : Control::OPEN_LOOP;
+		if (!acquirePath.empty() || closedLoopControl) {
+			ctr = make_unique<Ctr>(numSimCameras > 0 ? make_unique<SimMotionController>(SimMotionConfig()) : nullptr, ctrConfig);
+		}
+		if (closedLoopControl && ctr->getMotionController()) {
+			SimCamera* simCamera = dynamic_cast<SimCamera*>(cameras[0].get());
+			if (simCamera) {
+				// The first camera looks down on the stage; its spot is the tool.
+				SimStageSpotConfig spotConfig;
+				spotConfig.originX = simCamera->getConfig().width / 2.0;
+				spotConfig.originY = simCamera->getConfig().height / 2.0;
+				spotConfig.pixelsPerMmX = ctrConfig.pixelsPerMm;
+				spotConfig.pixelsPerMmY = ctrConfig.pixelsPerMm;
+				stageSpot = make_unique<SimStageSpot>(*ctr->getMotionController(), spotConfig);
+				simCamera->setSpotSource(stageSpot.get());
+			}
+			if (ctr->startControl(*controlViews[0]) && simCamera) {
+				ctr->getClosedLoop()->setSetpoint(simCamera->getConfig().width / 2.0 + 2.0 * ctrConfig.pixelsPerMm,
+					simCamera->getConfig().height / 2.0);
+			}
+		}
+		if (!acquirePath.empty()) {
+			AcquisitionConfig acquisitionConfig;
+			acquisitionConfig.recorder.path = acquirePath;
+			vector<AcquisitionSourceConfig> sourceConfigs(cameras.size());
+			for (size_t i = 0; i < cameras.size(); i++) {
+				ICameraClock* clock = dynamic_cast<ICameraClock*>(cameras[i].get());
+				if (clock) {
+					clockSyncs.push_back(make_unique<ClockSync>(*clock, cameras[i]->name(), ClockSyncConfig()));
+					clockSyncs.back()->start();
+					sourceConfigs[i].clock = clockSyncs.back().get();
+				}
+			}
+			acquiring = ctr->dataAcquisition(acquireViews, acquisitionConfig, sourceConfigs);
+			if (acquiring && numSimCameras > 0 && !closedLoopControl) {
+				// Give the simulated stage something to record.
+				ctr->getMotionController()->setVelocity(1.0, 0.5, 0.0);
+			}
+		}
+
+		FrameSet frameSet;
+		if (cameraGroup.waitForSet(frameSet, chrono::milliseconds(1000))) {
+			for (size_t i = 0; i < frameSet.count; i++) {
+				const Frame& image = frameSet.frames[i];
+				cout << "Camera " << i << " frame " << image.frameId() << ": " << image.width() << "x" << image.height()
+					 << " " << pixelFormatName(image.pixelFormat()) << " stride " << image.stride() << endl;
+			}
+			cout << "Set skew: " << frameSet.skew << endl;
+
+			if (!blackBoxPrefix.empty()) {
+				BlackBoxConfig blackBoxConfig;
+				blackBoxConfig.prefix = blackBoxPrefix;
+				blackBoxConfig.preTriggerSeconds = 2.0;
+				blackBoxConfig.postTriggerSeconds = 1.0;
+				blackBox = make_unique<BlackBox>(blackBoxConfig);
+				// Rings are sized from the first set's frames, for up to 60 fps.
+				for (size_t i = 0; i < frameSet.count; i++) {
+					blackBox->addSource(cameras[i]->name(), frameSet.frames[i].size(), 60.0);
+				}
+				if (!blackBox->start()) {
+					blackBox.reset();
+				}
+			}
+
+			if (!exportPrefix.empty()) {
+				ExportPool exportPool;
+				ExportOptions exportOptions;
+				exportOptions.outputFormat = PixelFormat::Mono8;
+				vector<future<ExportResult>> exports;
+				for (size_t i = 0; i < frameSet.count; i++) {
+					exports.push_back(exportPool.submit(frameSet.frames[i], exportPrefix + cameras[i]->name() + ".png", exportOptions));
+				}
+				for (auto& pending : exports) {
+					const ExportResult result = pending.get();
+					cout << (result.saved ? "Saved " : "Failed to save ") << result.path << " (" << result.encodeMs << " ms)"
+						 << (result.saved ? "" : ": " + result.error) << endl;
+				}
+			}
+		}
+		if (recorder || videoEncoder || blackBox || ctr) {
+			const auto recordStart = chrono::steady_clock::now();
+			const auto recordEnd = recordStart + chrono::duration<double>(recordSeconds);
+			const auto triggerTime = recordStart + chrono::duration<double>(recordSeconds / 2);
+			bool triggered = false;
+			while (chrono::steady_clock::now() < recordEnd) {
+				if (blackBox && !triggered && chrono::steady_clock::now() >= triggerTime) {
+					triggered = blackBox->trigger(TriggerReason::Manual);
+				}
+				if (cameraGroup.waitForSet(frameSet, chrono::milliseconds(100))) {
+					for (size_t i = 0; recorder && i < frameSet.count; i++) {
+						const FrameInfo& info = frameSet.frames[i].info();
+						CameraSample sample;
+						sample.source = static_cast<uint32_t>(i);
+						sample.frameId = info.frameId;
+						sample.timestamp = info.timestamp;
+						sample.hostTimestamp = info.hostTimestamp;
+						recorder->submitCamera(sample);
+						recorder->submit(i, frameSet.frames[i]);
+					}
+					if (videoEncoder) {
+						videoEncoder->submit(frameSet.frames[0]);
+					}
+					for (size_t i = 0; blackBox && i < frameSet.count; i++) {
+						blackBox->submit(i, frameSet.frames[i]);
+					}
+				}
+			}
+		}
+		frameSet = FrameSet();
+		if (ctr && ctr->getClosedLoop()) {
+			ctr->stopControl();
+			const ClosedLoopStats controlStats = ctr->getClosedLoop()->getStats();
+			cout << "Closed loop: " << controlStats.framesProcessed << " frames, " << controlStats.commandsSent
+				 << " commands, end-to-end p50 " << controlStats.endToEnd.p50Us << " us, p99 " << controlStats.endToEnd.p99Us
+				 << " us, max " << controlStats.endToEnd.maxUs << " us, final error (" << controlStats.errorX << ", "
+				 << controlStats.errorY << ") px" << endl;
+			cout << "  deadline misses " << controlStats.deadlineMisses << " (" << controlStats.framesStale << " stale, "
+				 << controlStats.framesLate << " late, " << controlStats.commandsLate << " late commands), superseded "
+				 << controlStats.framesSuperseded << ", feature misses " << controlStats.featureMisses << ", watchdog stops "
+				 << controlStats.watchdogStops << ", extraction p99 "
+				 << controlStats.extraction.p99Us << " us, command p99 " << controlStats.command.p99Us << " us" << endl;
+		}
+		if (acquiring) {
+			ctr->stopDataAcquisition();
+			const AcquisitionStats acquisitionStats = ctr->getDataAcquisition()->getStats();
+			cout << "Acquired " << acquisitionStats.recorder.framesWritten << " frames and " << acquisitionStats.stageSamples
+				 << " stage samples to " << acquirePath << ", alignment delay p99 " << acquisitionStats.alignmentDelay.p99Us
+				 << " us" << endl;
+			for (const AcquisitionSourceStats& source : acquisitionStats.sources) {
+				cout << "  " << source.name << ": " << source.framesInterpolated << " interpolated, " << source.framesNearest
+					 << " nearest, " << source.framesUnaligned << " without stage position, " << source.framesClockTimed
+					 << " timed by camera clock, dropped " << source.framesDropped << endl;
+			}
+		}
+		for (auto& clockSync : clockSyncs) {
+			clockSync->stop();
+			const ClockSyncStats syncStats = clockSync->getStats();
+			cout << "Clock sync: " << syncStats.latches << " latches, drift " << syncStats.driftPpm << " ppm, residual rms "
+				 << syncStats.residualRmsUs << " us (max " << syncStats.residualMaxUs << "), prediction error "
+				 << syncStats.predictionErrorUs << " us, latch round trip p50 " << syncStats.roundTrip.p50Us << " us" << endl;
+		}
+		clockSyncs.clear();
+
+		Frame latest;
+		for (FrameSubscriber* controlView : controlViews) {
+			if (controlView->tryPopFrame(latest)) {
+				cout << controlView->name() << " latest frame " << latest.frameId() << endl;
+			}
+		}
+		latest.reset();
+
+		cameraGroup.stop();
+		if (blackBox) {
+			blackBox->stop();
+			const BlackBoxStats blackBoxStats = blackBox->getStats();
+			cout << "Black box: " << blackBoxStats.ringBytes << " bytes of ring, " << blackBoxStats.flushes << " flushes ("
+				 << triggerReasonName(blackBoxStats.lastReason) << "), " << blackBoxStats.framesFlushed << " frames and "
+				 << blackBoxStats.stageSamplesFlushed << " stage samples written to " << blackBoxStats.lastPath << endl;
+			for (const BlackBoxSourceStats& source : blackBoxStats.sources) {
+				cout << "  " << source.name << ": dropped " << source.framesDropped << ", skipped " << source.framesSkipped << endl;
+			}
+		}
+		if (videoEncoder) {
+			videoEncoder->stop();
+			const VideoEncoderStats videoStats = videoEncoder->getStats();
+			cout << "Video: " << videoStats.framesEncoded << " frames in " << videoStats.filesWritten << " files, "
+				 << videoStats.bytesWritten << " bytes, " << videoStats.encodeFps << " fps encode, dropped "
+				 << videoStats.framesDropped << ", failed " << videoStats.framesFailed << endl;
+		}
+		if (recorder) {
+			recorder->stop();
+			const RecorderStats recorderStats = recorder->getStats();
+			cout << "Recorded " << recorderStats.framesWritten << " frames, " << recorderStats.bytesWritten << " bytes at "
+				 << recorderStats.sustainedMBps << " MB/s (device " << recorderStats.deviceMBps << " MB/s"
+				 << (recorderStats.directIo ? ", unbuffered" : "") << "), dropped " << recorderStats.framesDropped << endl;
+			if (recorderStats.failed) {
+				cout << "Recording failed: " << recorderStats.error << endl;
+			}
+			for (const RecorderSourceStats& source : recorderStats.sources) {
+				cout << "  " << source.name << ": peak queue depth " << source.peakQueueDepth;
+				if (source.compressed) {
+					cout << ", ratio " << source.ratio;
+				}
+				cout << endl;
+			}
+			cout << "Telemetry: " << recorderStats.cameraSamples << " camera and " << recorderStats.stageSamples
+				 << " stage samples in " << recorderStats.telemetryRecords << " records, " << recorderStats.telemetryBytes
+				 << " bytes, dropped " << recorderStats.telemetryDropped << endl;
+			if (compress) {
+				cout << "Compressed " << recorderStats.codec.frames << " frames at " << recorderStats.codec.encodeMBps
+					 << " MB/s, ratio " << recorderStats.codec.ratio << endl;
+			}
+		}
+		for (auto& preview : previews) {
+			preview->stopStreaming();
+			const PreviewStats previewStats = preview->getPreviewStats();
+			cout << preview->name() << ": " << previewStats.framesPreviewed << " frames at 1/" << preview->getScale()
+				 << " scale, skipped " << previewStats.framesSkipped << ", dropped " << previewStats.framesDropped
+				 << ", " << previewStats.meanScaleUs << " us per frame" << endl;
+		}
+		for (auto& fanout : fanouts) {
+			fanout->stop();
+		}
+		for (FrameSubscriber* controlView : controlViews) {
+			const SubscriberStats viewStats = controlView->getSubscriberStats();
+			cout << controlView->name() << " delivered " << viewStats.delivered << ", skipped " << viewStats.skipped << endl;
+		}
+		for (ICamera* recordView : groupCameras) {
+			const SubscriberStats viewStats = static_cast<FrameSubscriber*>(recordView)->getSubscriberStats();
+			cout << recordView->name() << " delivered " << viewStats.delivered << ", dropped " << viewStats.dropped
+				 << ", peak backlog " << viewStats.peakBacklog << endl;
+		}
+		const CameraGroupStats groupStats = cameraGroup.getStats();
+		cout << "Frame sets: " << groupStats.setsEmitted << ", dropped: " << groupStats.setsDropped
+			 << ", mean skew: " << groupStats.meanSkew << ", max skew: " << groupStats.maxSkew << endl;
+		for (size_t i = 0; i < groupStats.unmatchedFrames.size(); i++) {
+			cout << "Camera " << i << " unmatched frames: " << groupStats.unmatchedFrames[i] << endl;
+		}
 	}
 
-	
-	vector<vector<char>> images;
-	for (auto& flirFuture : flirFutures) {
-		images.push_back(flirFuture.get());
+	for (auto& camera : cameras) {
+		const CameraStats stats = camera->getStats();
+		cout << camera->name() << " frames grabbed: " << stats.framesGrabbed
+			 << ", incomplete: " << stats.framesIncomplete
+			 << ", dropped: " << stats.framesDropped << endl;
+		cout << "Delivery latency: mean " << stats.deliveryLatency.meanUs << " us, p99 "
+			 << stats.deliveryLatency.p99Us << " us, max " << stats.deliveryLatency.maxUs << " us" << endl;
+		const Flir* flir = dynamic_cast<const Flir*>(camera.get());
+		if (flir) {
+			const ArenaReport arena = flir->getArenaReport();
+			cout << "Stream buffers: " << arena.bufferCount << " x " << arena.bufferSize << " bytes ("
+				 << arena.totalBytes << " total" << (arena.hugePages ? ", huge pages" : "") << "), peak in use "
+				 << arena.peakBuffersInUse << endl;
+			for (const RoiRate& rate : flir->getRoiRates()) {
+				cout << "ROI " << rate.width << "x" << rate.height << ": " << rate.frames << " frames, "
+					 << rate.fps << " fps (camera reports " << rate.resultingFrameRate << ")" << endl;
+			}
+		}
+	}
+	previews.clear();
+	fanouts.clear();
+	cameras.clear();
+	if (system) {
+		camList.Clear();
+		system->ReleaseInstance();
 	}
 
 
@@ -0,0 +1,531 @@
+#include <cstring>
+
+#include "pixelConvert.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+struct ConvertJob {
+	const uint8_t* src;
+	size_t srcStride;
+	uint8_t* dst;
+	size_t dstStride;
+	size_t width;
+	size_t height;
+	SimdLevel level;
+	void (*rows)(const ConvertJob& job, size_t begin, size_t end);
+	size_t bands;
+	// Downscale only; width and height are then the output size.
+	size_t factor = 1;
+};
+
+const char* simdLevelName(SimdLevel level) {
+	switch (level) {
+	case SimdLevel::AVX2:
+		return "AVX2";
+	case SimdLevel::SSE41:
+		return "SSE4.1";
+	default:
+		return "scalar";
+	}
+}
+
+SimdLevel detectSimdLevel() {
+#if defined(PIXEL_CONVERT_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	__cpuid(info, 1);
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 0x6) == 0x6) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	return avx2 ? SimdLevel::AVX2 : sse41 ? SimdLevel::SSE41 : SimdLevel::Scalar;
+#elif defined(PIXEL_CONVERT_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return SimdLevel::AVX2;
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		return SimdLevel::SSE41;
+	}
+	return SimdLevel::Scalar;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+// Reflects out-of-range rows/columns about the edge. Reflecting by one
+// keeps the Bayer phase of the neighbour.
+static size_t mirror(ptrdiff_t i, size_t n) {
+	if (i < 0) {
+		return static_cast<size_t>(-i);
+	}
+	if (static_cast<size_t>(i) >= n) {
+		return 2 * n - 2 - static_cast<size_t>(i);
+	}
+	return static_cast<size_t>(i);
+}
+
+
+// Bayer -> Mono8. A 3x3 [1 2 1] x [1 2 1] kernel over an RGGB mosaic weighs
+// R, G and B as 1/4, 1/2, 1/4 at every site, so one kernel serves all four
+// phases. 16-bit input is reduced to 12 bits first so the sums stay in
+// 16-bit lanes; the scalar path rounds the same way as the SIMD paths.
+
+template <typename T>
+static inline uint32_t sample12(const T* row, size_t x) {
+	return sizeof(T) == 1 ? row[x] : static_cast<uint32_t>(row[x] >> 4);
+}
+
+template <typename T>
+static void bayerToMono8Scalar(const T* r0, const T* r1, const T* r2, uint8_t* out, size_t begin, size_t end, size_t width) {
+	for (size_t x = begin; x < end; x++) {
+		const size_t xl = mirror(static_cast<ptrdiff_t>(x) - 1, width);
+		const size_t xr = mirror(static_cast<ptrdiff_t>(x) + 1, width);
+		const uint32_t vl = sample12(r0, xl) + 2 * sample12(r1, xl) + sample12(r2, xl);
+		const uint32_t vm = sample12(r0, x) + 2 * sample12(r1, x) + sample12(r2, x);
+		const uint32_t vr = sample12(r0, xr) + 2 * sample12(r1, xr) + sample12(r2, xr);
+		const uint32_t sum = vl + 2 * vm + vr;
+		if (sizeof(T) == 1) {
+			out[x] = static_cast<uint8_t>((sum + 8) >> 4);
+		}
+		else {
+			const uint32_t rounded = sum + 128 > 0xFFFF ? 0xFFFF : sum + 128;
+			out[x] = static_cast<uint8_t>(rounded >> 8);
+		}
+	}
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+TARGET_SSE41 static inline __m128i columnSum8Sse41(const uint8_t* a, const uint8_t* b, const uint8_t* c) {
+	const __m128i va = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a)));
+	const __m128i vb = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b)));
+	const __m128i vc = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c)));
+	return _mm_add_epi16(_mm_add_epi16(va, vc), _mm_slli_epi16(vb, 1));
+}
+
+TARGET_SSE41 static size_t bayer8ToMono8Sse41(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, uint8_t* out, size_t width) {
+	size_t x = 1;
+	const __m128i round = _mm_set1_epi16(8);
+	for (; x + 9 <= width; x += 8) {
+		const __m128i l = columnSum8Sse41(r0 + x - 1, r1 + x - 1, r2 + x - 1);
+		const __m128i m = columnSum8Sse41(r0 + x, r1 + x, r2 + x);
+		const __m128i r = columnSum8Sse41(r0 + x + 1, r1 + x + 1, r2 + x + 1);
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(l, r), _mm_slli_epi16(m, 1));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 4);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, sum));
+	}
+	return x;
+}
+
+TARGET_SSE41 static inline __m128i columnSum16Sse41(const uint16_t* a, const uint16_t* b, const uint16_t* c) {
+	const __m128i va = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)), 4);
+	const __m128i vb = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), 4);
+	const __m128i vc = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c)), 4);
+	return _mm_add_epi16(_mm_add_epi16(va, vc), _mm_slli_epi16(vb, 1));
+}
+
+TARGET_SSE41 static size_t bayer16ToMono8Sse41(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2, uint8_t* out, size_t width) {
+	size_t x = 1;
+	const __m128i round = _mm_set1_epi16(128);
+	for (; x + 9 <= width; x += 8) {
+		const __m128i l = columnSum16Sse41(r0 + x - 1, r1 + x - 1, r2 + x - 1);
+		const __m128i m = columnSum16Sse41(r0 + x, r1 + x, r2 + x);
+		const __m128i r = columnSum16Sse41(r0 + x + 1, r1 + x + 1, r2 + x + 1);
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(l, r), _mm_slli_epi16(m, 1));
+		sum = _mm_srli_epi16(_mm_adds_epu16(sum, round), 8);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, sum));
+	}
+	return x;
+}
+
+TARGET_AVX2 static inline __m256i columnSum8Avx2(const uint8_t* a, const uint8_t* b, const uint8_t* c) {
+	const __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+	const __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+	const __m256i vc = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c)));
+	return _mm256_add_epi16(_mm256_add_epi16(va, vc), _mm256_slli_epi16(vb, 1));
+}
+
+TARGET_AVX2 static size_t bayer8ToMono8Avx2(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, uint8_t* out, size_t width) {
+	size_t x = 1;
+	const __m256i round = _mm256_set1_epi16(8);
+	for (; x + 17 <= width; x += 16) {
+		const __m256i l = columnSum8Avx2(r0 + x - 1, r1 + x - 1, r2 + x - 1);
+		const __m256i m = columnSum8Avx2(r0 + x, r1 + x, r2 + x);
+		const __m256i r = columnSum8Avx2(r0 + x + 1, r1 + x + 1, r2 + x + 1);
+		__m256i sum = _mm256_add_epi16(_mm256_add_epi16(l, r), _mm256_slli_epi16(m, 1));
+		sum = _mm256_srli_epi16(_mm256_add_epi16(sum, round), 4);
+		const __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), packed);
+	}
+	return x;
+}
+
+TARGET_AVX2 static inline __m256i columnSum16Avx2(const uint16_t* a, const uint16_t* b, const uint16_t* c) {
+	const __m256i va = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)), 4);
+	const __m256i vb = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)), 4);
+	const __m256i vc = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c)), 4);
+	return _mm256_add_epi16(_mm256_add_epi16(va, vc), _mm256_slli_epi16(vb, 1));
+}
+
+TARGET_AVX2 static size_t bayer16ToMono8Avx2(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2, uint8_t* out, size_t width) {
+	size_t x = 1;
+	const __m256i round = _mm256_set1_epi16(128);
+	for (; x + 17 <= width; x += 16) {
+		const __m256i l = columnSum16Avx2(r0 + x - 1, r1 + x - 1, r2 + x - 1);
+		const __m256i m = columnSum16Avx2(r0 + x, r1 + x, r2 + x);
+		const __m256i r = columnSum16Avx2(r0 + x + 1, r1 + x + 1, r2 + x + 1);
+		__m256i sum = _mm256_add_epi16(_mm256_add_epi16(l, r), _mm256_slli_epi16(m, 1));
+		sum = _mm256_srli_epi16(_mm256_adds_epu16(sum, round), 8);
+		const __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), packed);
+	}
+	return x;
+}
+
+TARGET_SSE41 static size_t mono16ToMono8Sse41(const uint16_t* in, uint8_t* out, size_t width) {
+	size_t x = 0;
+	for (; x + 16 <= width; x += 16) {
+		const __m128i a = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x)), 8);
+		const __m128i b = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x + 8)), 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(a, b));
+	}
+	return x;
+}
+
+TARGET_AVX2 static size_t mono16ToMono8Avx2(const uint16_t* in, uint8_t* out, size_t width) {
+	size_t x = 0;
+	for (; x + 32 <= width; x += 32) {
+		const __m256i a = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + x)), 8);
+		const __m256i b = _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + x + 16)), 8);
+		// packus works per 128-bit lane; put the quadwords back in order.
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), packed);
+	}
+	return x;
+}
+
+// 2x2 and 4x4 box means: maddubs against ones sums horizontal pairs, the rows
+// of a block are added in 16-bit lanes, and 4x4 folds pairs of pairs with
+// madd before rounding.
+TARGET_SSE41 static size_t box2ToMono8Sse41(const uint8_t* r0, const uint8_t* r1, uint8_t* out, size_t width) {
+	const __m128i ones = _mm_set1_epi8(1);
+	const __m128i round = _mm_set1_epi16(2);
+	size_t x = 0;
+	for (; x + 8 <= width; x += 8) {
+		const __m128i a = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + 2 * x)), ones);
+		const __m128i b = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + 2 * x)), ones);
+		const __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, b), round), 2);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, sum));
+	}
+	return x;
+}
+
+TARGET_SSE41 static size_t box4ToMono8Sse41(const uint8_t* const* rows, uint8_t* out, size_t width) {
+	const __m128i ones8 = _mm_set1_epi8(1);
+	const __m128i ones16 = _mm_set1_epi16(1);
+	const __m128i round = _mm_set1_epi32(8);
+	size_t x = 0;
+	for (; x + 4 <= width; x += 4) {
+		__m128i pairs = _mm_setzero_si128();
+		for (size_t r = 0; r < 4; r++) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[r] + 4 * x));
+			pairs = _mm_add_epi16(pairs, _mm_maddubs_epi16(v, ones8));
+		}
+		const __m128i sum = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(pairs, ones16), round), 4);
+		const __m128i words = _mm_packus_epi32(sum, sum);
+		const int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+		memcpy(out + x, &packed, 4);
+	}
+	return x;
+}
+
+TARGET_AVX2 static size_t box2ToMono8Avx2(const uint8_t* r0, const uint8_t* r1, uint8_t* out, size_t width) {
+	const __m256i ones = _mm256_set1_epi8(1);
+	const __m256i round = _mm256_set1_epi16(2);
+	size_t x = 0;
+	for (; x + 16 <= width; x += 16) {
+		const __m256i a = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + 2 * x)), ones);
+		const __m256i b = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + 2 * x)), ones);
+		const __m256i sum = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(a, b), round), 2);
+		const __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), packed);
+	}
+	return x;
+}
+
+TARGET_AVX2 static size_t box4ToMono8Avx2(const uint8_t* const* rows, uint8_t* out, size_t width) {
+	const __m256i ones8 = _mm256_set1_epi8(1);
+	const __m256i ones16 = _mm256_set1_epi16(1);
+	const __m256i round = _mm256_set1_epi32(8);
+	size_t x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m256i pairs = _mm256_setzero_si256();
+		for (size_t r = 0; r < 4; r++) {
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + 4 * x));
+			pairs = _mm256_add_epi16(pairs, _mm256_maddubs_epi16(v, ones8));
+		}
+		const __m256i sum = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(pairs, ones16), round), 4);
+		const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(words, words));
+	}
+	return x;
+}
+
+#endif
+
+template <typename T>
+static void bayerToMono8Rows(const ConvertJob& job, size_t begin, size_t end) {
+	for (size_t y = begin; y < end; y++) {
+		const T* r0 = reinterpret_cast<const T*>(job.src + mirror(static_cast<ptrdiff_t>(y) - 1, job.height) * job.srcStride);
+		const T* r1 = reinterpret_cast<const T*>(job.src + y * job.srcStride);
+		const T* r2 = reinterpret_cast<const T*>(job.src + mirror(static_cast<ptrdiff_t>(y) + 1, job.height) * job.srcStride);
+		uint8_t* out = job.dst + y * job.dstStride;
+
+		size_t x = 1;
+#ifdef PIXEL_CONVERT_X86
+		if (sizeof(T) == 1) {
+			const uint8_t* a = reinterpret_cast<const uint8_t*>(r0);
+			const uint8_t* b = reinterpret_cast<const uint8_t*>(r1);
+			const uint8_t* c = reinterpret_cast<const uint8_t*>(r2);
+			if (job.level == SimdLevel::AVX2) {
+				x = bayer8ToMono8Avx2(a, b, c, out, job.width);
+			}
+			else if (job.level == SimdLevel::SSE41) {
+				x = bayer8ToMono8Sse41(a, b, c, out, job.width);
+			}
+		}
+		else {
+			const uint16_t* a = reinterpret_cast<const uint16_t*>(r0);
+			const uint16_t* b = reinterpret_cast<const uint16_t*>(r1);
+			const uint16_t* c = reinterpret_cast<const uint16_t*>(r2);
+			if (job.level == SimdLevel::AVX2) {
+				x = bayer16ToMono8Avx2(a, b, c, out, job.width);
+			}
+			else if (job.level == SimdLevel::SSE41) {
+				x = bayer16ToMono8Sse41(a, b, c, out, job.width);
+			}
+		}
+#endif
+		bayerToMono8Scalar(r0, r1, r2, out, 0, 1, job.width);
+		bayerToMono8Scalar(r0, r1, r2, out, x, job.width, job.width);
+	}
+}
+
+static void mono16ToMono8Rows(const ConvertJob& job, size_t begin, size_t end) {
+	for (size_t y = begin; y < end; y++) {
+		const uint16_t* in = reinterpret_cast<const uint16_t*>(job.src + y * job.srcStride);
+		uint8_t* out = job.dst + y * job.dstStride;
+		size_t x = 0;
+#ifdef PIXEL_CONVERT_X86
+		if (job.level == SimdLevel::AVX2) {
+			x = mono16ToMono8Avx2(in, out, job.width);
+		}
+		else if (job.level == SimdLevel::SSE41) {
+			x = mono16ToMono8Sse41(in, out, job.width);
+		}
+#endif
+		for (; x < job.width; x++) {
+			out[x] = static_cast<uint8_t>(in[x] >> 8);
+		}
+	}
+}
+
+// Bilinear demosaic of an RGGB mosaic. Left scalar: the per-phase selects
+// and the interleaved BGR store do not map cleanly onto 8/16-lane vectors,
+// and the compiler vectorizes the neighbour sums well enough.
+template <typename T>
+static void bayerToBgr8Rows(const ConvertJob& job, size_t begin, size_t end) {
+	const int shift = sizeof(T) == 1 ? 0 : 8;
+	for (size_t y = begin; y < end; y++) {
+		const T* up = reinterpret_cast<const T*>(job.src + mirror(static_cast<ptrdiff_t>(y) - 1, job.height) * job.srcStride);
+		const T* mid = reinterpret_cast<const T*>(job.src + y * job.srcStride);
+		const T* down = reinterpret_cast<const T*>(job.src + mirror(static_cast<ptrdiff_t>(y) + 1, job.height) * job.srcStride);
+		uint8_t* out = job.dst + y * job.dstStride;
+		const bool oddRow = (y & 1) != 0;
+
+		for (size_t x = 0; x < job.width; x++) {
+			const size_t xl = mirror(static_cast<ptrdiff_t>(x) - 1, job.width);
+			const size_t xr = mirror(static_cast<ptrdiff_t>(x) + 1, job.width);
+			const uint32_t centre = mid[x];
+			const uint32_t cross = (up[x] + down[x] + mid[xl] + mid[xr] + 2u) >> 2;
+			const uint32_t diagonal = (up[xl] + up[xr] + down[xl] + down[xr] + 2u) >> 2;
+			const uint32_t horizontal = (mid[xl] + mid[xr] + 1u) >> 1;
+			const uint32_t vertical = (up[x] + down[x] + 1u) >> 1;
+			const bool oddColumn = (x & 1) != 0;
+
+			uint32_t r;
+			uint32_t g;
+			uint32_t b;
+			if (!oddRow && !oddColumn) {
+				r = centre;
+				g = cross;
+				b = diagonal;
+			}
+			else if (!oddRow) {
+				r = horizontal;
+				g = centre;
+				b = vertical;
+			}
+			else if (!oddColumn) {
+				r = vertical;
+				g = centre;
+				b = horizontal;
+			}
+			else {
+				r = diagonal;
+				g = cross;
+				b = centre;
+			}
+			out[3 * x] = static_cast<uint8_t>(b >> shift);
+			out[3 * x + 1] = static_cast<uint8_t>(g >> shift);
+			out[3 * x + 2] = static_cast<uint8_t>(r >> shift);
+		}
+	}
+}
+
+static void boxDownscaleRows(const ConvertJob& job, size_t begin, size_t end) {
+	const size_t factor = job.factor;
+	const uint32_t area = static_cast<uint32_t>(factor * factor);
+	for (size_t y = begin; y < end; y++) {
+		const uint8_t* in = job.src + y * factor * job.srcStride;
+		uint8_t* out = job.dst + y * job.dstStride;
+		size_t x = 0;
+#ifdef PIXEL_CONVERT_X86
+		if (factor == 2 && job.level == SimdLevel::AVX2) {
+			x = box2ToMono8Avx2(in, in + job.srcStride, out, job.width);
+		}
+		else if (factor == 2 && job.level == SimdLevel::SSE41) {
+			x = box2ToMono8Sse41(in, in + job.srcStride, out, job.width);
+		}
+		else if (factor == 4 && job.level != SimdLevel::Scalar) {
+			const uint8_t* rows[4] = { in, in + job.srcStride, in + 2 * job.srcStride, in + 3 * job.srcStride };
+			x = job.level == SimdLevel::AVX2 ? box4ToMono8Avx2(rows, out, job.width) : box4ToMono8Sse41(rows, out, job.width);
+		}
+#endif
+		for (; x < job.width; x++) {
+			uint32_t sum = 0;
+			for (size_t dy = 0; dy < factor; dy++) {
+				const uint8_t* block = in + dy * job.srcStride + x * factor;
+				for (size_t dx = 0; dx < factor; dx++) {
+					sum += block[dx];
+				}
+			}
+			out[x] = static_cast<uint8_t>((sum + area / 2) / area);
+		}
+	}
+}
+
+static void copyRows(const ConvertJob& job, size_t begin, size_t end) {
+	const size_t bytes = job.dstStride < job.srcStride ? job.dstStride : job.srcStride;
+	for (size_t y = begin; y < end; y++) {
+		memcpy(job.dst + y * job.dstStride, job.src + y * job.srcStride, bytes);
+	}
+}
+
+
+PixelConverter::PixelConverter(size_t threads) :
+	level{ detectSimdLevel() },
+	pool{ threads }
+{}
+
+static void convertBand(void* context, size_t band) {
+	const ConvertJob& job = *static_cast<const ConvertJob*>(context);
+	job.rows(job, job.height * band / job.bands, job.height * (band + 1) / job.bands);
+}
+
+void PixelConverter::run(ConvertJob& convertJob) {
+	const size_t threads = pool.getThreadCount();
+	convertJob.bands = convertJob.height < 2 * threads ? 1 : threads;
+	pool.run(convertJob.bands, convertBand, &convertJob);
+}
+
+bool PixelConverter::isSupported(PixelFormat from, PixelFormat to) {
+	switch (from) {
+	case PixelFormat::BayerRG8:
+	case PixelFormat::BayerRG16:
+		return to == PixelFormat::Mono8 || to == PixelFormat::BGR8;
+	case PixelFormat::Mono16:
+	case PixelFormat::Mono8:
+		return to == PixelFormat::Mono8;
+	case PixelFormat::BGR8:
+		return to == PixelFormat::BGR8;
+	default:
+		return false;
+	}
+}
+
+size_t PixelConverter::requiredStride(size_t width, PixelFormat format) {
+	return width * bytesPerPixel(format);
+}
+
+bool PixelConverter::convert(const uint8_t* src, size_t srcStride, PixelFormat srcFormat,
+	uint8_t* dst, size_t dstStride, PixelFormat dstFormat,
+	size_t width, size_t height) {
+	if (!isSupported(srcFormat, dstFormat) || width < 2 || height < 2
+		|| dstStride < requiredStride(width, dstFormat)) {
+		return false;
+	}
+
+	ConvertJob convertJob{ src, srcStride, dst, dstStride, width, height, level, nullptr, 1 };
+	if (srcFormat == dstFormat) {
+		convertJob.rows = copyRows;
+	}
+	else if (srcFormat == PixelFormat::Mono16) {
+		convertJob.rows = mono16ToMono8Rows;
+	}
+	else if (dstFormat == PixelFormat::Mono8) {
+		convertJob.rows = srcFormat == PixelFormat::BayerRG8 ? bayerToMono8Rows<uint8_t> : bayerToMono8Rows<uint16_t>;
+	}
+	else {
+		convertJob.rows = srcFormat == PixelFormat::BayerRG8 ? bayerToBgr8Rows<uint8_t> : bayerToBgr8Rows<uint16_t>;
+	}
+	run(convertJob);
+	return true;
+}
+
+bool PixelConverter::downscale(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride,
+	size_t width, size_t height, size_t factor) {
+	const size_t outWidth = factor > 0 ? width / factor : 0;
+	const size_t outHeight = factor > 0 ? height / factor : 0;
+	if (factor == 0 || factor > 16 || outWidth == 0 || outHeight == 0 || dstStride < outWidth) {
+		return false;
+	}
+	ConvertJob convertJob{ src, srcStride, dst, dstStride, outWidth, outHeight, level, boxDownscaleRows, 1 };
+	convertJob.factor = factor;
+	if (factor == 1) {
+		convertJob.rows = copyRows;
+	}
+	run(convertJob);
+	return true;
+}
+
+void PixelConverter::setSimdLevel(SimdLevel level_) {
+	const SimdLevel supported = detectSimdLevel();
+	level = static_cast<int>(level_) > static_cast<int>(supported) ? supported : level_;
+}
+
+SimdLevel PixelConverter::getSimdLevel() const {
+	return level;
+}
+
+size_t PixelConverter::getThreadCount() const {
+	return pool.getThreadCount();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.h"
+#include "workerPool.h"
+
+using namespace std;
+
+
+enum class SimdLevel {
+	Scalar,
+	SSE41,
+	AVX2
+};
+
+const char* simdLevelName(SimdLevel level);
+SimdLevel detectSimdLevel();
+
+struct ConvertJob;
+
+// Pixel format conversion into caller-provided buffers, replacing
+// Image::Convert on the acquisition path. Supported:
+//   BayerRG8/16 -> Mono8  (3x3 binomial luma, SIMD)
+//   BayerRG8/16 -> BGR8   (bilinear demosaic, scalar)
+//   Mono16 -> Mono8       (SIMD)
+//   Mono8 -> Mono8, BGR8 -> BGR8 (row copy)
+// Rows are split across a WorkerPool when threads > 1.
+class PixelConverter {
+
+private:
+	SimdLevel level;
+	WorkerPool pool;
+
+	void run(ConvertJob& convertJob);
+
+public:
+	explicit PixelConverter(size_t threads = 1);
+
+	static bool isSupported(PixelFormat from, PixelFormat to);
+	static size_t requiredStride(size_t width, PixelFormat format);
+
+	// Returns false for unsupported format pairs. dst must hold
+	// height * dstStride bytes.
+	bool convert(const uint8_t* src, size_t srcStride, PixelFormat srcFormat,
+		uint8_t* dst, size_t dstStride, PixelFormat dstFormat,
+		size_t width, size_t height);
+
+	// Mono8 box filter by an integer factor up to 16: each output pixel is
+	// the rounded mean of a factor x factor block, and edge pixels that do
+	// not fill a block are dropped. dst must hold (height / factor) rows of
+	// dstStride bytes. Factors 2 and 4 are SIMD.
+	bool downscale(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride,
+		size_t width, size_t height, size_t factor);
+
+	// Benchmarking hook; levels above what the CPU supports are clamped.
+	void setSimdLevel(SimdLevel level_);
+	SimdLevel getSimdLevel() const;
+	size_t getThreadCount() const;
+};
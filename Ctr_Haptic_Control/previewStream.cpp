@@ -0,0 +1,207 @@
+#include <chrono>
+#include <cstdint>
+
+#include "previewStream.h"
+#include "utilities.h"
+
+
+static size_t clampScale(size_t factor) {
+	return factor < 1 ? 1 : factor > 16 ? 16 : factor;
+}
+
+PreviewStream::PreviewStream(ICamera& source_, const string& name_, const PreviewConfig& config) :
+	source{ source_ },
+	previewName{ name_ },
+	rate{ config.rate },
+	scale{ clampScale(config.scale) },
+	converter{ 1 },
+	bufferBytes{ 0 },
+	pool{ config.bufferCount < 2 ? 2 : config.bufferCount, nullptr },
+	latestUnread{ false },
+	running{ false },
+	lastFrameId{ UINT64_MAX },
+	previewed{ 0 },
+	skipped{ 0 },
+	dropped{ 0 },
+	scaleNanos{ 0 }
+{}
+
+PreviewStream::~PreviewStream() {
+	stopStreaming();
+}
+
+// Buffers are sized for the full-resolution Mono8 frame so changing the
+// scale never reallocates; a larger frame (a new ROI) waits until every
+// preview frame has been given back.
+bool PreviewStream::reserve(size_t bytes) {
+	if (bytes <= bufferBytes) {
+		return true;
+	}
+	{
+		lock_guard<mutex> lock(latestLock);
+		latest.reset();
+		latestUnread = false;
+	}
+	if (pool.inUse() > 0) {
+		return false;
+	}
+	buffers.clear();
+	for (size_t i = 0; i < pool.capacity(); i++) {
+		buffers.emplace_back(new uint8_t[bytes]);
+		pool.bindBuffer(i, buffers.back().get());
+	}
+	bufferBytes = bytes;
+	return true;
+}
+
+void PreviewStream::preview(const Frame& frame) {
+	const uint64_t begin = hostNanos();
+	const FrameInfo& info = frame.info();
+	if (lastFrameId != UINT64_MAX && info.frameId > lastFrameId + 1) {
+		skipped += info.frameId - lastFrameId - 1;
+	}
+	lastFrameId = info.frameId;
+
+	const uint8_t* pixels = frame.data();
+	size_t stride = info.stride;
+	if (info.pixelFormat != PixelFormat::Mono8) {
+		mono.resize(info.width * info.height);
+		if (!converter.convert(frame.data(), info.stride, info.pixelFormat, mono.data(), info.width, PixelFormat::Mono8,
+			info.width, info.height)) {
+			dropped++;
+			return;
+		}
+		pixels = mono.data();
+		stride = info.width;
+	}
+
+	const size_t factor = scale;
+	FrameInfo previewInfo = info;
+	previewInfo.width = info.width / factor;
+	previewInfo.height = info.height / factor;
+	previewInfo.stride = previewInfo.width;
+	previewInfo.pixelFormat = PixelFormat::Mono8;
+	Frame out;
+	if (reserve(info.width * info.height)) {
+		out = pool.acquire(previewInfo.stride * previewInfo.height, previewInfo);
+	}
+	if (!out || !converter.downscale(pixels, stride, buffers[out.slotIndex()].get(), previewInfo.stride,
+		info.width, info.height, factor)) {
+		dropped++;
+		return;
+	}
+	scaleNanos += hostNanos() - begin;
+	previewed++;
+
+	{
+		lock_guard<mutex> lock(latestLock);
+		swap(latest, out);
+		latestUnread = true;
+	}
+	// out (the previous preview) is released here, outside the lock.
+}
+
+void PreviewStream::previewLoop() {
+	Frame frame;
+	Frame newest;
+	uint64_t next = hostNanos();
+	while (running) {
+		const double fps = rate;
+		const uint64_t now = hostNanos();
+		if (fps <= 0.0 || now < next) {
+			const uint64_t nap = fps <= 0.0 ? 10000000 : next - now;
+			this_thread::sleep_for(chrono::nanoseconds(nap < 10000000 ? nap : 10000000));
+			continue;
+		}
+		// A late tick does not try to catch up.
+		const uint64_t period = static_cast<uint64_t>(1e9 / fps);
+		next = next + period > now ? next + period : now + period;
+
+		// Whatever the source has queued, only the newest frame is used.
+		while (source.tryPopFrame(frame)) {
+			newest = move(frame);
+		}
+		if (newest) {
+			preview(newest);
+			newest.reset();
+		}
+	}
+}
+
+void PreviewStream::setRate(double fps) {
+	rate = fps > 0.0 ? fps : 0.0;
+}
+
+double PreviewStream::getRate() const {
+	return rate;
+}
+
+void PreviewStream::setScale(size_t factor) {
+	scale = clampScale(factor);
+}
+
+size_t PreviewStream::getScale() const {
+	return scale;
+}
+
+string PreviewStream::name() const {
+	return previewName;
+}
+
+void PreviewStream::startStreaming() {
+	if (running) {
+		return;
+	}
+	source.startStreaming();
+	lastFrameId = UINT64_MAX;
+	running = true;
+	previewThread = thread(&PreviewStream::previewLoop, this);
+}
+
+void PreviewStream::stopStreaming() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	if (previewThread.joinable()) {
+		previewThread.join();
+	}
+	lock_guard<mutex> lock(latestLock);
+	latest.reset();
+	latestUnread = false;
+}
+
+bool PreviewStream::isStreaming() const {
+	return running && source.isStreaming();
+}
+
+bool PreviewStream::tryPopFrame(Frame& frame) {
+	{
+		lock_guard<mutex> lock(latestLock);
+		if (!latestUnread) {
+			return false;
+		}
+		frame = latest;
+		latestUnread = false;
+	}
+	deliveryLatency.record(hostNanos() - frame.info().hostTimestamp);
+	return true;
+}
+
+CameraStats PreviewStream::getStats() const {
+	CameraStats stats;
+	stats.framesGrabbed = previewed;
+	stats.framesDropped = dropped;
+	stats.deliveryLatency = deliveryLatency.summary();
+	return stats;
+}
+
+PreviewStats PreviewStream::getPreviewStats() const {
+	PreviewStats stats;
+	stats.framesPreviewed = previewed;
+	stats.framesSkipped = skipped;
+	stats.framesDropped = dropped;
+	if (stats.framesPreviewed > 0) {
+		stats.meanScaleUs = scaleNanos / 1e3 / stats.framesPreviewed;
+	}
+	return stats;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "icamera.h"
+#include "latencyHistogram.h"
+#include "pixelConvert.h"
+
+using namespace std;
+
+
+struct PreviewConfig {
+	// Preview frames per second; 0 pauses the preview.
+	double rate = 10.0;
+	// Box downscale factor, 1 to 16; 1 keeps full resolution.
+	size_t scale = 4;
+	// Preview frames in flight: one being drawn, one latest, one held by the UI.
+	size_t bufferCount = 3;
+};
+
+struct PreviewStats {
+	uint64_t framesPreviewed = 0;
+	// Source frames that arrived between ticks and were never previewed.
+	uint64_t framesSkipped = 0;
+	// Ticks with no free buffer or a frame that could not be converted.
+	uint64_t framesDropped = 0;
+	// Time spent converting and downscaling, per preview frame.
+	double meanScaleUs = 0.0;
+};
+
+// Low-rate, downscaled Mono8 view of a camera for the operator UI, itself
+// an ICamera. Put it behind a LatestOnly subscriber: on every tick its own
+// thread takes the newest frame, converts and box-filters it into one of a
+// few private buffers, and drops anything older. Nothing is ever queued, so
+// the preview cannot hold camera buffers or compete with recording beyond
+// one conversion per tick. tryPopFrame() returns the newest preview only.
+// Rate and scale may be changed while streaming.
+class PreviewStream : public ICamera {
+
+private:
+	ICamera& source;
+	string previewName;
+	atomic<double> rate;
+	atomic<size_t> scale;
+
+	PixelConverter converter;
+	vector<uint8_t> mono;
+	size_t bufferBytes;
+	vector<unique_ptr<uint8_t[]>> buffers;
+	FramePool pool;
+
+	mutex latestLock;
+	Frame latest;
+	bool latestUnread;
+
+	thread previewThread;
+	atomic<bool> running;
+	uint64_t lastFrameId;
+
+	atomic<uint64_t> previewed;
+	atomic<uint64_t> skipped;
+	atomic<uint64_t> dropped;
+	atomic<uint64_t> scaleNanos;
+	LatencyHistogram deliveryLatency;
+
+	bool reserve(size_t bytes);
+	void preview(const Frame& frame);
+	void previewLoop();
+
+public:
+	PreviewStream(ICamera& source_, const string& name_, const PreviewConfig& config);
+	~PreviewStream();
+	PreviewStream(const PreviewStream&) = delete;
+	PreviewStream& operator=(const PreviewStream&) = delete;
+
+	void setRate(double fps);
+	double getRate() const;
+	// Clamped to 1-16.
+	void setScale(size_t factor);
+	size_t getScale() const;
+
+	string name() const override;
+
+	// Starts the source as well; stopping leaves the source streaming.
+	void startStreaming() override;
+	void stopStreaming() override;
+	bool isStreaming() const override;
+
+	bool tryPopFrame(Frame& frame) override;
+	CameraStats getStats() const override;
+	PreviewStats getPreviewStats() const;
+};
@@ -0,0 +1,696 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include "recorder.h"
+#include "utilities.h"
+
+static constexpr intptr_t INVALID_FILE = -1;
+
+static size_t roundUp(size_t value, size_t multiple) {
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+
+// Hands protobuf the free tail of the staging chunk, writing the chunk out
+// whenever it fills.
+class Recorder::ChunkStream : public google::protobuf::io::ZeroCopyOutputStream {
+
+private:
+	Recorder& recorder;
+	int64_t count;
+
+public:
+	explicit ChunkStream(Recorder& recorder_) :
+		recorder{ recorder_ },
+		count{ 0 }
+	{}
+
+	bool Next(void** data, int* size) override {
+		if (recorder.failed) {
+			return false;
+		}
+		if (recorder.chunkFill == recorder.config.chunkBytes) {
+			recorder.chunkFill = 0;
+			if (!recorder.writeChunk(recorder.config.chunkBytes)) {
+				return false;
+			}
+		}
+		const size_t space = recorder.config.chunkBytes - recorder.chunkFill;
+		*data = recorder.chunk + recorder.chunkFill;
+		*size = static_cast<int>(space);
+		recorder.chunkFill += space;
+		recorder.fileOffset += space;
+		count += space;
+		return true;
+	}
+
+	void BackUp(int bytes) override {
+		recorder.chunkFill -= bytes;
+		recorder.fileOffset -= bytes;
+		count -= bytes;
+	}
+
+	int64_t ByteCount() const override {
+		return count;
+	}
+};
+
+
+Recorder::Source::Source(const string& name_, bool compress_, size_t capacity, size_t encodedCapacity) :
+	name{ name_ },
+	compress{ compress_ },
+	queue{ capacity },
+	encoded{ encodedCapacity }
+{}
+
+Recorder::Recorder(const RecorderConfig& config_) :
+	config{ config_ },
+	file{ INVALID_FILE },
+	directIo{ false },
+	chunk{ nullptr },
+	chunkFill{ 0 },
+	fileOffset{ 0 },
+	flushedOffset{ 0 },
+	freeSlots{ config_.codecQueueCapacity },
+	carriedSlot{ nullptr },
+	codecDone{ true },
+	stageQueue{ config_.telemetryQueueCapacity },
+	cameraQueue{ config_.telemetryQueueCapacity },
+	stageSubmitted{ 0 },
+	cameraSubmitted{ 0 },
+	telemetryDropped{ 0 },
+	telemetryRecords{ 0 },
+	telemetryBytes{ 0 },
+	running{ false },
+	bytesWritten{ 0 },
+	chunksWritten{ 0 },
+	writeNanos{ 0 },
+	failed{ false },
+	startNanos{ 0 },
+	stopNanos{ 0 }
+{
+	config.chunkBytes = roundUp(config.chunkBytes > 0 ? config.chunkBytes : SESSION_BLOCK_SIZE, SESSION_BLOCK_SIZE);
+	if (config.codecThreads == 0) {
+		config.codecThreads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+	}
+	config.codecQueueCapacity = config.codecQueueCapacity > 0 ? config.codecQueueCapacity : 1;
+}
+
+Recorder::~Recorder() {
+	stop();
+}
+
+size_t Recorder::addSource(const string& name, bool compress) {
+	if (running) {
+		throw logic_error("Recorder::addSource called while running");
+	}
+	if (sources.size() >= SESSION_MAX_SOURCES) {
+		throw logic_error("Recorder::addSource: too many sources");
+	}
+	sources.push_back(make_unique<Source>(name, compress, config.queueCapacity, config.codecQueueCapacity));
+	if (compress && !codec) {
+		codec = make_unique<LosslessCodec>(config.codecThreads);
+	}
+	return sources.size() - 1;
+}
+
+bool Recorder::openFile() {
+#ifdef _WIN32
+	HANDLE handle = INVALID_HANDLE_VALUE;
+	if (config.directIo) {
+		handle = CreateFileA(config.path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+			FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, nullptr);
+		directIo = handle != INVALID_HANDLE_VALUE;
+	}
+	if (handle == INVALID_HANDLE_VALUE) {
+		handle = CreateFileA(config.path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	}
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	file = reinterpret_cast<intptr_t>(handle);
+#else
+	int fd = -1;
+#ifdef O_DIRECT
+	if (config.directIo) {
+		fd = open(config.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+		directIo = fd >= 0;
+	}
+#endif
+	if (fd < 0) {
+		fd = open(config.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (fd < 0) {
+		return false;
+	}
+	file = fd;
+#endif
+	return true;
+}
+
+void Recorder::closeFile() {
+	if (file == INVALID_FILE) {
+		return;
+	}
+#ifdef _WIN32
+	CloseHandle(reinterpret_cast<HANDLE>(file));
+#else
+	close(static_cast<int>(file));
+#endif
+	file = INVALID_FILE;
+}
+
+void Recorder::fail(const string& reason) {
+	cout << "Error: " << reason << "; recording stopped." << endl;
+	{
+		lock_guard<mutex> lock(errorLock);
+		error = reason;
+	}
+	failed = true;
+	for (const auto& frame : staged) {
+		sources[frame.second]->dropped++;
+	}
+	staged.clear();
+}
+
+// bytes is a multiple of SESSION_BLOCK_SIZE and chunk is page-aligned, as
+// unbuffered I/O requires.
+bool Recorder::writeChunk(size_t bytes) {
+	if (failed) {
+		return false;
+	}
+	const uint64_t begin = hostNanos();
+	const uint8_t* p = chunk;
+	size_t remaining = bytes;
+	while (remaining > 0) {
+#ifdef _WIN32
+		DWORD written = 0;
+		const DWORD request = remaining > 0x40000000 ? 0x40000000 : static_cast<DWORD>(remaining);
+		if (!WriteFile(reinterpret_cast<HANDLE>(file), p, request, &written, nullptr) || written == 0) {
+			fail("session write failed (" + to_string(GetLastError()) + ")");
+			return false;
+		}
+#else
+		const ssize_t written = write(static_cast<int>(file), p, remaining);
+		if (written <= 0) {
+			fail(string("session write failed (") + (written < 0 ? strerror(errno) : "no progress") + ")");
+			return false;
+		}
+#endif
+		p += written;
+		remaining -= written;
+	}
+	writeNanos += hostNanos() - begin;
+	bytesWritten += bytes;
+	chunksWritten++;
+	flushedOffset += bytes;
+	while (!staged.empty() && staged.front().first <= flushedOffset) {
+		sources[staged.front().second]->written++;
+		staged.pop_front();
+	}
+	return true;
+}
+
+void Recorder::append(const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	while (size > 0 && !failed) {
+		const size_t space = config.chunkBytes - chunkFill;
+		const size_t n = size < space ? size : space;
+		if (bytes) {
+			memcpy(chunk + chunkFill, bytes, n);
+			bytes += n;
+		}
+		else {
+			memset(chunk + chunkFill, 0, n);
+		}
+		chunkFill += n;
+		fileOffset += n;
+		size -= n;
+		if (chunkFill == config.chunkBytes) {
+			chunkFill = 0;
+			writeChunk(config.chunkBytes);
+		}
+	}
+}
+
+// Fills with a Padding record until reserve bytes short of a multiple of
+// alignment. Records are RECORD_ALIGNMENT-aligned, so a non-empty gap
+// always fits a header.
+void Recorder::appendPadding(size_t alignment, size_t reserve) {
+	const size_t gap = (alignment - (chunkFill + reserve) % alignment) % alignment;
+	if (gap == 0) {
+		return;
+	}
+	RecordHeader header{};
+	header.magic = RECORD_MAGIC;
+	header.type = static_cast<uint16_t>(RecordType::Padding);
+	header.payloadSize = gap - sizeof(header);
+	append(&header, sizeof(header));
+	append(nullptr, header.payloadSize);
+}
+
+void Recorder::writeHeader() {
+	SessionHeader header{};
+	memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+	header.version = SESSION_VERSION;
+	header.headerSize = static_cast<uint32_t>(SESSION_BLOCK_SIZE);
+	header.chunkBytes = static_cast<uint32_t>(config.chunkBytes);
+	header.sourceCount = static_cast<uint32_t>(sources.size());
+	header.createdHostNanos = hostNanos();
+	for (size_t i = 0; i < sources.size(); i++) {
+		strncpy(header.sourceNames[i], sources[i]->name.c_str(), SESSION_SOURCE_NAME_SIZE - 1);
+	}
+	append(&header, sizeof(header));
+	append(nullptr, SESSION_BLOCK_SIZE - sizeof(header));
+}
+
+void Recorder::writeFrame(uint16_t source, const Frame& frame, const Encoded* encoded) {
+	const FrameInfo& info = frame.info();
+	const uint8_t* payload = frame.data();
+	size_t payloadSize = frame.size();
+	RecordEncoding encoding = RecordEncoding::Raw;
+	if (encoded && encoded->size > 0 && encoded->size < payloadSize) {
+		payload = encoded->data.data();
+		payloadSize = encoded->size;
+		encoding = RecordEncoding::Lossless;
+	}
+	sources[source]->rawBytes += frame.size();
+	sources[source]->storedBytes += payloadSize;
+
+	IndexEntry entry{};
+	entry.offset = fileOffset;
+	entry.frameId = info.frameId;
+	entry.timestamp = info.timestamp;
+	entry.hostTimestamp = info.hostTimestamp;
+	entry.payloadSize = static_cast<uint32_t>(payloadSize);
+	entry.source = source;
+	index.push_back(entry);
+
+	RecordHeader header{};
+	header.magic = RECORD_MAGIC;
+	header.type = static_cast<uint16_t>(RecordType::Frame);
+	header.source = source;
+	header.payloadSize = payloadSize;
+	header.frameId = info.frameId;
+	header.timestamp = info.timestamp;
+	header.hostTimestamp = info.hostTimestamp;
+	header.width = static_cast<uint32_t>(info.width);
+	header.height = static_cast<uint32_t>(info.height);
+	header.stride = static_cast<uint32_t>(info.stride);
+	header.pixelFormat = static_cast<uint16_t>(info.pixelFormat);
+	header.encoding = static_cast<uint16_t>(encoding);
+	header.offsetX = static_cast<uint32_t>(info.offsetX);
+	header.offsetY = static_cast<uint32_t>(info.offsetY);
+	append(&header, sizeof(header));
+	append(payload, payloadSize);
+	append(nullptr, alignRecord(payloadSize) - payloadSize);
+}
+
+void Recorder::writeTelemetry() {
+	if (failed) {
+		telemetryDropped += telemetry.stageCount() + telemetry.cameraCount();
+		telemetry.clear();
+		return;
+	}
+	const size_t payloadSize = telemetry.byteSize();
+	const uint64_t first = telemetry.firstHostTimestamp();
+	IndexEntry entry{};
+	entry.offset = fileOffset;
+	entry.timestamp = first;
+	entry.hostTimestamp = first;
+	entry.payloadSize = static_cast<uint32_t>(payloadSize);
+	entry.source = TELEMETRY_SOURCE;
+	index.push_back(entry);
+
+	RecordHeader header{};
+	header.magic = RECORD_MAGIC;
+	header.type = static_cast<uint16_t>(RecordType::Telemetry);
+	header.source = TELEMETRY_SOURCE;
+	header.payloadSize = payloadSize;
+	header.timestamp = first;
+	header.hostTimestamp = first;
+	append(&header, sizeof(header));
+	ChunkStream stream(*this);
+	{
+		google::protobuf::io::CodedOutputStream out(&stream);
+		telemetry.serialize(out);
+	}
+	if (!failed && static_cast<size_t>(stream.ByteCount()) != payloadSize) {
+		cout << "Error: telemetry batch size mismatch." << endl;
+	}
+	append(nullptr, alignRecord(payloadSize) - payloadSize);
+	telemetryRecords++;
+	telemetryBytes += payloadSize;
+	telemetry.clear();
+}
+
+void Recorder::writeIndex() {
+	const uint64_t indexOffset = fileOffset;
+	const size_t indexBytes = index.size() * sizeof(IndexEntry);
+	RecordHeader header{};
+	header.magic = RECORD_MAGIC;
+	header.type = static_cast<uint16_t>(RecordType::Index);
+	header.payloadSize = indexBytes;
+	append(&header, sizeof(header));
+	append(index.data(), indexBytes);
+	append(nullptr, alignRecord(indexBytes) - indexBytes);
+
+	appendPadding(SESSION_BLOCK_SIZE, sizeof(SessionFooter));
+	SessionFooter footer{};
+	footer.magic = RECORD_MAGIC;
+	footer.type = static_cast<uint16_t>(RecordType::Footer);
+	footer.indexOffset = indexOffset;
+	footer.indexCount = index.size();
+	memcpy(footer.footerMagic, SESSION_FOOTER_MAGIC, sizeof(footer.footerMagic));
+	append(&footer, sizeof(footer));
+}
+
+// Moves queued samples into the batch, writing a record each time it fills.
+// A partial batch is written when flush is set or its oldest sample is past
+// telemetryFlushMs. Returns the number of samples taken.
+size_t Recorder::drainTelemetry(bool flush) {
+	size_t total = 0;
+	StageSample stage;
+	CameraSample camera;
+	for (;;) {
+		const bool room = telemetry.stageCount() + telemetry.cameraCount() < config.telemetryBatchSamples;
+		size_t popped = 0;
+		if (room && stageQueue.tryPop(stage)) {
+			telemetry.add(stage);
+			popped++;
+		}
+		if (room && cameraQueue.tryPop(camera)) {
+			telemetry.add(camera);
+			popped++;
+		}
+		if (popped == 0) {
+			break;
+		}
+		total += popped;
+		if (telemetry.stageCount() + telemetry.cameraCount() >= config.telemetryBatchSamples) {
+			writeTelemetry();
+		}
+	}
+	if (!telemetry.empty() && (flush || hostNanos() - telemetry.firstHostTimestamp() >= config.telemetryFlushMs * 1000000)) {
+		writeTelemetry();
+	}
+	return total;
+}
+
+// Takes a few frames from each source in turn so one busy camera cannot
+// starve the others. Returns the number of frames written.
+size_t Recorder::drain() {
+	static constexpr size_t BATCH = 4;
+	size_t total = 0;
+	Frame frame;
+	for (size_t i = 0; i < sources.size(); i++) {
+		Source& source = *sources[i];
+		for (size_t n = 0; n < BATCH; n++) {
+			Encoded* slot = nullptr;
+			if (source.compress ? !source.encoded.tryPop(slot) : !source.queue.tryPop(frame)) {
+				break;
+			}
+			if (failed) {
+				source.dropped++;
+			}
+			else {
+				writeFrame(static_cast<uint16_t>(i), slot ? slot->frame : frame, slot);
+				staged.emplace_back(fileOffset, static_cast<uint16_t>(i));
+			}
+			if (slot) {
+				slot->frame.reset();
+				freeSlots.tryPush(move(slot));
+			}
+			frame.reset();
+			total++;
+		}
+	}
+	return total;
+}
+
+void Recorder::ioLoop() {
+	// The codec thread finishes what was submitted before stop() after
+	// running drops, and needs its slots back meanwhile.
+	while (running || !codecDone) {
+		if (drain() + drainTelemetry(false) == 0) {
+			this_thread::sleep_for(chrono::microseconds(200));
+		}
+	}
+	while (drain() > 0) {
+	}
+	drainTelemetry(true);
+	if (!failed) {
+		writeIndex();
+	}
+	if (chunkFill > 0) {
+		writeChunk(chunkFill);
+		chunkFill = 0;
+	}
+	closeFile();
+}
+
+void Recorder::encode(Encoded& slot) {
+	const FrameInfo& info = slot.frame.info();
+	slot.size = 0;
+	if (!LosslessCodec::isSupported(info.pixelFormat)) {
+		return;
+	}
+	const size_t capacity = LosslessCodec::maxEncodedSize(info);
+	if (slot.data.size() < capacity) {
+		slot.data.resize(capacity);
+	}
+	slot.size = codec->encode(slot.frame.data(), info, slot.data.data(), slot.data.size());
+}
+
+// One frame from each compressing source in turn, while slots are free.
+// slot carries a free slot over to the next call. Returns the number of
+// frames compressed.
+size_t Recorder::encodeFrames(Encoded*& slot) {
+	size_t total = 0;
+	for (auto& source : sources) {
+		if (!source->compress) {
+			continue;
+		}
+		if (!slot && !freeSlots.tryPop(slot)) {
+			break;
+		}
+		if (!source->queue.tryPop(slot->frame)) {
+			continue;
+		}
+		encode(*slot);
+		// Never full: it has room for every slot.
+		source->encoded.tryPush(move(slot));
+		slot = nullptr;
+		total++;
+	}
+	return total;
+}
+
+void Recorder::codecLoop() {
+	Encoded*& slot = carriedSlot;
+	while (running) {
+		if (encodeFrames(slot) == 0) {
+			this_thread::sleep_for(chrono::microseconds(200));
+		}
+	}
+	// Everything submitted before stop(), as the I/O thread frees slots.
+	for (;;) {
+		bool queued = false;
+		for (auto& source : sources) {
+			queued = queued || (source->compress && source->queue.size() > 0);
+		}
+		if (!queued) {
+			break;
+		}
+		if (encodeFrames(slot) == 0) {
+			this_thread::sleep_for(chrono::microseconds(200));
+		}
+	}
+	codecDone = true;
+}
+
+bool Recorder::start() {
+	if (running) {
+		return true;
+	}
+	if (!openFile()) {
+		cout << "Error: unable to open " << config.path << " for recording." << endl;
+		return false;
+	}
+	if (!staging.allocate(config.chunkBytes, 1, false)) {
+		cout << "Error: unable to allocate the recorder staging chunk." << endl;
+		closeFile();
+		return false;
+	}
+	chunk = static_cast<uint8_t*>(staging.buffers()[0]);
+	chunkFill = 0;
+	fileOffset = 0;
+	flushedOffset = 0;
+	staged.clear();
+	index.clear();
+	index.reserve(1 << 16);
+	telemetry.clear();
+	telemetry.reserve(config.telemetryBatchSamples);
+	stageSubmitted = 0;
+	cameraSubmitted = 0;
+	telemetryDropped = 0;
+	telemetryRecords = 0;
+	telemetryBytes = 0;
+	bytesWritten = 0;
+	chunksWritten = 0;
+	writeNanos = 0;
+	failed = false;
+	{
+		lock_guard<mutex> lock(errorLock);
+		error.clear();
+	}
+	writeHeader();
+
+	if (codec && encodedSlots.empty()) {
+		for (size_t i = 0; i < config.codecQueueCapacity; i++) {
+			encodedSlots.push_back(make_unique<Encoded>());
+			Encoded* slot = encodedSlots.back().get();
+			freeSlots.tryPush(move(slot));
+		}
+	}
+
+	startNanos = hostNanos();
+	stopNanos = 0;
+	codecDone = !codec;
+	running = true;
+	if (codec) {
+		codecThread = thread(&Recorder::codecLoop, this);
+	}
+	ioThread = thread(&Recorder::ioLoop, this);
+	return true;
+}
+
+void Recorder::stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	if (codecThread.joinable()) {
+		codecThread.join();
+	}
+	if (ioThread.joinable()) {
+		ioThread.join();
+	}
+	stopNanos = hostNanos();
+	// Frames submitted after the final drain.
+	Frame frame;
+	for (auto& source : sources) {
+		while (source->queue.tryPop(frame)) {
+			source->dropped++;
+			frame.reset();
+		}
+	}
+	StageSample stage;
+	while (stageQueue.tryPop(stage)) {
+		telemetryDropped++;
+	}
+	CameraSample camera;
+	while (cameraQueue.tryPop(camera)) {
+		telemetryDropped++;
+	}
+}
+
+bool Recorder::isRunning() const {
+	return running;
+}
+
+bool Recorder::submit(size_t source, const Frame& frame) {
+	Source& target = *sources[source];
+	target.submitted++;
+	Frame copy = frame;
+	if (!running || failed || !target.queue.tryPush(move(copy))) {
+		target.dropped++;
+		return false;
+	}
+	const size_t depth = target.queue.size();
+	if (depth > target.peakDepth.load(memory_order_relaxed)) {
+		target.peakDepth.store(depth, memory_order_relaxed);
+	}
+	return true;
+}
+
+bool Recorder::submitStage(const StageSample& sample) {
+	stageSubmitted++;
+	StageSample copy = sample;
+	if (!running || failed || !stageQueue.tryPush(move(copy))) {
+		telemetryDropped++;
+		return false;
+	}
+	return true;
+}
+
+bool Recorder::submitCamera(const CameraSample& sample) {
+	cameraSubmitted++;
+	CameraSample copy = sample;
+	if (!running || failed || !cameraQueue.tryPush(move(copy))) {
+		telemetryDropped++;
+		return false;
+	}
+	return true;
+}
+
+RecorderStats Recorder::getStats() const {
+	RecorderStats stats;
+	stats.bytesWritten = bytesWritten;
+	stats.chunksWritten = chunksWritten;
+	stats.directIo = directIo;
+	stats.failed = failed;
+	{
+		lock_guard<mutex> lock(errorLock);
+		stats.error = error;
+	}
+	const uint64_t end = stopNanos > 0 ? stopNanos.load() : hostNanos();
+	if (startNanos > 0 && end > startNanos) {
+		stats.sustainedMBps = stats.bytesWritten * 1e3 / (end - startNanos);
+	}
+	if (writeNanos > 0) {
+		stats.deviceMBps = stats.bytesWritten * 1e3 / writeNanos;
+	}
+	if (codec) {
+		stats.codec = codec->getStats();
+	}
+	stats.stageSamples = stageSubmitted;
+	stats.cameraSamples = cameraSubmitted;
+	stats.telemetryDropped = telemetryDropped;
+	stats.telemetryRecords = telemetryRecords;
+	stats.telemetryBytes = telemetryBytes;
+	for (const auto& source : sources) {
+		RecorderSourceStats sourceStats;
+		sourceStats.name = source->name;
+		sourceStats.framesSubmitted = source->submitted;
+		sourceStats.framesWritten = source->written;
+		sourceStats.framesDropped = source->dropped;
+		sourceStats.queueDepth = source->queue.size();
+		sourceStats.peakQueueDepth = source->peakDepth;
+		sourceStats.compressed = source->compress;
+		sourceStats.rawBytes = source->rawBytes;
+		sourceStats.storedBytes = source->storedBytes;
+		if (sourceStats.storedBytes > 0) {
+			sourceStats.ratio = static_cast<double>(sourceStats.rawBytes) / sourceStats.storedBytes;
+		}
+		stats.framesWritten += sourceStats.framesWritten;
+		stats.framesDropped += sourceStats.framesDropped;
+		stats.sources.push_back(sourceStats);
+	}
+	return stats;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bufferArena.h"
+#include "frame.h"
+#include "losslessCodec.h"
+#include "ringBuffer.h"
+#include "sessionFormat.h"
+#include "telemetry.h"
+
+using namespace std;
+
+
+struct RecorderConfig {
+	string path;
+	// Size of each write; rounded up to SESSION_BLOCK_SIZE.
+	size_t chunkBytes = 8 * 1024 * 1024;
+	// Frames buffered per source between the producer and the I/O thread.
+	size_t queueCapacity = 64;
+	// Bypass the OS page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING). Falls
+	// back to buffered writes where the filesystem refuses it.
+	bool directIo = true;
+	// Threads compressing frames, each frame striped across all of them;
+	// 0 uses every hardware thread.
+	size_t codecThreads = 0;
+	// Compressed frames that may wait for the I/O thread. Each keeps a
+	// worst-case-sized buffer.
+	size_t codecQueueCapacity = 4;
+	// Stage and camera samples buffered between producers and the I/O thread.
+	size_t telemetryQueueCapacity = 1 << 16;
+	// A telemetry record is written once this many samples are batched, or
+	// when the oldest batched sample is telemetryFlushMs old.
+	size_t telemetryBatchSamples = 4096;
+	size_t telemetryFlushMs = 1000;
+};
+
+struct RecorderSourceStats {
+	string name;
+	uint64_t framesSubmitted = 0;
+	uint64_t framesWritten = 0;
+	// Frames refused because the source's queue was full.
+	uint64_t framesDropped = 0;
+	size_t queueDepth = 0;
+	size_t peakQueueDepth = 0;
+	bool compressed = false;
+	// Frame payload bytes before and after compression.
+	uint64_t rawBytes = 0;
+	uint64_t storedBytes = 0;
+	double ratio = 0.0;
+};
+
+struct RecorderStats {
+	uint64_t bytesWritten = 0;
+	uint64_t chunksWritten = 0;
+	uint64_t framesWritten = 0;
+	uint64_t framesDropped = 0;
+	// Bytes over wall time since start().
+	double sustainedMBps = 0.0;
+	// Bytes over time spent inside write calls.
+	double deviceMBps = 0.0;
+	bool directIo = false;
+	// A write failed; nothing was written after it, and the session has no
+	// index. error says why.
+	bool failed = false;
+	string error;
+	CodecStats codec;
+	uint64_t stageSamples = 0;
+	uint64_t cameraSamples = 0;
+	// Samples refused because a telemetry queue was full.
+	uint64_t telemetryDropped = 0;
+	uint64_t telemetryRecords = 0;
+	uint64_t telemetryBytes = 0;
+	vector<RecorderSourceStats> sources;
+};
+
+// Appends raw frames and their metadata to a session file (see
+// sessionFormat.h) from a dedicated I/O thread. Producers hand over Frame
+// references through a per-source SPSC ring and never block; a full ring
+// drops the frame and counts it. The I/O thread copies records into an
+// aligned staging chunk and writes whole chunks, so the disk sees large
+// sequential aligned writes regardless of frame size. stop() appends an
+// index of every frame and a footer pointing at it, for SessionReader.
+//
+// Frames of sources added with compress set are taken by a codec thread,
+// which runs LosslessCodec with the stripes of each frame spread over
+// codecThreads, and handed to the I/O thread in finished buffers: writing
+// one frame overlaps compressing the next, and the I/O thread only copies.
+// When the codec falls behind, frames back up into the source's ring and are
+// dropped there. A frame that does not shrink is stored raw.
+//
+// Stage and camera samples go through their own SPSC rings and are written
+// in batches as Telemetry records, serialized straight into the staging
+// chunk.
+//
+// The first failed write (disk full, an unbuffered write the device
+// refuses, ...) stops the recording: nothing more is written, submit()
+// refuses everything and getStats() reports the error.
+//
+// io_uring is not used: one synchronous writer per file already streams
+// chunk-sized writes back to back, and the build targets Windows.
+class Recorder {
+
+private:
+	// A frame compressed by the codec thread, waiting for the I/O thread.
+	// The Frame stays referenced for its metadata and until it is written.
+	struct Encoded {
+		Frame frame;
+		vector<uint8_t> data;
+		size_t size = 0;
+	};
+
+	struct Source {
+		string name;
+		bool compress;
+		RingBuffer<Frame> queue;
+		// compress: frames out of the codec, in order.
+		RingBuffer<Encoded*> encoded;
+		atomic<uint64_t> submitted{ 0 };
+		atomic<uint64_t> written{ 0 };
+		atomic<uint64_t> dropped{ 0 };
+		atomic<size_t> peakDepth{ 0 };
+		atomic<uint64_t> rawBytes{ 0 };
+		atomic<uint64_t> storedBytes{ 0 };
+
+		Source(const string& name_, bool compress_, size_t capacity, size_t encodedCapacity);
+	};
+
+	// ZeroCopyOutputStream over the staging chunk.
+	class ChunkStream;
+
+	RecorderConfig config;
+	vector<unique_ptr<Source>> sources;
+
+	intptr_t file;
+	bool directIo;
+	BufferArena staging;
+	uint8_t* chunk;
+	size_t chunkFill;
+	// Bytes appended so far, i.e. the file offset of the next record.
+	uint64_t fileOffset;
+	// Bytes that reached the file, and the frames appended past that point
+	// (end offset, source): a frame counts as written once all of it has.
+	uint64_t flushedOffset;
+	deque<pair<uint64_t, uint16_t>> staged;
+	vector<IndexEntry> index;
+	unique_ptr<LosslessCodec> codec;
+	vector<unique_ptr<Encoded>> encodedSlots;
+	// Slots back from the I/O thread, its only producer, to the codec
+	// thread.
+	RingBuffer<Encoded*> freeSlots;
+	// Codec thread only: a free slot it has taken but not filled yet, kept
+	// from one recording to the next rather than pushed back.
+	Encoded* carriedSlot;
+	thread codecThread;
+	atomic<bool> codecDone;
+
+	RingBuffer<StageSample> stageQueue;
+	RingBuffer<CameraSample> cameraQueue;
+	TelemetryBatcher telemetry;
+	atomic<uint64_t> stageSubmitted;
+	atomic<uint64_t> cameraSubmitted;
+	atomic<uint64_t> telemetryDropped;
+	atomic<uint64_t> telemetryRecords;
+	atomic<uint64_t> telemetryBytes;
+
+	thread ioThread;
+	atomic<bool> running;
+	atomic<uint64_t> bytesWritten;
+	atomic<uint64_t> chunksWritten;
+	atomic<uint64_t> writeNanos;
+	atomic<bool> failed;
+	mutable mutex errorLock;
+	string error;
+	uint64_t startNanos;
+	atomic<uint64_t> stopNanos;
+
+	bool openFile();
+	void closeFile();
+	bool writeChunk(size_t bytes);
+	void fail(const string& reason);
+	void append(const void* data, size_t size);
+	void appendPadding(size_t alignment, size_t reserve = 0);
+	void writeHeader();
+	void writeFrame(uint16_t source, const Frame& frame, const Encoded* encoded);
+	void writeTelemetry();
+	void writeIndex();
+	size_t drainTelemetry(bool flush);
+	size_t drain();
+	void ioLoop();
+	void encode(Encoded& slot);
+	size_t encodeFrames(Encoded*& slot);
+	void codecLoop();
+
+public:
+	explicit Recorder(const RecorderConfig& config_);
+	~Recorder();
+	Recorder(const Recorder&) = delete;
+	Recorder& operator=(const Recorder&) = delete;
+
+	// Add every source before start(). Returns the id used with submit().
+	// compress applies to Mono8/16 and BayerRG8/16 frames; others stay raw.
+	size_t addSource(const string& name, bool compress = false);
+
+	bool start();
+	// Writes everything still queued, then closes the file.
+	void stop();
+	bool isRunning() const;
+
+	// One producer thread per source. Returns false when the frame was
+	// dropped, always so once a write has failed.
+	bool submit(size_t source, const Frame& frame);
+	// One producer thread each for stage and camera samples. Return false
+	// when the sample was dropped.
+	bool submitStage(const StageSample& sample);
+	bool submitCamera(const CameraSample& sample);
+
+	RecorderStats getStats() const;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Bounded single-producer/single-consumer ring. Capacity is rounded up to a
+// power of two; head and tail live on separate cache lines so the producer
+// and consumer threads never share a line on the fast path.
+template <typename T>
+class RingBuffer {
+
+private:
+	vector<T> slots;
+	size_t mask;
+	alignas(64) atomic<size_t> head;
+	alignas(64) atomic<size_t> tail;
+
+	static size_t roundUpPow2(size_t n) {
+		size_t p = 1;
+		while (p < n) {
+			p <<= 1;
+		}
+		return p;
+	}
+
+public:
+	explicit RingBuffer(size_t capacity) :
+		slots(roundUpPow2(capacity < 2 ? 2 : capacity)),
+		mask{ slots.size() - 1 },
+		head{ 0 },
+		tail{ 0 }
+	{}
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	// Producer side. Leaves item untouched and returns false when full.
+	bool tryPush(T&& item) {
+		const size_t h = head.load(memory_order_relaxed);
+		if (h - tail.load(memory_order_acquire) == slots.size()) {
+			return false;
+		}
+		slots[h & mask] = move(item);
+		head.store(h + 1, memory_order_release);
+		return true;
+	}
+
+	// Consumer side.
+	bool tryPop(T& item) {
+		const size_t t = tail.load(memory_order_relaxed);
+		if (t == head.load(memory_order_acquire)) {
+			return false;
+		}
+		item = move(slots[t & mask]);
+		slots[t & mask] = T();
+		tail.store(t + 1, memory_order_release);
+		return true;
+	}
+
+	size_t size() const {
+		const size_t t = tail.load(memory_order_acquire);
+		return head.load(memory_order_acquire) - t;
+	}
+
+	size_t capacity() const {
+		return slots.size();
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+
+// On-disk layout of a recorded session:
+//
+//   SessionHeader, padded to SESSION_BLOCK_SIZE
+//   records, each a RecordHeader plus payload padded to RECORD_ALIGNMENT
+//   an Index record: one IndexEntry per frame record
+//   a Padding record, then a SessionFooter ending on a block boundary
+//
+// The file is written in fixed-size chunks that are multiples of
+// SESSION_BLOCK_SIZE; records run across chunk boundaries. All integers
+// are little-endian. A file without a footer (the recorder did not stop
+// cleanly) can still be read by walking the records from the header.
+
+constexpr char SESSION_MAGIC[8] = { 'M', 'E', 'D', 'U', 'S', 'A', 'S', '1' };
+constexpr uint32_t SESSION_VERSION = 1;
+// Alignment of the header, chunk writes and the file size; satisfies
+// O_DIRECT / FILE_FLAG_NO_BUFFERING on 4Kn drives.
+constexpr size_t SESSION_BLOCK_SIZE = 4096;
+constexpr size_t SESSION_MAX_SOURCES = 32;
+constexpr size_t SESSION_SOURCE_NAME_SIZE = 56;
+
+constexpr uint32_t RECORD_MAGIC = 0x4345524D;
+constexpr size_t RECORD_ALIGNMENT = 64;
+
+enum class RecordType : uint16_t {
+	Padding = 0,
+	Frame = 1,
+	Index = 2,
+	Footer = 3,
+	// Serialized medusa::TelemetryBatch.
+	Telemetry = 4
+};
+
+// RecordHeader::source and IndexEntry::source of Telemetry records.
+constexpr uint16_t TELEMETRY_SOURCE = 0xFFFF;
+
+// RecordHeader::encoding of a Frame record.
+enum class RecordEncoding : uint16_t {
+	Raw = 0,
+	// LosslessCodec stream; width, height and format are repeated inside it.
+	Lossless = 1
+};
+
+struct SessionHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t chunkBytes;
+	uint32_t sourceCount;
+	uint64_t createdHostNanos;
+	char sourceNames[SESSION_MAX_SOURCES][SESSION_SOURCE_NAME_SIZE];
+};
+
+struct RecordHeader {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t source;
+	// Bytes of payload after the header, before padding.
+	uint64_t payloadSize;
+	uint64_t frameId;
+	uint64_t timestamp;
+	uint64_t hostTimestamp;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint16_t pixelFormat;
+	uint16_t encoding;
+	uint32_t offsetX;
+	uint32_t offsetY;
+};
+
+struct IndexEntry {
+	// File offset of the frame's RecordHeader.
+	uint64_t offset;
+	uint64_t frameId;
+	uint64_t timestamp;
+	uint64_t hostTimestamp;
+	uint32_t payloadSize;
+	uint16_t source;
+	uint16_t reserved;
+};
+
+constexpr char SESSION_FOOTER_MAGIC[8] = { 'M', 'E', 'D', 'U', 'S', 'A', 'F', '1' };
+
+// Last 64 bytes of a cleanly closed file. Starts like a RecordHeader with
+// no payload so a sequential walk steps over it.
+struct SessionFooter {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t reserved;
+	uint64_t payloadSize;
+	// File offset of the Index record's header.
+	uint64_t indexOffset;
+	uint64_t indexCount;
+	char footerMagic[8];
+	uint8_t padding[24];
+};
+
+static_assert(sizeof(SessionHeader) <= SESSION_BLOCK_SIZE, "session header must fit one block");
+static_assert(sizeof(RecordHeader) == RECORD_ALIGNMENT, "record header must be one alignment unit");
+static_assert(sizeof(SessionFooter) == RECORD_ALIGNMENT, "footer must be one alignment unit");
+static_assert(sizeof(IndexEntry) == 40, "index entries are packed");
+
+inline size_t alignRecord(size_t size) {
+	return (size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+}
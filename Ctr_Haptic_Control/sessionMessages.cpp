@@ -0,0 +1,51 @@
+#include "sessionMessages.h"
+
+
+medusa::PixelFormat toProtoPixelFormat(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::Mono8:
+		return medusa::PIXEL_FORMAT_MONO8;
+	case PixelFormat::Mono16:
+		return medusa::PIXEL_FORMAT_MONO16;
+	case PixelFormat::BayerRG8:
+		return medusa::PIXEL_FORMAT_BAYER_RG8;
+	case PixelFormat::BayerRG16:
+		return medusa::PIXEL_FORMAT_BAYER_RG16;
+	case PixelFormat::BGR8:
+		return medusa::PIXEL_FORMAT_BGR8;
+	default:
+		return medusa::PIXEL_FORMAT_UNKNOWN;
+	}
+}
+
+medusa::FrameMetadata* makeFrameMetadata(google::protobuf::Arena* arena, uint32_t source, const string& camera,
+	const FrameInfo& info, uint16_t encoding) {
+	medusa::FrameMetadata* metadata = google::protobuf::Arena::CreateMessage<medusa::FrameMetadata>(arena);
+	metadata->set_source(source);
+	metadata->set_camera(camera);
+	metadata->set_frame_id(info.frameId);
+	metadata->set_timestamp(info.timestamp);
+	metadata->set_host_timestamp(info.hostTimestamp);
+	metadata->set_width(static_cast<uint32_t>(info.width));
+	metadata->set_height(static_cast<uint32_t>(info.height));
+	metadata->set_stride(static_cast<uint32_t>(info.stride));
+	metadata->set_offset_x(static_cast<uint32_t>(info.offsetX));
+	metadata->set_offset_y(static_cast<uint32_t>(info.offsetY));
+	metadata->set_pixel_format(toProtoPixelFormat(info.pixelFormat));
+	metadata->set_encoding(encoding);
+	return metadata;
+}
+
+medusa::ControlCommand* makeControlCommand(google::protobuf::Arena* arena, uint64_t sequence, uint64_t hostTimestamp,
+	medusa::ControlCommand::Type type, double x, double y, double z, double speed, uint64_t frameId) {
+	medusa::ControlCommand* command = google::protobuf::Arena::CreateMessage<medusa::ControlCommand>(arena);
+	command->set_sequence(sequence);
+	command->set_host_timestamp(hostTimestamp);
+	command->set_type(type);
+	command->set_x(x);
+	command->set_y(y);
+	command->set_z(z);
+	command->set_speed(speed);
+	command->set_frame_id(frameId);
+	return command;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "frame.h"
+#include "session.pb.h"
+
+using namespace std;
+
+
+medusa::PixelFormat toProtoPixelFormat(PixelFormat format);
+
+// Builds the metadata message for a recorded frame. With an arena the
+// message, its camera string and any nested stage sample all live on the
+// arena; pass nullptr for a heap message the caller deletes.
+medusa::FrameMetadata* makeFrameMetadata(google::protobuf::Arena* arena, uint32_t source, const string& camera,
+	const FrameInfo& info, uint16_t encoding = 0);
+
+// Builds the message for one stage command; arena as for makeFrameMetadata.
+// frameId is the frame a closed-loop command was computed from, 0 in open
+// loop.
+medusa::ControlCommand* makeControlCommand(google::protobuf::Arena* arena, uint64_t sequence, uint64_t hostTimestamp,
+	medusa::ControlCommand::Type type, double x, double y, double z, double speed = 0.0, uint64_t frameId = 0);
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sessionReader.h"
+
+static constexpr intptr_t INVALID_FILE = -1;
+
+
+SessionReader::SessionReader() :
+	file{ INVALID_FILE },
+	mapping{ 0 },
+	base{ nullptr },
+	fileSize{ 0 },
+	recovered{ false }
+{}
+
+SessionReader::~SessionReader() {
+	close();
+}
+
+bool SessionReader::mapFile(const string& path) {
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	file = reinterpret_cast<intptr_t>(handle);
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+		return false;
+	}
+	fileSize = static_cast<size_t>(size.QuadPart);
+	HANDLE map = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!map) {
+		return false;
+	}
+	mapping = reinterpret_cast<intptr_t>(map);
+	base = static_cast<const uint8_t*>(MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0));
+#else
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	file = fd;
+	struct stat status;
+	if (fstat(fd, &status) != 0 || status.st_size == 0) {
+		return false;
+	}
+	fileSize = static_cast<size_t>(status.st_size);
+	void* p = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		return false;
+	}
+	// Scrubbing jumps around; read-ahead would mostly fetch frames nobody asked for.
+	madvise(p, fileSize, MADV_RANDOM);
+	base = static_cast<const uint8_t*>(p);
+#endif
+	return base != nullptr;
+}
+
+void SessionReader::unmapFile() {
+#ifdef _WIN32
+	if (base) {
+		UnmapViewOfFile(base);
+	}
+	if (mapping) {
+		CloseHandle(reinterpret_cast<HANDLE>(mapping));
+	}
+	if (file != INVALID_FILE) {
+		CloseHandle(reinterpret_cast<HANDLE>(file));
+	}
+#else
+	if (base) {
+		munmap(const_cast<uint8_t*>(base), fileSize);
+	}
+	if (file != INVALID_FILE) {
+		::close(static_cast<int>(file));
+	}
+#endif
+	base = nullptr;
+	mapping = 0;
+	file = INVALID_FILE;
+	fileSize = 0;
+}
+
+bool SessionReader::open(const string& path) {
+	close();
+	if (!mapFile(path) || fileSize < SESSION_BLOCK_SIZE) {
+		cout << "Error: unable to map session " << path << "." << endl;
+		unmapFile();
+		return false;
+	}
+	SessionHeader header;
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, SESSION_MAGIC, sizeof(header.magic)) != 0 || header.version != SESSION_VERSION
+		|| header.headerSize < sizeof(SessionHeader) || header.sourceCount > SESSION_MAX_SOURCES) {
+		cout << "Error: " << path << " is not a session file." << endl;
+		unmapFile();
+		return false;
+	}
+	for (uint32_t i = 0; i < header.sourceCount; i++) {
+		sourceNames.push_back(string(header.sourceNames[i], strnlen(header.sourceNames[i], SESSION_SOURCE_NAME_SIZE)));
+	}
+
+	vector<IndexEntry> entries;
+	recovered = !loadFooterIndex(entries);
+	if (recovered) {
+		scanIndex(entries);
+	}
+
+	byFrameId.assign(sourceNames.size(), vector<IndexEntry>());
+	for (const IndexEntry& entry : entries) {
+		if (entry.source < sourceNames.size()) {
+			byFrameId[entry.source].push_back(entry);
+		}
+		else if (entry.source == TELEMETRY_SOURCE) {
+			telemetry.push_back(entry);
+		}
+	}
+	byTimestamp = byFrameId;
+	for (size_t i = 0; i < sourceNames.size(); i++) {
+		stable_sort(byFrameId[i].begin(), byFrameId[i].end(),
+			[](const IndexEntry& a, const IndexEntry& b) { return a.frameId < b.frameId; });
+		stable_sort(byTimestamp[i].begin(), byTimestamp[i].end(),
+			[](const IndexEntry& a, const IndexEntry& b) { return a.timestamp < b.timestamp; });
+	}
+	return true;
+}
+
+void SessionReader::close() {
+	unmapFile();
+	recovered = false;
+	sourceNames.clear();
+	byFrameId.clear();
+	byTimestamp.clear();
+	telemetry.clear();
+}
+
+bool SessionReader::loadFooterIndex(vector<IndexEntry>& entries) const {
+	if (fileSize < SESSION_BLOCK_SIZE + sizeof(SessionFooter)) {
+		return false;
+	}
+	SessionFooter footer;
+	memcpy(&footer, base + fileSize - sizeof(footer), sizeof(footer));
+	if (footer.magic != RECORD_MAGIC || footer.type != static_cast<uint16_t>(RecordType::Footer)
+		|| memcmp(footer.footerMagic, SESSION_FOOTER_MAGIC, sizeof(footer.footerMagic)) != 0
+		|| footer.indexOffset > fileSize - sizeof(RecordHeader)) {
+		return false;
+	}
+	// Bounded by the bytes after the offset before multiplying, so a
+	// corrupt count cannot wrap indexBytes.
+	if (footer.indexCount > (fileSize - footer.indexOffset) / sizeof(IndexEntry)) {
+		return false;
+	}
+	RecordHeader header;
+	memcpy(&header, base + footer.indexOffset, sizeof(header));
+	const uint64_t indexBytes = footer.indexCount * sizeof(IndexEntry);
+	if (header.magic != RECORD_MAGIC || header.type != static_cast<uint16_t>(RecordType::Index)
+		|| header.payloadSize != indexBytes || footer.indexOffset + sizeof(header) + indexBytes > fileSize) {
+		return false;
+	}
+	entries.resize(static_cast<size_t>(footer.indexCount));
+	memcpy(entries.data(), base + footer.indexOffset + sizeof(header), static_cast<size_t>(indexBytes));
+	return true;
+}
+
+// Walks record headers from the start. Stops at the first damaged or
+// truncated record, which is where an interrupted recording ends.
+void SessionReader::scanIndex(vector<IndexEntry>& entries) const {
+	uint64_t offset = SESSION_BLOCK_SIZE;
+	RecordHeader header;
+	while (offset + sizeof(header) <= fileSize) {
+		memcpy(&header, base + offset, sizeof(header));
+		const uint64_t next = offset + sizeof(header) + alignRecord(static_cast<size_t>(header.payloadSize));
+		if (header.magic != RECORD_MAGIC || next > fileSize) {
+			break;
+		}
+		if (header.type == static_cast<uint16_t>(RecordType::Frame)
+			|| header.type == static_cast<uint16_t>(RecordType::Telemetry)) {
+			IndexEntry entry{};
+			entry.offset = offset;
+			entry.frameId = header.frameId;
+			entry.timestamp = header.timestamp;
+			entry.hostTimestamp = header.hostTimestamp;
+			entry.payloadSize = static_cast<uint32_t>(header.payloadSize);
+			entry.source = header.source;
+			entries.push_back(entry);
+		}
+		offset = next;
+	}
+}
+
+bool SessionReader::readEntry(const IndexEntry& entry, RecordedFrame& frame) const {
+	if (entry.offset + sizeof(RecordHeader) + entry.payloadSize > fileSize) {
+		return false;
+	}
+	RecordHeader header;
+	memcpy(&header, base + entry.offset, sizeof(header));
+	if (header.magic != RECORD_MAGIC || header.type != static_cast<uint16_t>(RecordType::Frame)) {
+		return false;
+	}
+	frame.source = header.source;
+	frame.info.width = header.width;
+	frame.info.height = header.height;
+	frame.info.stride = header.stride;
+	frame.info.offsetX = header.offsetX;
+	frame.info.offsetY = header.offsetY;
+	frame.info.pixelFormat = static_cast<PixelFormat>(header.pixelFormat);
+	frame.info.timestamp = header.timestamp;
+	frame.info.frameId = header.frameId;
+	frame.info.hostTimestamp = header.hostTimestamp;
+	frame.encoding = header.encoding;
+	frame.data = base + entry.offset + sizeof(header);
+	frame.size = static_cast<size_t>(header.payloadSize);
+	return true;
+}
+
+bool SessionReader::isOpen() const {
+	return base != nullptr;
+}
+
+bool SessionReader::wasRecovered() const {
+	return recovered;
+}
+
+size_t SessionReader::getSourceCount() const {
+	return sourceNames.size();
+}
+
+string SessionReader::getSourceName(size_t source) const {
+	return source < sourceNames.size() ? sourceNames[source] : string();
+}
+
+size_t SessionReader::getFrameCount(size_t source) const {
+	return source < byFrameId.size() ? byFrameId[source].size() : 0;
+}
+
+bool SessionReader::frameAt(size_t source, size_t index, RecordedFrame& frame) const {
+	if (source >= byFrameId.size() || index >= byFrameId[source].size()) {
+		return false;
+	}
+	return readEntry(byFrameId[source][index], frame);
+}
+
+bool SessionReader::findByFrameId(size_t source, uint64_t frameId, RecordedFrame& frame) const {
+	if (source >= byFrameId.size()) {
+		return false;
+	}
+	const vector<IndexEntry>& entries = byFrameId[source];
+	auto it = lower_bound(entries.begin(), entries.end(), frameId,
+		[](const IndexEntry& entry, uint64_t id) { return entry.frameId < id; });
+	if (it == entries.end() || it->frameId != frameId) {
+		return false;
+	}
+	return readEntry(*it, frame);
+}
+
+bool SessionReader::findByTimestamp(size_t source, uint64_t timestamp, RecordedFrame& frame) const {
+	if (source >= byTimestamp.size() || byTimestamp[source].empty()) {
+		return false;
+	}
+	const vector<IndexEntry>& entries = byTimestamp[source];
+	auto it = lower_bound(entries.begin(), entries.end(), timestamp,
+		[](const IndexEntry& entry, uint64_t t) { return entry.timestamp < t; });
+	if (it == entries.end()) {
+		--it;
+	}
+	else if (it != entries.begin() && timestamp - prev(it)->timestamp < it->timestamp - timestamp) {
+		--it;
+	}
+	return readEntry(*it, frame);
+}
+
+size_t SessionReader::getTelemetryRecordCount() const {
+	return telemetry.size();
+}
+
+bool SessionReader::readTelemetryRecord(size_t record, vector<StageSample>& stage, vector<CameraSample>& camera) const {
+	if (record >= telemetry.size()) {
+		return false;
+	}
+	const IndexEntry& entry = telemetry[record];
+	RecordHeader header;
+	if (entry.offset + sizeof(header) + entry.payloadSize > fileSize) {
+		return false;
+	}
+	memcpy(&header, base + entry.offset, sizeof(header));
+	if (header.magic != RECORD_MAGIC || header.type != static_cast<uint16_t>(RecordType::Telemetry)) {
+		return false;
+	}
+	return TelemetryBatcher::parse(base + entry.offset + sizeof(header), entry.payloadSize, stage, camera);
+}
+
+bool SessionReader::readTelemetry(vector<StageSample>& stage, vector<CameraSample>& camera) const {
+	for (size_t i = 0; i < telemetry.size(); i++) {
+		if (!readTelemetryRecord(i, stage, camera)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SessionReader::readPixels(const RecordedFrame& frame, uint8_t* dst, size_t dstStride) const {
+	if (frame.encoding == static_cast<uint16_t>(RecordEncoding::Lossless)) {
+		return codec.decode(frame.data, frame.size, dst, dstStride);
+	}
+	if (frame.encoding != static_cast<uint16_t>(RecordEncoding::Raw)) {
+		return false;
+	}
+	const size_t rowBytes = frame.info.width * bytesPerPixel(frame.info.pixelFormat);
+	if (rowBytes > dstStride || frame.info.stride < rowBytes
+		|| (frame.info.height > 0 && frame.info.stride > frame.size / frame.info.height)) {
+		return false;
+	}
+	for (size_t y = 0; y < frame.info.height; y++) {
+		memcpy(dst + y * dstStride, frame.data + y * frame.info.stride, rowBytes);
+	}
+	return true;
+}
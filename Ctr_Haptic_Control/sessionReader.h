@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame.h"
+#include "losslessCodec.h"
+#include "sessionFormat.h"
+#include "telemetry.h"
+
+using namespace std;
+
+
+// A frame inside a mapped session. data points into the mapping and stays
+// valid while the reader is open.
+struct RecordedFrame {
+	size_t source = 0;
+	FrameInfo info;
+	uint16_t encoding = 0;
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+// Random access to a session written by Recorder. The file is memory-mapped
+// and only the pages of frames actually read are faulted in. Lookups by
+// frame ID or camera timestamp are binary searches over the footer index;
+// a file without a footer is indexed by walking its record headers once.
+class SessionReader {
+
+private:
+	intptr_t file;
+	intptr_t mapping;
+	const uint8_t* base;
+	size_t fileSize;
+	bool recovered;
+
+	vector<string> sourceNames;
+	// Per source, ordered by frameId and by timestamp.
+	vector<vector<IndexEntry>> byFrameId;
+	vector<vector<IndexEntry>> byTimestamp;
+	// Telemetry records in file order.
+	vector<IndexEntry> telemetry;
+	mutable LosslessCodec codec;
+
+	bool mapFile(const string& path);
+	void unmapFile();
+	bool loadFooterIndex(vector<IndexEntry>& entries) const;
+	void scanIndex(vector<IndexEntry>& entries) const;
+	bool readEntry(const IndexEntry& entry, RecordedFrame& frame) const;
+
+public:
+	SessionReader();
+	~SessionReader();
+	SessionReader(const SessionReader&) = delete;
+	SessionReader& operator=(const SessionReader&) = delete;
+
+	bool open(const string& path);
+	void close();
+	bool isOpen() const;
+	// True when the footer was missing and the index was rebuilt by a scan.
+	bool wasRecovered() const;
+
+	size_t getSourceCount() const;
+	string getSourceName(size_t source) const;
+	size_t getFrameCount(size_t source) const;
+
+	// index-th frame of a source in frame ID order.
+	bool frameAt(size_t source, size_t index, RecordedFrame& frame) const;
+	bool findByFrameId(size_t source, uint64_t frameId, RecordedFrame& frame) const;
+	// Frame whose camera timestamp is closest to timestamp.
+	bool findByTimestamp(size_t source, uint64_t timestamp, RecordedFrame& frame) const;
+
+	size_t getTelemetryRecordCount() const;
+	// Appends the samples of one Telemetry record; records are in file order.
+	bool readTelemetryRecord(size_t record, vector<StageSample>& stage, vector<CameraSample>& camera) const;
+	// Appends every recorded stage and camera sample, in recording order.
+	bool readTelemetry(vector<StageSample>& stage, vector<CameraSample>& camera) const;
+
+	// Pixels of frame as height rows of dstStride bytes, decoding compressed
+	// records. Not thread-safe for compressed frames.
+	bool readPixels(const RecordedFrame& frame, uint8_t* dst, size_t dstStride) const;
+};
@@ -0,0 +1,393 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#include "sessionReplay.h"
+#include "utilities.h"
+
+
+ReplayCamera::ReplayCamera(SessionReplay& replay_, size_t source_, const string& name_, const ReplayConfig& config,
+	size_t decodedBytes) :
+	replay{ replay_ },
+	source{ source_ },
+	cameraName{ name_ },
+	pool{ config.bufferCount, nullptr },
+	frames{ config.ringCapacity },
+	streaming{ false },
+	framesGrabbed{ 0 },
+	framesDropped{ 0 }
+{
+	if (decodedBytes > 0) {
+		for (size_t i = 0; i < config.bufferCount; i++) {
+			decodeBuffers.emplace_back(new uint8_t[decodedBytes]);
+			pool.bindBuffer(i, decodeBuffers.back().get());
+		}
+	}
+}
+
+bool ReplayCamera::publish(const RecordedFrame& recorded, uint64_t hostTimestamp, bool wait) {
+	FrameInfo info = recorded.info;
+	info.hostTimestamp = hostTimestamp;
+	const bool compressed = recorded.encoding != static_cast<uint16_t>(RecordEncoding::Raw);
+	if (compressed) {
+		info.stride = info.width * bytesPerPixel(info.pixelFormat);
+	}
+
+	Frame frame;
+	for (;;) {
+		frame = compressed && !decodeBuffers.empty() ? pool.acquire(info.stride * info.height, info)
+			: pool.acquire(recorded.data, recorded.size, info);
+		if (frame || !wait || !replay.running || !streaming) {
+			break;
+		}
+		this_thread::yield();
+	}
+	if (!frame) {
+		framesDropped++;
+		return false;
+	}
+	if (compressed && (decodeBuffers.empty()
+		|| !replay.reader.readPixels(recorded, decodeBuffers[frame.slotIndex()].get(), info.stride))) {
+		cout << "Error: unable to decode frame " << info.frameId << " of " << cameraName << "." << endl;
+		framesDropped++;
+		return false;
+	}
+
+	for (;;) {
+		if (frames.tryPush(move(frame))) {
+			framesGrabbed++;
+			return true;
+		}
+		if (!wait || !replay.running || !streaming) {
+			framesDropped++;
+			return false;
+		}
+		this_thread::yield();
+	}
+}
+
+string ReplayCamera::name() const {
+	return cameraName;
+}
+
+void ReplayCamera::startStreaming() {
+	streaming = true;
+}
+
+void ReplayCamera::stopStreaming() {
+	streaming = false;
+	Frame frame;
+	while (frames.tryPop(frame)) {
+		frame.reset();
+	}
+}
+
+bool ReplayCamera::isStreaming() const {
+	return streaming && (replay.isRunning() || !frames.empty());
+}
+
+bool ReplayCamera::tryPopFrame(Frame& frame) {
+	if (!frames.tryPop(frame)) {
+		return false;
+	}
+	// A max-speed replay runs ahead of the stamped times; there is no
+	// delivery latency to speak of then.
+	const uint64_t now = hostNanos();
+	if (now >= frame.info().hostTimestamp) {
+		deliveryLatency.record(now - frame.info().hostTimestamp);
+	}
+	return true;
+}
+
+CameraStats ReplayCamera::getStats() const {
+	CameraStats stats;
+	stats.framesGrabbed = framesGrabbed;
+	stats.framesDropped = framesDropped;
+	stats.deliveryLatency = deliveryLatency.summary();
+	return stats;
+}
+
+
+ReplayStage::ReplayStage(SessionReplay& replay_, size_t capacity) :
+	replay{ replay_ },
+	samples{ capacity },
+	sampling{ false }
+{}
+
+bool ReplayStage::publish(const StageSample& sample, bool wait) {
+	for (;;) {
+		StageSample copy = sample;
+		if (samples.tryPush(move(copy))) {
+			return true;
+		}
+		if (!wait || !replay.running || !sampling) {
+			return false;
+		}
+		this_thread::yield();
+	}
+}
+
+string ReplayStage::name() const {
+	return "replay-stage";
+}
+
+void ReplayStage::startSampling() {
+	sampling = true;
+}
+
+void ReplayStage::stopSampling() {
+	sampling = false;
+	StageSample sample;
+	while (samples.tryPop(sample)) {
+	}
+}
+
+bool ReplayStage::isSampling() const {
+	return sampling && (replay.isRunning() || !samples.empty());
+}
+
+bool ReplayStage::tryPopSample(StageSample& sample) {
+	return samples.tryPop(sample);
+}
+
+
+SessionReplay::SessionReplay(const ReplayConfig& config_) :
+	config{ config_ },
+	running{ false },
+	finished{ false },
+	framesReplayed{ 0 },
+	stageReplayed{ 0 },
+	framesDropped{ 0 },
+	stageDropped{ 0 },
+	framesSkipped{ 0 },
+	stageSkipped{ 0 },
+	sessionNanos{ 0 },
+	startNanos{ 0 },
+	endNanos{ 0 }
+{}
+
+SessionReplay::~SessionReplay() {
+	stop();
+}
+
+bool SessionReplay::open(const string& path) {
+	stop();
+	cameras.clear();
+	stage.reset();
+	if (!reader.open(path)) {
+		return false;
+	}
+	for (size_t source = 0; source < reader.getSourceCount(); source++) {
+		// Compressed frames need somewhere to decode to; size it for the
+		// largest one.
+		size_t decodedBytes = 0;
+		RecordedFrame recorded;
+		for (size_t i = 0; i < reader.getFrameCount(source); i++) {
+			if (reader.frameAt(source, i, recorded) && recorded.encoding != static_cast<uint16_t>(RecordEncoding::Raw)) {
+				const size_t bytes = recorded.info.width * bytesPerPixel(recorded.info.pixelFormat) * recorded.info.height;
+				decodedBytes = bytes > decodedBytes ? bytes : decodedBytes;
+			}
+		}
+		cameras.push_back(make_unique<ReplayCamera>(*this, source, reader.getSourceName(source), config, decodedBytes));
+	}
+	stage = make_unique<ReplayStage>(*this, config.stageCapacity);
+	finished = false;
+	return true;
+}
+
+size_t SessionReplay::getCameraCount() const {
+	return cameras.size();
+}
+
+ReplayCamera& SessionReplay::getCamera(size_t index) {
+	return *cameras[index];
+}
+
+ReplayStage& SessionReplay::getStage() {
+	return *stage;
+}
+
+bool SessionReplay::waitUntil(uint64_t deadline) const {
+	static constexpr uint64_t SPIN_NANOS = 2000000;
+	for (;;) {
+		const uint64_t now = hostNanos();
+		if (!running) {
+			return false;
+		}
+		if (now >= deadline) {
+			return true;
+		}
+		// Sleep coarsely in short steps so stop() is not held up, then yield
+		// for the last stretch.
+		if (deadline - now > SPIN_NANOS) {
+			const uint64_t nap = deadline - now - SPIN_NANOS;
+			this_thread::sleep_for(chrono::nanoseconds(nap < 50000000 ? nap : 50000000));
+		}
+		else {
+			this_thread::yield();
+		}
+	}
+}
+
+void SessionReplay::replayLoop() {
+	const bool paced = config.speed > 0.0;
+	const size_t sourceCount = cameras.size();
+
+	// Next frame of each source, and the current batch of stage samples.
+	vector<RecordedFrame> heads(sourceCount);
+	vector<size_t> nextFrame(sourceCount, 0);
+	vector<bool> hasHead(sourceCount, false);
+	for (size_t source = 0; source < sourceCount; source++) {
+		hasHead[source] = reader.frameAt(source, 0, heads[source]);
+	}
+	vector<StageSample> stageSamples;
+	vector<CameraSample> cameraSamples;
+	size_t nextRecord = 0;
+	size_t nextSample = 0;
+	auto refillStage = [&]() {
+		while (nextSample == stageSamples.size() && nextRecord < reader.getTelemetryRecordCount()) {
+			stageSamples.clear();
+			cameraSamples.clear();
+			nextSample = 0;
+			reader.readTelemetryRecord(nextRecord++, stageSamples, cameraSamples);
+		}
+		return nextSample < stageSamples.size();
+	};
+
+	uint64_t sessionStart = UINT64_MAX;
+	for (size_t source = 0; source < sourceCount; source++) {
+		if (hasHead[source] && heads[source].info.hostTimestamp < sessionStart) {
+			sessionStart = heads[source].info.hostTimestamp;
+		}
+	}
+	if (refillStage() && stageSamples[nextSample].hostTimestamp < sessionStart) {
+		sessionStart = stageSamples[nextSample].hostTimestamp;
+	}
+
+	const uint64_t replayStart = startNanos;
+	while (running) {
+		// Earliest pending item; sourceCount stands for the stage.
+		size_t pick = SIZE_MAX;
+		uint64_t recorded = UINT64_MAX;
+		for (size_t source = 0; source < sourceCount; source++) {
+			if (hasHead[source] && heads[source].info.hostTimestamp < recorded) {
+				recorded = heads[source].info.hostTimestamp;
+				pick = source;
+			}
+		}
+		if (refillStage() && stageSamples[nextSample].hostTimestamp < recorded) {
+			recorded = stageSamples[nextSample].hostTimestamp;
+			pick = sourceCount;
+		}
+		if (pick == SIZE_MAX) {
+			break;
+		}
+
+		const uint64_t offset = recorded > sessionStart ? recorded - sessionStart : 0;
+		uint64_t release = replayStart + offset;
+		if (paced) {
+			release = replayStart + static_cast<uint64_t>(offset / config.speed);
+			if (!waitUntil(release)) {
+				break;
+			}
+		}
+		sessionNanos = offset;
+
+		if (pick == sourceCount) {
+			StageSample sample = stageSamples[nextSample++];
+			sample.hostTimestamp = release;
+			if (stage->sampling) {
+				if (stage->publish(sample, !paced)) {
+					stageReplayed++;
+				}
+				else {
+					stageDropped++;
+				}
+			}
+			else {
+				stageSkipped++;
+			}
+		}
+		else {
+			ReplayCamera& camera = *cameras[pick];
+			if (camera.streaming) {
+				if (camera.publish(heads[pick], release, !paced)) {
+					framesReplayed++;
+				}
+				else {
+					framesDropped++;
+				}
+			}
+			else {
+				framesSkipped++;
+			}
+			hasHead[pick] = reader.frameAt(pick, ++nextFrame[pick], heads[pick]);
+		}
+	}
+	endNanos = hostNanos();
+	finished = true;
+	running = false;
+}
+
+void SessionReplay::start() {
+	lock_guard<mutex> guard(startLock);
+	if (running || !reader.isOpen()) {
+		return;
+	}
+	// A replay that ran to the end left its thread to be joined.
+	if (replayThread.joinable()) {
+		replayThread.join();
+	}
+	framesReplayed = 0;
+	stageReplayed = 0;
+	framesDropped = 0;
+	stageDropped = 0;
+	framesSkipped = 0;
+	stageSkipped = 0;
+	sessionNanos = 0;
+	endNanos = 0;
+	finished = false;
+	startNanos = hostNanos();
+	running = true;
+	replayThread = thread(&SessionReplay::replayLoop, this);
+}
+
+void SessionReplay::stop() {
+	lock_guard<mutex> guard(startLock);
+	running = false;
+	if (replayThread.joinable()) {
+		replayThread.join();
+	}
+	if (endNanos == 0) {
+		endNanos = hostNanos();
+	}
+}
+
+bool SessionReplay::isRunning() const {
+	return running;
+}
+
+bool SessionReplay::isFinished() const {
+	return finished;
+}
+
+ReplayStats SessionReplay::getStats() const {
+	ReplayStats stats;
+	stats.framesReplayed = framesReplayed;
+	stats.stageSamplesReplayed = stageReplayed;
+	stats.framesDropped = framesDropped;
+	stats.stageSamplesDropped = stageDropped;
+	stats.framesSkipped = framesSkipped;
+	stats.stageSamplesSkipped = stageSkipped;
+	stats.finished = finished;
+	stats.sessionSeconds = sessionNanos / 1e9;
+	if (startNanos > 0) {
+		const uint64_t end = endNanos > 0 ? endNanos.load() : hostNanos();
+		stats.wallSeconds = (end - startNanos) / 1e9;
+	}
+	if (stats.wallSeconds > 0.0) {
+		stats.achievedSpeed = stats.sessionSeconds / stats.wallSeconds;
+		stats.framesPerSecond = stats.framesReplayed / stats.wallSeconds;
+	}
+	return stats;
+}
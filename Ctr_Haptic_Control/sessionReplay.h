@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "icamera.h"
+#include "istage.h"
+#include "latencyHistogram.h"
+#include "ringBuffer.h"
+#include "sessionReader.h"
+
+using namespace std;
+
+
+struct ReplayConfig {
+	// Playback rate relative to the recording. 0 or less replays as fast as
+	// the consumers take frames: nothing is dropped and the replay waits on
+	// full queues instead.
+	double speed = 1.0;
+	// Frames each camera may have handed out, and queued, at once.
+	size_t bufferCount = 16;
+	size_t ringCapacity = 16;
+	size_t stageCapacity = 1 << 14;
+};
+
+struct ReplayStats {
+	uint64_t framesReplayed = 0;
+	uint64_t stageSamplesReplayed = 0;
+	// Refused by a full queue or with every frame slot still held; paced
+	// replays only.
+	uint64_t framesDropped = 0;
+	uint64_t stageSamplesDropped = 0;
+	// Released while their camera was not streaming, or the stage not
+	// sampling.
+	uint64_t framesSkipped = 0;
+	uint64_t stageSamplesSkipped = 0;
+	// Recorded time covered so far, and the wall time it took.
+	double sessionSeconds = 0.0;
+	double wallSeconds = 0.0;
+	double achievedSpeed = 0.0;
+	double framesPerSecond = 0.0;
+	bool finished = false;
+};
+
+class SessionReplay;
+
+// One recorded camera played back as an ICamera. Raw frames are handed out
+// straight from the session mapping; compressed frames are decoded into
+// per-slot buffers. Streaming only opens its queue; SessionReplay::start()
+// starts the shared replay, and stopping only discards what it has queued.
+class ReplayCamera : public ICamera {
+
+private:
+	friend class SessionReplay;
+
+	SessionReplay& replay;
+	size_t source;
+	string cameraName;
+
+	vector<unique_ptr<uint8_t[]>> decodeBuffers;
+	FramePool pool;
+	RingBuffer<Frame> frames;
+
+	atomic<bool> streaming;
+	atomic<uint64_t> framesGrabbed;
+	atomic<uint64_t> framesDropped;
+	LatencyHistogram deliveryLatency;
+
+	// Replay thread. wait keeps retrying while the replay runs.
+	bool publish(const RecordedFrame& recorded, uint64_t hostTimestamp, bool wait);
+
+public:
+	ReplayCamera(SessionReplay& replay_, size_t source_, const string& name_, const ReplayConfig& config,
+		size_t decodedBytes);
+	ReplayCamera(const ReplayCamera&) = delete;
+	ReplayCamera& operator=(const ReplayCamera&) = delete;
+
+	string name() const override;
+
+	void startStreaming() override;
+	void stopStreaming() override;
+	bool isStreaming() const override;
+
+	bool tryPopFrame(Frame& frame) override;
+	CameraStats getStats() const override;
+};
+
+// Recorded stage samples played back as an IStageSource.
+class ReplayStage : public IStageSource {
+
+private:
+	friend class SessionReplay;
+
+	SessionReplay& replay;
+	RingBuffer<StageSample> samples;
+	atomic<bool> sampling;
+
+	bool publish(const StageSample& sample, bool wait);
+
+public:
+	ReplayStage(SessionReplay& replay_, size_t capacity);
+	ReplayStage(const ReplayStage&) = delete;
+	ReplayStage& operator=(const ReplayStage&) = delete;
+
+	string name() const override;
+
+	void startSampling() override;
+	void stopSampling() override;
+	bool isSampling() const override;
+
+	bool tryPopSample(StageSample& sample) override;
+};
+
+// Plays a recorded session back through the interfaces live acquisition
+// uses, so processing code runs unchanged on recorded data. One thread
+// merges every camera's frames and the stage samples in host-timestamp
+// order and releases each at its recorded time divided by the speed.
+//
+// Host timestamps are moved onto the replay clock: a paced replay stamps
+// each item with its release time, and a max-speed replay keeps the
+// recorded spacing from the start of the replay so frames and stage samples
+// still line up. Camera timestamps and frame IDs are kept as recorded.
+// Frames must not outlive the SessionReplay.
+class SessionReplay {
+
+private:
+	friend class ReplayCamera;
+	friend class ReplayStage;
+
+	ReplayConfig config;
+	SessionReader reader;
+	vector<unique_ptr<ReplayCamera>> cameras;
+	unique_ptr<ReplayStage> stage;
+
+	mutex startLock;
+	thread replayThread;
+	atomic<bool> running;
+	atomic<bool> finished;
+	atomic<uint64_t> framesReplayed;
+	atomic<uint64_t> stageReplayed;
+	atomic<uint64_t> framesDropped;
+	atomic<uint64_t> stageDropped;
+	atomic<uint64_t> framesSkipped;
+	atomic<uint64_t> stageSkipped;
+	atomic<uint64_t> sessionNanos;
+	atomic<uint64_t> startNanos;
+	atomic<uint64_t> endNanos;
+
+	// Sleeps until the given host time; false when stopped first.
+	bool waitUntil(uint64_t deadline) const;
+	void replayLoop();
+
+public:
+	explicit SessionReplay(const ReplayConfig& config_);
+	~SessionReplay();
+	SessionReplay(const SessionReplay&) = delete;
+	SessionReplay& operator=(const SessionReplay&) = delete;
+
+	bool open(const string& path);
+
+	size_t getCameraCount() const;
+	ReplayCamera& getCamera(size_t index);
+	ReplayStage& getStage();
+
+	// Start the cameras and stage that should receive items first: anything
+	// released to one that is not streaming is skipped. Does nothing while
+	// running; a finished replay starts over from the beginning.
+	void start();
+	void stop();
+	bool isRunning() const;
+	// Every recorded item has been released.
+	bool isFinished() const;
+
+	ReplayStats getStats() const;
+};
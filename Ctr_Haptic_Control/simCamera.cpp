@@ -0,0 +1,243 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "simCamera.h"
+#include "utilities.h"
+
+
+// Sleeps coarsely, then yields for the last stretch; OS sleep granularity
+// is too coarse for kHz frame periods.
+static void sleepUntil(chrono::steady_clock::time_point deadline) {
+	const auto coarse = deadline - chrono::milliseconds(2);
+	if (chrono::steady_clock::now() < coarse) {
+		this_thread::sleep_until(coarse);
+	}
+	while (chrono::steady_clock::now() < deadline) {
+		this_thread::yield();
+	}
+}
+
+
+SimCamera::SimCamera(const SimCameraConfig& config_) :
+	config{ config_ },
+	stride{ config.width * bytesPerPixel(config.pixelFormat) },
+	frameSize{ stride * config.height },
+	replayCount{ 0 },
+	pool{ config.bufferCount, this },
+	frames{ config.ringCapacity },
+	streaming{ false },
+	framesGrabbed{ 0 },
+	framesLost{ 0 },
+	framesDropped{ 0 },
+	rng{ config.seed },
+	clockOrigin{ hostNanos() },
+	spotSource{ nullptr },
+	spotX{ config.width / 2.0 },
+	spotY{ config.height / 2.0 }
+{
+	if (config.pattern == SimPattern::Replay && !loadReplay()) {
+		cout << "Replay file " << config.replayPath << " unusable, generating a gradient instead." << endl;
+		config.pattern = SimPattern::Gradient;
+	}
+	for (size_t i = 0; i < config.bufferCount; i++) {
+		buffers.emplace_back(new uint8_t[frameSize]);
+		pool.bindBuffer(i, buffers.back().get());
+	}
+}
+
+SimCamera::~SimCamera() {
+	stopStreaming();
+}
+
+uint64_t SimCamera::cameraClock(uint64_t host) const {
+	const double elapsed = static_cast<double>(host - clockOrigin);
+	return static_cast<uint64_t>(elapsed * (1.0 + config.clockDriftPpm * 1e-6));
+}
+
+bool SimCamera::loadReplay() {
+	ifstream file(config.replayPath, ios::binary | ios::ate);
+	if (!file || frameSize == 0) {
+		return false;
+	}
+	const size_t size = static_cast<size_t>(file.tellg());
+	if (size < frameSize) {
+		return false;
+	}
+	replayCount = size / frameSize;
+	replayFrames.resize(replayCount * frameSize);
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(replayFrames.data()), replayFrames.size());
+	return static_cast<bool>(file);
+}
+
+string SimCamera::name() const {
+	return config.name;
+}
+
+void SimCamera::startStreaming() {
+	if (streaming) {
+		return;
+	}
+	streaming = true;
+	generatorThread = thread(&SimCamera::generateLoop, this);
+}
+
+void SimCamera::stopStreaming() {
+	if (!streaming) {
+		return;
+	}
+	streaming = false;
+	if (generatorThread.joinable()) {
+		generatorThread.join();
+	}
+	Frame frame;
+	while (frames.tryPop(frame)) {
+		frame.reset();
+	}
+}
+
+bool SimCamera::isStreaming() const {
+	return streaming;
+}
+
+void SimCamera::render(uint8_t* buffer, uint64_t frameId) {
+	if (config.pattern == SimPattern::Replay) {
+		memcpy(buffer, &replayFrames[(frameId % replayCount) * frameSize], frameSize);
+		return;
+	}
+
+	const size_t shift = static_cast<size_t>(frameId * 4);
+	const double radiusSquared = config.spotRadius * config.spotRadius;
+	for (size_t y = 0; y < config.height; y++) {
+		uint8_t* row = buffer + y * stride;
+		const double dy = y - spotY;
+		for (size_t x = 0; x < config.width; x++) {
+			uint32_t value;
+			if (config.pattern == SimPattern::Spot) {
+				const double dx = x - spotX;
+				value = dx * dx + dy * dy <= radiusSquared ? 240 : 16;
+			}
+			else if (config.pattern == SimPattern::Checkerboard) {
+				value = (((x + shift) >> 5) + (y >> 5)) & 1 ? 220 : 30;
+			}
+			else {
+				value = static_cast<uint32_t>((x + y + shift) & 0xFF);
+			}
+			switch (config.pixelFormat) {
+			case PixelFormat::Mono16:
+			case PixelFormat::BayerRG16: {
+				const uint16_t wide = static_cast<uint16_t>(value << 8 | value);
+				memcpy(row + 2 * x, &wide, sizeof(wide));
+				break;
+			}
+			case PixelFormat::BGR8:
+				row[3 * x] = static_cast<uint8_t>(value);
+				row[3 * x + 1] = static_cast<uint8_t>(value + 85);
+				row[3 * x + 2] = static_cast<uint8_t>(value + 170);
+				break;
+			default:
+				row[x] = static_cast<uint8_t>(value);
+				break;
+			}
+		}
+	}
+}
+
+void SimCamera::generateLoop() {
+	const auto start = chrono::steady_clock::now();
+	const double periodNs = config.frameRate > 0.0 ? 1e9 / config.frameRate : 0.0;
+	normal_distribution<double> jitter(0.0, config.jitterUs * 1000.0);
+	bernoulli_distribution lost(config.dropProbability);
+
+	auto next = start;
+	uint64_t frameId = 0;
+	while (streaming) {
+		if (periodNs > 0.0) {
+			double period = periodNs + (config.jitterUs > 0.0 ? jitter(rng) : 0.0);
+			next += chrono::nanoseconds(static_cast<int64_t>(period > 0.0 ? period : 0.0));
+			sleepUntil(next);
+		}
+		else {
+			next = chrono::steady_clock::now();
+		}
+
+		const uint64_t id = frameId++;
+		if (config.dropProbability > 0.0 && lost(rng)) {
+			framesLost++;
+			continue;
+		}
+		const uint64_t exposed = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(next.time_since_epoch()).count());
+		SimSpotSource* source = spotSource;
+		if (config.pattern == SimPattern::Spot && source) {
+			source->spotPosition(exposed, spotX, spotY);
+		}
+
+		FrameInfo info;
+		info.width = config.width;
+		info.height = config.height;
+		info.stride = stride;
+		info.pixelFormat = config.pixelFormat;
+		info.timestamp = cameraClock(exposed);
+		info.frameId = id;
+		Frame frame = pool.acquire(frameSize, info);
+		if (!frame) {
+			framesDropped++;
+			continue;
+		}
+		render(buffers[frame.slotIndex()].get(), id);
+		frame.mutableInfo().hostTimestamp = hostNanos();
+		if (!frames.tryPush(move(frame))) {
+			framesDropped++;
+		}
+		else {
+			framesGrabbed++;
+		}
+	}
+}
+
+void SimCamera::releaseFrame(size_t slot) {
+	(void)slot;
+}
+
+bool SimCamera::tryPopFrame(Frame& frame) {
+	if (!frames.tryPop(frame)) {
+		return false;
+	}
+	deliveryLatency.record(hostNanos() - frame.info().hostTimestamp);
+	return true;
+}
+
+CameraStats SimCamera::getStats() const {
+	CameraStats stats;
+	stats.framesGrabbed = framesGrabbed;
+	// A frame lost in transport is what an incomplete frame is on real hardware.
+	stats.framesIncomplete = framesLost;
+	stats.framesDropped = framesDropped;
+	stats.deliveryLatency = deliveryLatency.summary();
+	return stats;
+}
+
+// The camera latches halfway through the round trip.
+bool SimCamera::latchTimestamp(ClockLatch& latch) {
+	latch.hostBefore = hostNanos();
+	const uint64_t half = static_cast<uint64_t>(config.latchLatencyUs * 500.0);
+	while (hostNanos() < latch.hostBefore + half) {
+		this_thread::yield();
+	}
+	latch.timestamp = cameraClock(hostNanos());
+	while (hostNanos() < latch.hostBefore + 2 * half) {
+		this_thread::yield();
+	}
+	latch.hostAfter = hostNanos();
+	return true;
+}
+
+void SimCamera::setSpotSource(SimSpotSource* source) {
+	spotSource = source;
+}
+
+const SimCameraConfig& SimCamera::getConfig() const {
+	return config;
+}
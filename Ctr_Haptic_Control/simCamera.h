@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "icamera.h"
+#include "latencyHistogram.h"
+#include "ringBuffer.h"
+
+using namespace std;
+
+
+enum class SimPattern {
+	Gradient,
+	Checkerboard,
+	Replay,
+	// A bright disc on a dark field, placed by a SimSpotSource.
+	Spot
+};
+
+// Where the spot of SimPattern::Spot is, e.g. a tool carried by a simulated
+// stage. Called on the camera's thread once per frame.
+class SimSpotSource {
+
+public:
+	virtual ~SimSpotSource() = default;
+	// Pixel position of the spot centre in a frame exposed at hostTimestamp.
+	virtual bool spotPosition(uint64_t hostTimestamp, double& x, double& y) = 0;
+};
+
+struct SimCameraConfig {
+	string name = "sim";
+	size_t width = 2048;
+	size_t height = 1536;
+	PixelFormat pixelFormat = PixelFormat::BayerRG8;
+	double frameRate = 100.0;
+	// Standard deviation of the frame period, in microseconds.
+	double jitterUs = 0.0;
+	// Probability that a frame is lost in transport and never delivered.
+	double dropProbability = 0.0;
+	SimPattern pattern = SimPattern::Gradient;
+	// Raw frames of exactly width x height x bytesPerPixel, played in a loop.
+	string replayPath;
+	// SimPattern::Spot; without a source the spot sits in the centre.
+	double spotRadius = 12.0;
+	size_t bufferCount = 32;
+	size_t ringCapacity = 16;
+	// Camera clock error: how many ppm fast it runs against the host, and
+	// the round trip of a timestamp latch.
+	double clockDriftPpm = 0.0;
+	double latchLatencyUs = 0.0;
+	uint64_t seed = 1;
+};
+
+// Software camera for exercising and benchmarking the pipeline without FLIR
+// hardware or the Spinnaker SDK. Frames are timestamped at the start of
+// exposure, in nanoseconds on a camera clock that starts at construction
+// and runs clockDriftPpm fast; latchTimestamp() reads that clock.
+class SimCamera : public ICamera, public ICameraClock, private FrameReleaser {
+
+private:
+	SimCameraConfig config;
+	size_t stride;
+	size_t frameSize;
+
+	vector<unique_ptr<uint8_t[]>> buffers;
+	vector<uint8_t> replayFrames;
+	size_t replayCount;
+	FramePool pool;
+	RingBuffer<Frame> frames;
+
+	thread generatorThread;
+	atomic<bool> streaming;
+	atomic<uint64_t> framesGrabbed;
+	atomic<uint64_t> framesLost;
+	atomic<uint64_t> framesDropped;
+	LatencyHistogram deliveryLatency;
+	mt19937_64 rng;
+	uint64_t clockOrigin;
+	atomic<SimSpotSource*> spotSource;
+	double spotX;
+	double spotY;
+
+	uint64_t cameraClock(uint64_t host) const;
+	bool loadReplay();
+	void render(uint8_t* buffer, uint64_t frameId);
+	void generateLoop();
+	void releaseFrame(size_t slot) override;
+
+public:
+	explicit SimCamera(const SimCameraConfig& config_);
+	~SimCamera();
+	SimCamera(const SimCamera&) = delete;
+	SimCamera& operator=(const SimCamera&) = delete;
+
+	string name() const override;
+
+	void startStreaming() override;
+	void stopStreaming() override;
+	bool isStreaming() const override;
+
+	bool tryPopFrame(Frame& frame) override;
+	CameraStats getStats() const override;
+
+	bool latchTimestamp(ClockLatch& latch) override;
+
+	// Optional; must outlive streaming.
+	void setSpotSource(SimSpotSource* source);
+
+	const SimCameraConfig& getConfig() const;
+};
@@ -0,0 +1,241 @@
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "simMotionController.h"
+#include "utilities.h"
+
+
+static void spinFor(double microseconds) {
+	if (microseconds <= 0.0) {
+		return;
+	}
+	const uint64_t end = hostNanos() + static_cast<uint64_t>(microseconds * 1e3);
+	while (hostNanos() < end) {
+		this_thread::yield();
+	}
+}
+
+SimMotionController::SimMotionController(const SimMotionConfig& config_) :
+	config{ config_ },
+	connected{ false },
+	enabled{ false },
+	faulted{ false },
+	origin{ 0 },
+	modelTime{ 0 },
+	rng{ config.seed },
+	noise{ 0.0, config.feedbackNoise > 0.0 ? config.feedbackNoise : 1.0 }
+{}
+
+// Fixed 100 us steps keep the profile and the servo lag stable at any
+// read rate.
+void SimMotionController::integrate(uint64_t until) {
+	static const uint64_t STEP_NANOS = 100000;
+	const double acceleration = config.maxAcceleration;
+	const double lag = config.servoLagMs / 1e3;
+	while (modelTime < until) {
+		const uint64_t step = until - modelTime < STEP_NANOS ? until - modelTime : STEP_NANOS;
+		const double dt = step / 1e9;
+		modelTime += step;
+		if (faulted) {
+			continue;
+		}
+		for (Axis& axis : axes) {
+			double desired = axis.speed;
+			if (!axis.velocityMode) {
+				// Slow down in time to stop on the target.
+				const double remaining = axis.target - axis.command;
+				const double braking = sqrt(2.0 * acceleration * fabs(remaining));
+				desired = copysign(axis.speed < braking ? axis.speed : braking, remaining);
+			}
+			const double maxChange = acceleration * dt;
+			const double change = desired - axis.velocity;
+			axis.velocity += change > maxChange ? maxChange : change < -maxChange ? -maxChange : change;
+
+			const double before = axis.command;
+			axis.command += axis.velocity * dt;
+			if (!axis.velocityMode && (before - axis.target) * (axis.command - axis.target) <= 0.0) {
+				axis.command = axis.target;
+				axis.velocity = 0.0;
+			}
+			axis.actual += (axis.command - axis.actual) * (lag > 0.0 ? dt / (lag + dt) : 1.0);
+
+			if (config.followingErrorLimit > 0.0 && fabs(axis.command - axis.actual) > config.followingErrorLimit) {
+				faulted = true;
+			}
+		}
+		if (faulted) {
+			// Hold every axis where it is, as a drive does on a fault.
+			for (Axis& axis : axes) {
+				axis.command = axis.actual;
+				axis.target = axis.actual;
+				axis.velocity = 0.0;
+				axis.speed = 0.0;
+				axis.velocityMode = false;
+			}
+			pending.clear();
+			error = "Following error limit exceeded.";
+		}
+	}
+}
+
+void SimMotionController::apply(const Command& command) {
+	const double limit = config.maxSpeed;
+	for (size_t i = 0; i < 3; i++) {
+		Axis& axis = axes[i];
+		switch (command.type) {
+		case CommandType::MoveAbsolute:
+		case CommandType::MoveIncremental: {
+			const double base = axis.velocityMode ? axis.command : axis.target;
+			axis.target = command.type == CommandType::MoveAbsolute ? command.values[i] : base + command.values[i];
+			const double speed = fabs(command.speed);
+			axis.speed = speed < limit ? speed : limit;
+			axis.velocityMode = false;
+			break;
+		}
+		case CommandType::Velocity: {
+			const double velocity = command.values[i];
+			axis.speed = velocity > limit ? limit : velocity < -limit ? -limit : velocity;
+			axis.velocityMode = true;
+			break;
+		}
+		case CommandType::Stop:
+			axis.speed = 0.0;
+			axis.velocityMode = true;
+			break;
+		}
+	}
+}
+
+void SimMotionController::advance(uint64_t now) {
+	while (!pending.empty() && pending.front().applyAt <= now) {
+		integrate(pending.front().applyAt);
+		apply(pending.front());
+		pending.pop_front();
+	}
+	integrate(now);
+}
+
+bool SimMotionController::submit(CommandType type, double a, double b, double c, double speed) {
+	lock_guard<mutex> guard(lock);
+	if (!connected || !enabled || faulted) {
+		error = !connected ? "Not connected." : faulted ? "Axes are faulted." : "Axes are not enabled.";
+		return false;
+	}
+	const uint64_t now = hostNanos();
+	advance(now);
+	Command command{ now + static_cast<uint64_t>(config.commandLatencyUs * 1e3), type, { a, b, c }, speed };
+	pending.push_back(command);
+	advance(now);
+	return true;
+}
+
+string SimMotionController::name() const {
+	return "sim-stage";
+}
+
+bool SimMotionController::connect() {
+	lock_guard<mutex> guard(lock);
+	if (!connected) {
+		origin = hostNanos();
+		modelTime = origin;
+		connected = true;
+	}
+	return true;
+}
+
+void SimMotionController::disconnect() {
+	lock_guard<mutex> guard(lock);
+	connected = false;
+	enabled = false;
+	pending.clear();
+}
+
+bool SimMotionController::isConnected() const {
+	lock_guard<mutex> guard(lock);
+	return connected;
+}
+
+bool SimMotionController::enable() {
+	lock_guard<mutex> guard(lock);
+	if (!connected) {
+		error = "Not connected.";
+		return false;
+	}
+	advance(hostNanos());
+	enabled = true;
+	faulted = false;
+	return true;
+}
+
+bool SimMotionController::moveAbsolute(double x, double y, double z, double speed) {
+	return submit(CommandType::MoveAbsolute, x, y, z, speed);
+}
+
+bool SimMotionController::moveIncremental(double dx, double dy, double dz, double speed) {
+	return submit(CommandType::MoveIncremental, dx, dy, dz, speed);
+}
+
+bool SimMotionController::setVelocity(double vx, double vy, double vz) {
+	return submit(CommandType::Velocity, vx, vy, vz, 0.0);
+}
+
+bool SimMotionController::stop() {
+	return submit(CommandType::Stop, 0.0, 0.0, 0.0, 0.0);
+}
+
+bool SimMotionController::readFeedback(StageSample& sample) {
+	// The controller reads the axes halfway through the round trip.
+	spinFor(config.feedbackLatencyUs / 2);
+	{
+		lock_guard<mutex> guard(lock);
+		if (!connected) {
+			error = "Not connected.";
+			return false;
+		}
+		const uint64_t now = hostNanos();
+		advance(now);
+		double* position[3] = { &sample.x, &sample.y, &sample.z };
+		for (size_t i = 0; i < 3; i++) {
+			*position[i] = axes[i].actual + (config.feedbackNoise > 0.0 ? noise(rng) : 0.0);
+		}
+		sample.controllerTimestamp = now - origin;
+		sample.status = faulted ? STAGE_STATUS_FAULT | STAGE_STATUS_FOLLOWING_ERROR : 0;
+	}
+	spinFor(config.feedbackLatencyUs / 2);
+	return true;
+}
+
+string SimMotionController::lastError() const {
+	lock_guard<mutex> guard(lock);
+	return error;
+}
+
+double SimMotionController::getCommandedPosition(size_t axis) {
+	lock_guard<mutex> guard(lock);
+	advance(hostNanos());
+	return axes[axis].command;
+}
+
+double SimMotionController::getActualPosition(size_t axis) {
+	lock_guard<mutex> guard(lock);
+	advance(hostNanos());
+	return axes[axis].actual;
+}
+
+
+SimStageSpot::SimStageSpot(IMotionController& stage_, const SimStageSpotConfig& config_) :
+	stage(stage_),
+	config{ config_ }
+{}
+
+bool SimStageSpot::spotPosition(uint64_t hostTimestamp, double& x, double& y) {
+	(void)hostTimestamp;
+	StageSample sample;
+	if (!stage.readFeedback(sample)) {
+		return false;
+	}
+	x = config.originX + sample.x * config.pixelsPerMmX;
+	y = config.originY + sample.y * config.pixelsPerMmY;
+	return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "imotionController.h"
+#include "simCamera.h"
+
+using namespace std;
+
+
+struct SimMotionConfig {
+	// Limits of the commanded motion profile, in mm/s and mm/s^2.
+	double maxSpeed = 200.0;
+	double maxAcceleration = 2000.0;
+	// From a command being accepted to the axes acting on it.
+	double commandLatencyUs = 0.0;
+	// Round trip of readFeedback(), spent on the caller's thread.
+	double feedbackLatencyUs = 0.0;
+	// Standard deviation of the noise on position feedback, in mm.
+	double feedbackNoise = 0.0;
+	// Time constant of the servo: the actual position lags the commanded
+	// profile, so the following error is about speed * lag.
+	double servoLagMs = 0.0;
+	// Following error at which the axes fault and stop until enable(); 0
+	// never faults.
+	double followingErrorLimit = 0.0;
+	uint64_t seed = 1;
+};
+
+// Software x-y-z stage for building, testing and benchmarking the control
+// and acquisition paths without the A3200. Each axis follows a
+// speed- and acceleration-limited profile towards its target (or at its
+// free-run velocity); the actual position chases the profile through a
+// first-order servo lag, and feedback adds Gaussian noise. The model is
+// advanced to the current host time whenever it is read or commanded, so it
+// needs no thread of its own. controllerTimestamp is nanoseconds since
+// connect().
+class SimMotionController : public IMotionController {
+
+private:
+	enum class CommandType {
+		MoveAbsolute,
+		MoveIncremental,
+		Velocity,
+		Stop
+	};
+
+	struct Command {
+		uint64_t applyAt;
+		CommandType type;
+		double values[3];
+		double speed;
+	};
+
+	struct Axis {
+		double command = 0.0;
+		double velocity = 0.0;
+		double actual = 0.0;
+		double target = 0.0;
+		double speed = 0.0;
+		bool velocityMode = false;
+	};
+
+	SimMotionConfig config;
+	mutable mutex lock;
+	bool connected;
+	bool enabled;
+	bool faulted;
+	uint64_t origin;
+	uint64_t modelTime;
+	Axis axes[3];
+	deque<Command> pending;
+	mt19937_64 rng;
+	normal_distribution<double> noise;
+	string error;
+
+	void integrate(uint64_t until);
+	void apply(const Command& command);
+	void advance(uint64_t now);
+	bool submit(CommandType type, double a, double b, double c, double speed);
+
+public:
+	explicit SimMotionController(const SimMotionConfig& config_);
+	SimMotionController(const SimMotionController&) = delete;
+	SimMotionController& operator=(const SimMotionController&) = delete;
+
+	string name() const override;
+
+	bool connect() override;
+	void disconnect() override;
+	bool isConnected() const override;
+
+	bool enable() override;
+	bool moveAbsolute(double x, double y, double z, double speed) override;
+	bool moveIncremental(double dx, double dy, double dz, double speed) override;
+	bool setVelocity(double vx, double vy, double vz) override;
+	bool stop() override;
+
+	bool readFeedback(StageSample& sample) override;
+
+	string lastError() const override;
+
+	// Noise-free model state, for tests: the commanded profile and the
+	// actual position of axis 0-2.
+	double getCommandedPosition(size_t axis);
+	double getActualPosition(size_t axis);
+};
+
+struct SimStageSpotConfig {
+	// Pixel position of the spot with the stage at 0, and the image scale;
+	// a negative scale flips the axis.
+	double originX = 0.0;
+	double originY = 0.0;
+	double pixelsPerMmX = 100.0;
+	double pixelsPerMmY = 100.0;
+};
+
+// Shows a stage's x-y position to a SimCamera as the spot of
+// SimPattern::Spot, as a camera fixed above the stage sees the tool it
+// carries; what closes the loop in simulation.
+class SimStageSpot : public SimSpotSource {
+
+private:
+	IMotionController& stage;
+	SimStageSpotConfig config;
+
+public:
+	SimStageSpot(IMotionController& stage_, const SimStageSpotConfig& config_);
+
+	// Reads the stage as the frame is exposed, so hostTimestamp is unused.
+	bool spotPosition(uint64_t hostTimestamp, double& x, double& y) override;
+};
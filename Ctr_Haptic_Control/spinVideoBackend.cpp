@@ -0,0 +1,134 @@
+#include <filesystem>
+#include <iostream>
+
+#include "Spinnaker.h"
+#include "SpinVideo.h"
+#include "spinVideoBackend.h"
+
+using namespace Spinnaker;
+
+
+static PixelFormatEnums toSpinnakerFormat(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::Mono8:
+		return PixelFormat_Mono8;
+	case PixelFormat::Mono16:
+		return PixelFormat_Mono16;
+	case PixelFormat::BayerRG8:
+		return PixelFormat_BayerRG8;
+	case PixelFormat::BayerRG16:
+		return PixelFormat_BayerRG16;
+	case PixelFormat::BGR8:
+		return PixelFormat_BGR8;
+	default:
+		return UNKNOWN_PIXELFORMAT;
+	}
+}
+
+
+struct SpinVideoBackend::Writer {
+	Video::SpinVideo video;
+};
+
+SpinVideoBackend::SpinVideoBackend() :
+	bytes{ 0 },
+	appended{ 0 }
+{}
+
+SpinVideoBackend::~SpinVideoBackend() {
+	close();
+}
+
+bool SpinVideoBackend::open(const string& path_, const FrameInfo& info, const VideoOptions& options) {
+	(void)info;
+	close();
+	try {
+		writer = make_unique<Writer>();
+		// SpinVideo adds the extension itself.
+		switch (options.codec) {
+		case VideoCodec::Uncompressed: {
+			Video::AVIOption option;
+			option.frameRate = options.frameRate;
+			writer->video.Open(path_.c_str(), option);
+			path = path_ + ".avi";
+			break;
+		}
+		case VideoCodec::Mjpg: {
+			Video::MJPGOption option;
+			option.frameRate = options.frameRate;
+			option.quality = options.quality;
+			writer->video.Open(path_.c_str(), option);
+			path = path_ + ".avi";
+			break;
+		}
+		case VideoCodec::H264: {
+			Video::H264Option option;
+			option.frameRate = options.frameRate;
+			option.width = static_cast<unsigned int>(info.width);
+			option.height = static_cast<unsigned int>(info.height);
+			option.bitrate = options.bitrate;
+			writer->video.Open(path_.c_str(), option);
+			path = path_ + ".mp4";
+			break;
+		}
+		}
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+		writer.reset();
+		return false;
+	}
+	bytes = 0;
+	appended = 0;
+	return true;
+}
+
+bool SpinVideoBackend::append(const uint8_t* pixels, const FrameInfo& info) {
+	static constexpr uint64_t SIZE_POLL_FRAMES = 16;
+	if (!writer) {
+		return false;
+	}
+	try {
+		ImagePtr image = Image::Create(info.width, info.height, 0, 0, toSpinnakerFormat(info.pixelFormat),
+			const_cast<uint8_t*>(pixels));
+		writer->video.Append(image);
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+		return false;
+	}
+	if (++appended % SIZE_POLL_FRAMES == 0) {
+		error_code error;
+		const uintmax_t size = filesystem::file_size(path, error);
+		if (!error) {
+			bytes = size;
+		}
+	}
+	return true;
+}
+
+void SpinVideoBackend::close() {
+	if (!writer) {
+		return;
+	}
+	try {
+		writer->video.Close();
+	}
+	catch (Spinnaker::Exception& e) {
+		cout << "Error: " << e.what() << endl;
+	}
+	writer.reset();
+	error_code error;
+	const uintmax_t size = filesystem::file_size(path, error);
+	if (!error) {
+		bytes = size;
+	}
+}
+
+uint64_t SpinVideoBackend::fileBytes() const {
+	return bytes;
+}
+
+string SpinVideoBackend::currentPath() const {
+	return path;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "videoEncoder.h"
+
+using namespace std;
+
+
+// Encodes through Spinnaker's SpinVideo (AVI, MJPG or H264). SpinVideo
+// does not report how much it has written, so the size comes from the file
+// on disk, polled every few frames.
+class SpinVideoBackend : public IVideoBackend {
+
+private:
+	struct Writer;
+
+	unique_ptr<Writer> writer;
+	string path;
+	uint64_t bytes;
+	uint64_t appended;
+
+public:
+	SpinVideoBackend();
+	~SpinVideoBackend();
+
+	bool open(const string& path_, const FrameInfo& info, const VideoOptions& options) override;
+	bool append(const uint8_t* pixels, const FrameInfo& info) override;
+	void close() override;
+	uint64_t fileBytes() const override;
+	string currentPath() const override;
+};
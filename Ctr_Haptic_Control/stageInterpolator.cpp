@@ -0,0 +1,97 @@
+#include "stageInterpolator.h"
+
+
+StageInterpolator::StageInterpolator(size_t capacity) :
+	ring(capacity < 2 ? 2 : capacity),
+	head{ 0 },
+	count{ 0 }
+{}
+
+// i-th oldest sample kept.
+const StageSample& StageInterpolator::sampleAt(size_t i) const {
+	return ring[(head + ring.size() - count + i) % ring.size()];
+}
+
+void StageInterpolator::add(const StageSample& sample) {
+	if (count > 0 && sample.hostTimestamp <= newest()) {
+		return;
+	}
+	ring[head] = sample;
+	head = (head + 1) % ring.size();
+	count += count < ring.size() ? 1 : 0;
+}
+
+void StageInterpolator::clear() {
+	head = 0;
+	count = 0;
+}
+
+size_t StageInterpolator::size() const {
+	return count;
+}
+
+uint64_t StageInterpolator::newest() const {
+	return count == 0 ? 0 : sampleAt(count - 1).hostTimestamp;
+}
+
+StageAlignment StageInterpolator::at(uint64_t hostTimestamp, StageSample& sample) const {
+	if (count == 0 || hostTimestamp > newest()) {
+		return StageAlignment::Pending;
+	}
+	if (hostTimestamp < sampleAt(0).hostTimestamp) {
+		return StageAlignment::Expired;
+	}
+	// First sample at or after hostTimestamp.
+	size_t low = 0;
+	size_t high = count - 1;
+	while (low < high) {
+		const size_t middle = low + (high - low) / 2;
+		if (sampleAt(middle).hostTimestamp < hostTimestamp) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	const StageSample& after = sampleAt(low);
+	if (after.hostTimestamp == hostTimestamp || low == 0) {
+		sample = after;
+		return StageAlignment::Interpolated;
+	}
+	const StageSample& before = sampleAt(low - 1);
+	const double f = static_cast<double>(hostTimestamp - before.hostTimestamp)
+		/ static_cast<double>(after.hostTimestamp - before.hostTimestamp);
+	sample.hostTimestamp = hostTimestamp;
+	sample.controllerTimestamp = before.controllerTimestamp
+		+ static_cast<uint64_t>(f * static_cast<double>(after.controllerTimestamp - before.controllerTimestamp));
+	sample.x = before.x + (after.x - before.x) * f;
+	sample.y = before.y + (after.y - before.y) * f;
+	sample.z = before.z + (after.z - before.z) * f;
+	sample.status = before.status | after.status;
+	return StageAlignment::Interpolated;
+}
+
+bool StageInterpolator::nearest(uint64_t hostTimestamp, uint64_t maxGap, StageSample& sample) const {
+	if (count == 0) {
+		return false;
+	}
+	const StageSample& oldest = sampleAt(0);
+	const StageSample& latest = sampleAt(count - 1);
+	const StageSample* candidate = nullptr;
+	if (hostTimestamp <= oldest.hostTimestamp) {
+		candidate = &oldest;
+	}
+	else if (hostTimestamp >= latest.hostTimestamp) {
+		candidate = &latest;
+	}
+	else {
+		return at(hostTimestamp, sample) == StageAlignment::Interpolated;
+	}
+	const uint64_t gap = hostTimestamp > candidate->hostTimestamp
+		? hostTimestamp - candidate->hostTimestamp : candidate->hostTimestamp - hostTimestamp;
+	if (gap > maxGap) {
+		return false;
+	}
+	sample = *candidate;
+	return true;
+}
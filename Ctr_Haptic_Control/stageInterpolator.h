@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "telemetry.h"
+
+using namespace std;
+
+
+enum class StageAlignment {
+	// Bracketed by two samples; position interpolated between them.
+	Interpolated,
+	// Newer than every sample so far; ask again once more have arrived.
+	Pending,
+	// Older than every sample still kept.
+	Expired
+};
+
+// Stage position at arbitrary host times, from a stream of samples arriving
+// in time order. The newest `capacity` samples are kept in a fixed ring, so
+// adding and looking up never allocate; lookups binary-search the ring.
+// Single-threaded.
+class StageInterpolator {
+
+private:
+	vector<StageSample> ring;
+	size_t head;
+	size_t count;
+
+	const StageSample& sampleAt(size_t i) const;
+
+public:
+	explicit StageInterpolator(size_t capacity);
+
+	// Samples not newer than the last one are ignored.
+	void add(const StageSample& sample);
+	void clear();
+
+	size_t size() const;
+	// hostTimestamp of the newest sample, 0 when empty.
+	uint64_t newest() const;
+
+	// On Interpolated, sample holds the position at hostTimestamp, linear
+	// between its neighbours; status is theirs ORed together.
+	StageAlignment at(uint64_t hostTimestamp, StageSample& sample) const;
+	// For a time outside the kept samples, the oldest or newest sample if it
+	// is within maxGap nanoseconds; inside them, the same as at().
+	bool nearest(uint64_t hostTimestamp, uint64_t maxGap, StageSample& sample) const;
+};
@@ -0,0 +1,138 @@
+#include <chrono>
+#include <iostream>
+
+#include "stageSampler.h"
+#include "utilities.h"
+
+
+StageSampler::StageSampler(IMotionController& controller_, const StageSamplerConfig& config_) :
+	controller{ controller_ },
+	config{ config_ },
+	samples{ config.ringCapacity },
+	sampling{ false },
+	sampled{ 0 },
+	dropped{ 0 },
+	missed{ 0 },
+	errors{ 0 },
+	startNanos{ 0 },
+	lastNanos{ 0 }
+{}
+
+StageSampler::~StageSampler() {
+	stopSampling();
+}
+
+bool StageSampler::query(uint64_t sequence, StageSample& sample) {
+	sample = StageSample();
+	const uint64_t before = hostNanos();
+	const bool ok = controller.readFeedback(sample);
+	const uint64_t after = hostNanos();
+	queryLatency.record(after - before);
+	if (!ok) {
+		return false;
+	}
+	sample.hostTimestamp = before + (after - before) / 2;
+	if (sample.controllerTimestamp == 0) {
+		sample.controllerTimestamp = sequence;
+	}
+	return true;
+}
+
+void StageSampler::samplerLoop() {
+	static constexpr uint64_t SPIN_NANOS = 2000000;
+	const uint64_t period = static_cast<uint64_t>(1e9 / (config.rate > 0.0 ? config.rate : 1000.0));
+	uint64_t sequence = 0;
+	uint64_t previous = 0;
+	uint64_t next = hostNanos();
+
+	while (sampling) {
+		const uint64_t now = hostNanos();
+		if (now < next) {
+			if (next - now > SPIN_NANOS) {
+				this_thread::sleep_for(chrono::nanoseconds(next - now - SPIN_NANOS));
+			}
+			else {
+				this_thread::yield();
+			}
+			continue;
+		}
+		// Keep to the schedule; ticks a slow query ran past are skipped, not
+		// made up in a burst.
+		const uint64_t late = (now - next) / period;
+		missed += late;
+		next += (late + 1) * period;
+
+		StageSample sample;
+		if (!query(sequence++, sample)) {
+			if (errors++ == 0) {
+				cout << "Error: " << controller.name() << " feedback query failed: " << controller.lastError() << endl;
+			}
+			continue;
+		}
+		if (previous == 0) {
+			startNanos = sample.hostTimestamp;
+		}
+		else {
+			const uint64_t interval = sample.hostTimestamp - previous;
+			jitter.record(interval > period ? interval - period : period - interval);
+		}
+		previous = sample.hostTimestamp;
+		lastNanos = sample.hostTimestamp;
+		sampled++;
+		if (!samples.tryPush(move(sample))) {
+			dropped++;
+		}
+	}
+}
+
+string StageSampler::name() const {
+	return controller.name();
+}
+
+void StageSampler::startSampling() {
+	if (sampling) {
+		return;
+	}
+	sampled = 0;
+	dropped = 0;
+	missed = 0;
+	errors = 0;
+	lastNanos = 0;
+	jitter.reset();
+	queryLatency.reset();
+	sampling = true;
+	samplerThread = thread(&StageSampler::samplerLoop, this);
+}
+
+void StageSampler::stopSampling() {
+	if (!sampling.exchange(false)) {
+		return;
+	}
+	if (samplerThread.joinable()) {
+		samplerThread.join();
+	}
+}
+
+bool StageSampler::isSampling() const {
+	return sampling;
+}
+
+bool StageSampler::tryPopSample(StageSample& sample) {
+	return samples.tryPop(sample);
+}
+
+StageSamplerStats StageSampler::getStats() const {
+	StageSamplerStats stats;
+	stats.samples = sampled;
+	stats.samplesDropped = dropped;
+	stats.missedTicks = missed;
+	stats.queryErrors = errors;
+	const uint64_t first = startNanos;
+	const uint64_t last = lastNanos;
+	if (stats.samples > 1 && last > first) {
+		stats.achievedRate = (stats.samples - 1) * 1e9 / (last - first);
+	}
+	stats.jitter = jitter.summary();
+	stats.queryLatency = queryLatency.summary();
+	return stats;
+}
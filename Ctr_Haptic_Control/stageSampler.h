@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "imotionController.h"
+#include "istage.h"
+#include "latencyHistogram.h"
+#include "ringBuffer.h"
+
+using namespace std;
+
+
+struct StageSamplerConfig {
+	// Samples per second.
+	double rate = 1000.0;
+	size_t ringCapacity = 1 << 14;
+};
+
+struct StageSamplerStats {
+	uint64_t samples = 0;
+	// Refused because the ring was full.
+	uint64_t samplesDropped = 0;
+	// Ticks skipped because a query ran past the next one.
+	uint64_t missedTicks = 0;
+	uint64_t queryErrors = 0;
+	double achievedRate = 0.0;
+	// How far each sample interval was from the nominal period.
+	LatencySummary jitter;
+	// Round trip of each batched status query.
+	LatencySummary queryLatency;
+};
+
+// Reads a motion controller's feedback (one batched query per tick) on a
+// dedicated thread at a fixed rate. Each sample is stamped with hostNanos()
+// halfway through the query, the best estimate of when the controller read
+// the axes, and pushed into a lock-free ring. Controllers without a clock
+// of their own (the A3200 reports none through status items) get the
+// sample's sequence number as controllerTimestamp.
+//
+// Sleeps are too coarse for a kilohertz period, so the thread yields
+// through the last two milliseconds before each tick.
+class StageSampler : public IStageSource {
+
+private:
+	IMotionController& controller;
+	StageSamplerConfig config;
+
+	RingBuffer<StageSample> samples;
+	thread samplerThread;
+	atomic<bool> sampling;
+
+	atomic<uint64_t> sampled;
+	atomic<uint64_t> dropped;
+	atomic<uint64_t> missed;
+	atomic<uint64_t> errors;
+	atomic<uint64_t> startNanos;
+	atomic<uint64_t> lastNanos;
+	LatencyHistogram jitter;
+	LatencyHistogram queryLatency;
+
+	bool query(uint64_t sequence, StageSample& sample);
+	void samplerLoop();
+
+public:
+	// The controller must be connected, and outlive the sampler.
+	StageSampler(IMotionController& controller_, const StageSamplerConfig& config_);
+	~StageSampler();
+	StageSampler(const StageSampler&) = delete;
+	StageSampler& operator=(const StageSampler&) = delete;
+
+	string name() const override;
+
+	void startSampling() override;
+	void stopSampling() override;
+	bool isSampling() const override;
+
+	bool tryPopSample(StageSample& sample) override;
+	StageSamplerStats getStats() const;
+};
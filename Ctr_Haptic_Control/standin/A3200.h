@@ -0,0 +1,78 @@
+#pragma once
+
+// Stand-in for the subset of the Aerotech A3200 C library this project
+// uses, for building and testing on machines without it. CMakeLists.txt
+// (the Linux build) puts this directory on the include path ahead of the
+// real library and links a3200Standin.cpp instead of A3200C64.lib. Not part
+// of the Visual Studio project.
+//
+// The simulated controller has 32 axes that start at 0 mm. Moves complete
+// at the commanded speed with no acceleration, free runs continue until
+// stopped, and no axis ever faults; SimMotionController is the model to
+// use when kinematics matter. Every call takes the latency set with
+// A3200StandinSetCallLatency().
+
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+typedef int BOOL;
+typedef double DOUBLE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef char* LPSTR;
+#endif
+
+typedef struct A3200StandinController* A3200Handle;
+
+typedef enum {
+	AXISMASK_None = 0,
+	AXISMASK_00 = 1u << 0,
+	AXISMASK_01 = 1u << 1,
+	AXISMASK_02 = 1u << 2,
+	AXISMASK_03 = 1u << 3,
+	AXISMASK_04 = 1u << 4,
+	AXISMASK_05 = 1u << 5,
+	AXISMASK_06 = 1u << 6,
+	AXISMASK_07 = 1u << 7
+} AXISMASK;
+
+typedef enum {
+	AXISINDEX_00 = 0,
+	AXISINDEX_01 = 1,
+	AXISINDEX_02 = 2
+} AXISINDEX;
+
+typedef enum {
+	TASKID_Library = 0,
+	TASKID_01 = 1
+} TASKID;
+
+typedef enum {
+	STATUSITEM_PositionCommand = 0,
+	STATUSITEM_PositionFeedback = 1,
+	STATUSITEM_AxisFault = 2,
+	STATUSITEM_AxisStatus = 3
+} STATUSITEM;
+
+BOOL A3200Connect(A3200Handle* handle);
+BOOL A3200Disconnect(A3200Handle handle);
+
+BOOL A3200StatusGetItem(A3200Handle handle, WORD itemIndex, STATUSITEM itemCode, DWORD itemExtra, DOUBLE* itemValue);
+BOOL A3200StatusGetItems(A3200Handle handle, DWORD numberOfItems, WORD* itemIndexArray, STATUSITEM* itemCodeArray,
+	DWORD* itemExtrasArray, DOUBLE* itemValuesArray);
+
+// Array arguments hold one value per axis in the mask, lowest axis first.
+BOOL A3200MotionEnable(A3200Handle handle, TASKID taskId, AXISMASK axisMask);
+BOOL A3200MotionDisable(A3200Handle handle, TASKID taskId, AXISMASK axisMask);
+BOOL A3200MotionMoveAbs(A3200Handle handle, TASKID taskId, AXISMASK axisMask, DOUBLE* distanceArray, DOUBLE* speedArray);
+BOOL A3200MotionMoveInc(A3200Handle handle, TASKID taskId, AXISMASK axisMask, DOUBLE* distanceArray, DOUBLE* speedArray);
+BOOL A3200MotionFreeRun(A3200Handle handle, TASKID taskId, AXISINDEX axisIndex, DOUBLE speed);
+BOOL A3200MotionFreeRunStop(A3200Handle handle, TASKID taskId, AXISINDEX axisIndex);
+BOOL A3200MotionAbort(A3200Handle handle, AXISMASK axisMask);
+
+BOOL A3200GetLastErrorString(LPSTR errorString, DWORD errorStringSize);
+
+// Stand-in only.
+void A3200StandinSetCallLatency(DWORD microseconds);
@@ -0,0 +1,262 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "A3200.h"
+
+using namespace std;
+
+
+static const WORD AXIS_COUNT = 32;
+
+// Each axis moves from start towards target at speed from startTime; a free
+// run has no target.
+struct StandinAxis {
+	bool enabled = false;
+	bool freeRun = false;
+	double start = 0.0;
+	double target = 0.0;
+	double speed = 0.0;
+	double startTime = 0.0;
+};
+
+struct A3200StandinController {
+	chrono::steady_clock::time_point origin;
+	mutex lock;
+	StandinAxis axes[AXIS_COUNT];
+
+	double now() const {
+		return chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+	}
+};
+
+static atomic<DWORD> callLatencyUs{ 0 };
+static thread_local char lastError[128] = "";
+
+static void setError(const char* message) {
+	snprintf(lastError, sizeof(lastError), "%s", message);
+}
+
+// Waits out the configured latency; spinning, since sleeps this short are
+// not honoured.
+static void simulateCall() {
+	const DWORD latency = callLatencyUs;
+	if (latency == 0) {
+		return;
+	}
+	const auto end = chrono::steady_clock::now() + chrono::microseconds(latency);
+	while (chrono::steady_clock::now() < end) {
+		this_thread::yield();
+	}
+}
+
+static double positionOf(const StandinAxis& axis, double t) {
+	const double travelled = axis.speed * (t - axis.startTime);
+	if (axis.freeRun) {
+		return axis.start + travelled;
+	}
+	const double distance = axis.target - axis.start;
+	if (fabs(travelled) >= fabs(distance) || axis.speed == 0.0) {
+		return axis.target;
+	}
+	return axis.start + (distance < 0.0 ? -fabs(travelled) : fabs(travelled));
+}
+
+// Starts a new motion on an axis from wherever it is now.
+static void command(StandinAxis& axis, double t, bool freeRun, double target, double speed) {
+	const double position = positionOf(axis, t);
+	axis.freeRun = freeRun;
+	axis.start = position;
+	// A free run, or a stop (speed 0), holds no target of its own.
+	axis.target = freeRun || speed == 0.0 ? position : target;
+	axis.speed = speed;
+	axis.startTime = t;
+}
+
+static bool readItem(A3200Handle handle, WORD index, STATUSITEM code, DOUBLE* value) {
+	if (index >= AXIS_COUNT) {
+		setError("Axis index out of range.");
+		return false;
+	}
+	const StandinAxis& axis = handle->axes[index];
+	switch (code) {
+	case STATUSITEM_PositionCommand:
+	case STATUSITEM_PositionFeedback:
+		*value = positionOf(axis, handle->now());
+		return true;
+	case STATUSITEM_AxisFault:
+		*value = 0.0;
+		return true;
+	case STATUSITEM_AxisStatus:
+		*value = axis.enabled ? 1.0 : 0.0;
+		return true;
+	}
+	setError("Unknown status item.");
+	return false;
+}
+
+BOOL A3200Connect(A3200Handle* handle) {
+	if (!handle) {
+		setError("Null handle.");
+		return 0;
+	}
+	simulateCall();
+	*handle = new A3200StandinController();
+	(*handle)->origin = chrono::steady_clock::now();
+	return 1;
+}
+
+BOOL A3200Disconnect(A3200Handle handle) {
+	delete handle;
+	return 1;
+}
+
+BOOL A3200StatusGetItem(A3200Handle handle, WORD itemIndex, STATUSITEM itemCode, DWORD itemExtra, DOUBLE* itemValue) {
+	(void)itemExtra;
+	if (!handle || !itemValue) {
+		setError("Not connected.");
+		return 0;
+	}
+	simulateCall();
+	lock_guard<mutex> guard(handle->lock);
+	return readItem(handle, itemIndex, itemCode, itemValue) ? 1 : 0;
+}
+
+BOOL A3200StatusGetItems(A3200Handle handle, DWORD numberOfItems, WORD* itemIndexArray, STATUSITEM* itemCodeArray,
+	DWORD* itemExtrasArray, DOUBLE* itemValuesArray) {
+	(void)itemExtrasArray;
+	if (!handle || !itemIndexArray || !itemCodeArray || !itemValuesArray) {
+		setError("Not connected.");
+		return 0;
+	}
+	// One round trip for the whole batch, as with the real controller.
+	simulateCall();
+	lock_guard<mutex> guard(handle->lock);
+	for (DWORD i = 0; i < numberOfItems; i++) {
+		if (!readItem(handle, itemIndexArray[i], itemCodeArray[i], &itemValuesArray[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static BOOL setEnabled(A3200Handle handle, AXISMASK axisMask, bool enabled) {
+	if (!handle) {
+		setError("Not connected.");
+		return 0;
+	}
+	simulateCall();
+	lock_guard<mutex> guard(handle->lock);
+	for (WORD axis = 0; axis < AXIS_COUNT; axis++) {
+		if (axisMask & (1u << axis)) {
+			handle->axes[axis].enabled = enabled;
+		}
+	}
+	return 1;
+}
+
+BOOL A3200MotionEnable(A3200Handle handle, TASKID taskId, AXISMASK axisMask) {
+	(void)taskId;
+	return setEnabled(handle, axisMask, true);
+}
+
+BOOL A3200MotionDisable(A3200Handle handle, TASKID taskId, AXISMASK axisMask) {
+	(void)taskId;
+	return setEnabled(handle, axisMask, false);
+}
+
+static BOOL move(A3200Handle handle, AXISMASK axisMask, DOUBLE* distanceArray, DOUBLE* speedArray, bool incremental) {
+	if (!handle || !distanceArray || !speedArray) {
+		setError("Not connected.");
+		return 0;
+	}
+	simulateCall();
+	lock_guard<mutex> guard(handle->lock);
+	const double t = handle->now();
+	size_t n = 0;
+	for (WORD axis = 0; axis < AXIS_COUNT; axis++) {
+		if ((axisMask & (1u << axis)) == 0) {
+			continue;
+		}
+		StandinAxis& state = handle->axes[axis];
+		if (!state.enabled) {
+			setError("Axis is not enabled.");
+			return 0;
+		}
+		const double target = incremental ? positionOf(state, t) + distanceArray[n] : distanceArray[n];
+		command(state, t, false, target, fabs(speedArray[n]));
+		n++;
+	}
+	return 1;
+}
+
+BOOL A3200MotionMoveAbs(A3200Handle handle, TASKID taskId, AXISMASK axisMask, DOUBLE* distanceArray, DOUBLE* speedArray) {
+	(void)taskId;
+	return move(handle, axisMask, distanceArray, speedArray, false);
+}
+
+BOOL A3200MotionMoveInc(A3200Handle handle, TASKID taskId, AXISMASK axisMask, DOUBLE* distanceArray, DOUBLE* speedArray) {
+	(void)taskId;
+	return move(handle, axisMask, distanceArray, speedArray, true);
+}
+
+BOOL A3200MotionFreeRun(A3200Handle handle, TASKID taskId, AXISINDEX axisIndex, DOUBLE speed) {
+	(void)taskId;
+	if (!handle || axisIndex >= AXIS_COUNT) {
+		setError("Not connected.");
+		return 0;
+	}
+	simulateCall();
+	lock_guard<mutex> guard(handle->lock);
+	StandinAxis& state = handle->axes[axisIndex];
+	if (!state.enabled) {
+		setError("Axis is not enabled.");
+		return 0;
+	}
+	command(state, handle->now(), true, 0.0, speed);
+	return 1;
+}
+
+BOOL A3200MotionFreeRunStop(A3200Handle handle, TASKID taskId, AXISINDEX axisIndex) {
+	(void)taskId;
+	if (!handle || axisIndex >= AXIS_COUNT) {
+		setError("Not connected.");
+		return 0;
+	}
+	simulateCall();
+	lock_guard<mutex> guard(handle->lock);
+	command(handle->axes[axisIndex], handle->now(), false, 0.0, 0.0);
+	return 1;
+}
+
+BOOL A3200MotionAbort(A3200Handle handle, AXISMASK axisMask) {
+	if (!handle) {
+		setError("Not connected.");
+		return 0;
+	}
+	simulateCall();
+	lock_guard<mutex> guard(handle->lock);
+	const double t = handle->now();
+	for (WORD axis = 0; axis < AXIS_COUNT; axis++) {
+		if (axisMask & (1u << axis)) {
+			command(handle->axes[axis], t, false, 0.0, 0.0);
+		}
+	}
+	return 1;
+}
+
+BOOL A3200GetLastErrorString(LPSTR errorString, DWORD errorStringSize) {
+	if (!errorString || errorStringSize == 0) {
+		return 0;
+	}
+	snprintf(errorString, errorStringSize, "%s", lastError);
+	return 1;
+}
+
+void A3200StandinSetCallLatency(DWORD microseconds) {
+	callLatencyUs = microseconds;
+}
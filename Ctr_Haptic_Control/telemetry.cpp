@@ -0,0 +1,232 @@
+#include <google/protobuf/wire_format_lite.h>
+
+#include "session.pb.h"
+#include "telemetry.h"
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedOutputStream;
+
+
+// Field numbers of medusa::TelemetryBatch.
+enum TelemetryField {
+	StageHostTimestamp = 1,
+	StageControllerTimestamp = 2,
+	StageX = 3,
+	StageY = 4,
+	StageZ = 5,
+	StageStatus = 6,
+	CameraSource = 7,
+	CameraFrameId = 8,
+	CameraTimestamp = 9,
+	CameraHostTimestamp = 10,
+	CameraStageHostTimestamp = 11,
+	CameraStageX = 12,
+	CameraStageY = 13,
+	CameraStageZ = 14,
+	CameraStageStatus = 15
+};
+
+static uint32_t packedTag(int field) {
+	return WireFormatLite::MakeTag(field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+}
+
+static size_t packedSize(int field, size_t payload) {
+	if (payload == 0) {
+		return 0;
+	}
+	return CodedOutputStream::VarintSize32(packedTag(field))
+		+ CodedOutputStream::VarintSize32(static_cast<uint32_t>(payload)) + payload;
+}
+
+template <typename T>
+static size_t varintPayload(const vector<T>& values) {
+	size_t bytes = 0;
+	for (T value : values) {
+		bytes += CodedOutputStream::VarintSize64(value);
+	}
+	return bytes;
+}
+
+// fixed64 and double are little-endian on the wire, as in memory on every
+// target this builds for, so a column is copied out as is.
+template <typename T>
+static void writeFixed(CodedOutputStream& out, int field, const vector<T>& values) {
+	static_assert(sizeof(T) == 8, "fixed-width columns are 64-bit");
+	if (values.empty()) {
+		return;
+	}
+	out.WriteTag(packedTag(field));
+	out.WriteVarint32(static_cast<uint32_t>(values.size() * sizeof(T)));
+	out.WriteRaw(values.data(), static_cast<int>(values.size() * sizeof(T)));
+}
+
+template <typename T>
+static void writeVarints(CodedOutputStream& out, int field, const vector<T>& values) {
+	if (values.empty()) {
+		return;
+	}
+	out.WriteTag(packedTag(field));
+	out.WriteVarint32(static_cast<uint32_t>(varintPayload(values)));
+	for (T value : values) {
+		out.WriteVarint64(value);
+	}
+}
+
+
+void TelemetryBatcher::reserve(size_t samples) {
+	for (vector<uint64_t>* column : { &stageHostTimestamps, &stageControllerTimestamps, &cameraFrameIds,
+		&cameraTimestamps, &cameraHostTimestamps, &cameraStageHostTimestamps }) {
+		column->reserve(samples);
+	}
+	for (vector<double>* column : { &stageX, &stageY, &stageZ, &cameraStageX, &cameraStageY, &cameraStageZ }) {
+		column->reserve(samples);
+	}
+	stageStatus.reserve(samples);
+	cameraSources.reserve(samples);
+	cameraStageStatus.reserve(samples);
+}
+
+void TelemetryBatcher::add(const StageSample& sample) {
+	stageHostTimestamps.push_back(sample.hostTimestamp);
+	stageControllerTimestamps.push_back(sample.controllerTimestamp);
+	stageX.push_back(sample.x);
+	stageY.push_back(sample.y);
+	stageZ.push_back(sample.z);
+	stageStatus.push_back(sample.status);
+}
+
+void TelemetryBatcher::add(const CameraSample& sample) {
+	cameraSources.push_back(sample.source);
+	cameraFrameIds.push_back(sample.frameId);
+	cameraTimestamps.push_back(sample.timestamp);
+	cameraHostTimestamps.push_back(sample.hostTimestamp);
+	cameraStageHostTimestamps.push_back(sample.stage.hostTimestamp);
+	cameraStageX.push_back(sample.stage.x);
+	cameraStageY.push_back(sample.stage.y);
+	cameraStageZ.push_back(sample.stage.z);
+	cameraStageStatus.push_back(sample.stage.status);
+}
+
+void TelemetryBatcher::clear() {
+	for (vector<uint64_t>* column : { &stageHostTimestamps, &stageControllerTimestamps, &cameraFrameIds,
+		&cameraTimestamps, &cameraHostTimestamps, &cameraStageHostTimestamps }) {
+		column->clear();
+	}
+	for (vector<double>* column : { &stageX, &stageY, &stageZ, &cameraStageX, &cameraStageY, &cameraStageZ }) {
+		column->clear();
+	}
+	stageStatus.clear();
+	cameraSources.clear();
+	cameraStageStatus.clear();
+}
+
+size_t TelemetryBatcher::stageCount() const {
+	return stageHostTimestamps.size();
+}
+
+size_t TelemetryBatcher::cameraCount() const {
+	return cameraHostTimestamps.size();
+}
+
+bool TelemetryBatcher::empty() const {
+	return stageCount() == 0 && cameraCount() == 0;
+}
+
+uint64_t TelemetryBatcher::firstHostTimestamp() const {
+	if (empty()) {
+		return 0;
+	}
+	if (stageHostTimestamps.empty()) {
+		return cameraHostTimestamps.front();
+	}
+	if (cameraHostTimestamps.empty()) {
+		return stageHostTimestamps.front();
+	}
+	const uint64_t stage = stageHostTimestamps.front();
+	const uint64_t camera = cameraHostTimestamps.front();
+	return stage < camera ? stage : camera;
+}
+
+size_t TelemetryBatcher::byteSize() const {
+	const size_t stage = stageCount() * 8;
+	const size_t camera = cameraCount() * 8;
+	return packedSize(StageHostTimestamp, stage) + packedSize(StageControllerTimestamp, stage)
+		+ packedSize(StageX, stage) + packedSize(StageY, stage) + packedSize(StageZ, stage)
+		+ packedSize(StageStatus, varintPayload(stageStatus))
+		+ packedSize(CameraSource, varintPayload(cameraSources))
+		+ packedSize(CameraFrameId, varintPayload(cameraFrameIds))
+		+ packedSize(CameraTimestamp, camera) + packedSize(CameraHostTimestamp, camera)
+		+ packedSize(CameraStageHostTimestamp, camera) + packedSize(CameraStageX, camera)
+		+ packedSize(CameraStageY, camera) + packedSize(CameraStageZ, camera)
+		+ packedSize(CameraStageStatus, varintPayload(cameraStageStatus));
+}
+
+void TelemetryBatcher::serialize(CodedOutputStream& out) const {
+	writeFixed(out, StageHostTimestamp, stageHostTimestamps);
+	writeFixed(out, StageControllerTimestamp, stageControllerTimestamps);
+	writeFixed(out, StageX, stageX);
+	writeFixed(out, StageY, stageY);
+	writeFixed(out, StageZ, stageZ);
+	writeVarints(out, StageStatus, stageStatus);
+	writeVarints(out, CameraSource, cameraSources);
+	writeVarints(out, CameraFrameId, cameraFrameIds);
+	writeFixed(out, CameraTimestamp, cameraTimestamps);
+	writeFixed(out, CameraHostTimestamp, cameraHostTimestamps);
+	writeFixed(out, CameraStageHostTimestamp, cameraStageHostTimestamps);
+	writeFixed(out, CameraStageX, cameraStageX);
+	writeFixed(out, CameraStageY, cameraStageY);
+	writeFixed(out, CameraStageZ, cameraStageZ);
+	writeVarints(out, CameraStageStatus, cameraStageStatus);
+}
+
+bool TelemetryBatcher::parse(const uint8_t* data, size_t size, vector<StageSample>& stage, vector<CameraSample>& camera) {
+	google::protobuf::Arena arena;
+	medusa::TelemetryBatch* batch = google::protobuf::Arena::CreateMessage<medusa::TelemetryBatch>(&arena);
+	if (!batch->ParseFromArray(data, static_cast<int>(size))) {
+		return false;
+	}
+	const int stageSamples = batch->stage_host_timestamp_size();
+	if (batch->stage_controller_timestamp_size() != stageSamples || batch->stage_x_size() != stageSamples
+		|| batch->stage_y_size() != stageSamples || batch->stage_z_size() != stageSamples
+		|| batch->stage_status_size() != stageSamples) {
+		return false;
+	}
+	const int cameraSamples = batch->camera_host_timestamp_size();
+	if (batch->camera_source_size() != cameraSamples || batch->camera_frame_id_size() != cameraSamples
+		|| batch->camera_timestamp_size() != cameraSamples) {
+		return false;
+	}
+	// Stage columns are all there or, in older sessions, all absent.
+	const bool cameraStage = batch->camera_stage_host_timestamp_size() > 0;
+	if (cameraStage && (batch->camera_stage_host_timestamp_size() != cameraSamples
+		|| batch->camera_stage_x_size() != cameraSamples || batch->camera_stage_y_size() != cameraSamples
+		|| batch->camera_stage_z_size() != cameraSamples || batch->camera_stage_status_size() != cameraSamples)) {
+		return false;
+	}
+	for (int i = 0; i < stageSamples; i++) {
+		StageSample sample;
+		sample.hostTimestamp = batch->stage_host_timestamp(i);
+		sample.controllerTimestamp = batch->stage_controller_timestamp(i);
+		sample.x = batch->stage_x(i);
+		sample.y = batch->stage_y(i);
+		sample.z = batch->stage_z(i);
+		sample.status = batch->stage_status(i);
+		stage.push_back(sample);
+	}
+	for (int i = 0; i < cameraSamples; i++) {
+		CameraSample sample;
+		sample.source = batch->camera_source(i);
+		sample.frameId = batch->camera_frame_id(i);
+		sample.timestamp = batch->camera_timestamp(i);
+		sample.hostTimestamp = batch->camera_host_timestamp(i);
+		if (cameraStage) {
+			sample.stage.hostTimestamp = batch->camera_stage_host_timestamp(i);
+			sample.stage.x = batch->camera_stage_x(i);
+			sample.stage.y = batch->camera_stage_y(i);
+			sample.stage.z = batch->camera_stage_z(i);
+			sample.stage.status = batch->camera_stage_status(i);
+		}
+		camera.push_back(sample);
+	}
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <google/protobuf/io/coded_stream.h>
+
+using namespace std;
+
+
+// One stage position reading. Positions are in controller units.
+struct StageSample {
+	// hostNanos() when the sample was taken.
+	uint64_t hostTimestamp = 0;
+	uint64_t controllerTimestamp = 0;
+	double x = 0.0;
+	double y = 0.0;
+	double z = 0.0;
+	uint32_t status = 0;
+};
+
+// Set in CameraSample::stage.status when no pair of stage samples bracketed
+// the exposure and the nearest sample was used as is.
+constexpr uint32_t STAGE_STATUS_NOT_INTERPOLATED = 1u << 31;
+
+// Per-frame camera timing, kept even for frames whose pixels are not stored.
+struct CameraSample {
+	uint32_t source = 0;
+	uint64_t frameId = 0;
+	uint64_t timestamp = 0;
+	uint64_t hostTimestamp = 0;
+	// Stage position at the middle of the exposure. stage.hostTimestamp is
+	// that midpoint, or 0 when no stage sample was close enough.
+	StageSample stage;
+};
+
+// Accumulates samples column by column and writes them as one
+// medusa::TelemetryBatch (session.proto). Fixed-width columns go out as
+// single raw copies, so the cost per sample is a few stores rather than a
+// message build and serialize.
+class TelemetryBatcher {
+
+private:
+	vector<uint64_t> stageHostTimestamps;
+	vector<uint64_t> stageControllerTimestamps;
+	vector<double> stageX;
+	vector<double> stageY;
+	vector<double> stageZ;
+	vector<uint32_t> stageStatus;
+	vector<uint32_t> cameraSources;
+	vector<uint64_t> cameraFrameIds;
+	vector<uint64_t> cameraTimestamps;
+	vector<uint64_t> cameraHostTimestamps;
+	vector<uint64_t> cameraStageHostTimestamps;
+	vector<double> cameraStageX;
+	vector<double> cameraStageY;
+	vector<double> cameraStageZ;
+	vector<uint32_t> cameraStageStatus;
+
+public:
+	void reserve(size_t samples);
+	void add(const StageSample& sample);
+	void add(const CameraSample& sample);
+	void clear();
+
+	size_t stageCount() const;
+	size_t cameraCount() const;
+	bool empty() const;
+	// Earliest host timestamp in the batch, 0 when empty.
+	uint64_t firstHostTimestamp() const;
+
+	// Exact number of bytes serialize() writes.
+	size_t byteSize() const;
+	void serialize(google::protobuf::io::CodedOutputStream& out) const;
+
+	// Appends the samples of a serialized TelemetryBatch.
+	static bool parse(const uint8_t* data, size_t size, vector<StageSample>& stage, vector<CameraSample>& camera);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+
+// Assertions for the test executables: a failed check prints where and
+// what, and checkResult() turns any failure into a non-zero exit code.
+inline int& checkFailures() {
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << endl; \
+			checkFailures()++; \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+	do { \
+		const double checkActual = (actual); \
+		const double checkExpected = (expected); \
+		if (!(fabs(checkActual - checkExpected) <= (tolerance))) { \
+			cout << __FILE__ << ":" << __LINE__ << ": " #actual " = " << checkActual << ", expected " << checkExpected \
+				 << " +/- " << (tolerance) << endl; \
+			checkFailures()++; \
+		} \
+	} while (0)
+
+inline int checkResult(const char* test) {
+	cout << test << ": " << (checkFailures() == 0 ? "passed" : "FAILED") << endl;
+	return checkFailures() == 0 ? 0 : 1;
+}
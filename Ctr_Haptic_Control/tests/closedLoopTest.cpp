@@ -0,0 +1,170 @@
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "check.h"
+#include "ctr.h"
+#include "frameFanout.h"
+#include "simCamera.h"
+#include "simMotionController.h"
+
+
+static const size_t WIDTH = 640;
+static const size_t HEIGHT = 480;
+
+// A camera looking down on a simulated stage, its spot the stage's x-y
+// position, and a closed loop between them through Ctr.
+struct Rig {
+	SimCamera camera;
+	FrameFanout fanout;
+	FrameSubscriber& view;
+	Ctr ctr;
+	SimStageSpot spot;
+
+	static SimCameraConfig cameraConfig() {
+		SimCameraConfig config;
+		config.width = WIDTH;
+		config.height = HEIGHT;
+		config.frameRate = 200.0;
+		config.pattern = SimPattern::Spot;
+		return config;
+	}
+
+	static SimStageSpotConfig spotConfig() {
+		SimStageSpotConfig config;
+		config.originX = WIDTH / 2.0;
+		config.originY = HEIGHT / 2.0;
+		return config;
+	}
+
+	explicit Rig(const CtrConfig& config) :
+		camera{ cameraConfig() },
+		fanout{ camera },
+		view(fanout.subscribe("control", SubscriberPolicy::LatestOnly)),
+		ctr{ make_unique<SimMotionController>(SimMotionConfig()), config },
+		spot{ *ctr.getMotionController(), spotConfig() }
+	{
+		camera.setSpotSource(&spot);
+		fanout.start();
+	}
+
+	~Rig() {
+		ctr.stopControl();
+		fanout.stop();
+		camera.setSpotSource(nullptr);
+	}
+
+	StageSample stage() {
+		StageSample sample;
+		ctr.getMotionController()->readFeedback(sample);
+		return sample;
+	}
+};
+
+static CtrConfig closedLoop(double deadlineMs) {
+	CtrConfig config;
+	config.control = Control::CLOSED_LOOP;
+	config.controlDeadlineMs = deadlineMs;
+	return config;
+}
+
+static void centroid() {
+	SimCameraConfig config = Rig::cameraConfig();
+	SimCamera camera(config);
+	camera.startStreaming();
+	Frame frame;
+	CHECK(camera.waitForFrame(frame, chrono::milliseconds(1000)));
+	CentroidExtractor extractor{ CentroidConfig() };
+	Feature feature;
+	CHECK(extractor.extract(frame, feature));
+	CHECK_NEAR(feature.x, WIDTH / 2.0, 0.5);
+	CHECK_NEAR(feature.y, HEIGHT / 2.0, 0.5);
+	CHECK(feature.area > 400);
+	frame.reset();
+	camera.stopStreaming();
+}
+
+static void openLoopRefused() {
+	Rig rig{ CtrConfig() };
+	CHECK(!rig.ctr.startControl(rig.view));
+	CHECK(rig.ctr.getClosedLoop() == nullptr);
+}
+
+// Steers the spot 1 mm right and 0.4 mm up of centre.
+static void converges() {
+	Rig rig{ closedLoop(5.0) };
+	CHECK(rig.ctr.startControl(rig.view));
+	rig.ctr.getClosedLoop()->setSetpoint(WIDTH / 2.0 + 100.0, HEIGHT / 2.0 - 40.0);
+	this_thread::sleep_for(chrono::milliseconds(1500));
+	const StageSample stage = rig.stage();
+	CHECK_NEAR(stage.x, 1.0, 0.01);
+	CHECK_NEAR(stage.y, -0.4, 0.01);
+
+	rig.ctr.stopControl();
+	const ClosedLoopStats stats = rig.ctr.getClosedLoop()->getStats();
+	CHECK(stats.framesProcessed > 200);
+	CHECK(stats.commandsSent > 0);
+	CHECK(stats.featureMisses == 0);
+	CHECK(stats.commandErrors == 0);
+	CHECK(fabs(stats.errorX) < 1.0 && fabs(stats.errorY) < 1.0);
+	CHECK(stats.deadlineMisses == stats.framesStale + stats.framesLate + stats.commandsLate);
+	CHECK(stats.deadlineMisses * 20 < stats.framesProcessed);
+	CHECK(stats.endToEnd.count == stats.commandsSent);
+	CHECK(stats.endToEnd.p50Us > 0.0 && stats.endToEnd.p50Us < 5000.0);
+}
+
+// A deadline no frame can make: everything is stale or late, and the stage
+// is never commanded to move.
+static void deadlineMisses() {
+	Rig rig{ closedLoop(0.0001) };
+	CHECK(rig.ctr.startControl(rig.view));
+	rig.ctr.getClosedLoop()->setSetpoint(WIDTH / 2.0 + 100.0, HEIGHT / 2.0);
+	this_thread::sleep_for(chrono::milliseconds(300));
+	rig.ctr.stopControl();
+	const ClosedLoopStats stats = rig.ctr.getClosedLoop()->getStats();
+	CHECK(stats.framesStale > 0);
+	CHECK(stats.deadlineMisses == stats.framesStale + stats.framesLate + stats.commandsLate);
+	CHECK(stats.commandsSent == 0);
+	CHECK_NEAR(rig.stage().x, 0.0, 1e-9);
+}
+
+// Losing the camera mid-move must not leave the stage running.
+static void stopsOnCameraLoss() {
+	CtrConfig config = closedLoop(5.0);
+	config.controlGain = 1.0;
+	Rig rig{ config };
+	CHECK(rig.ctr.startControl(rig.view));
+	rig.ctr.getClosedLoop()->setSetpoint(WIDTH - 20.0, HEIGHT / 2.0);
+	this_thread::sleep_for(chrono::milliseconds(300));
+	rig.fanout.stop();
+	this_thread::sleep_for(chrono::milliseconds(50));
+	const StageSample stopped = rig.stage();
+	this_thread::sleep_for(chrono::milliseconds(500));
+	CHECK_NEAR(rig.stage().x, stopped.x, 1e-6);
+	CHECK(stopped.x > 0.1 && stopped.x < 2.9);
+	CHECK(rig.ctr.getClosedLoop()->getStats().watchdogStops == 1);
+}
+
+// Losing the feature stops the stage at once: a setpoint outside the frame
+// drives the spot off its edge.
+static void stopsOnFeatureLoss() {
+	Rig rig{ closedLoop(5.0) };
+	CHECK(rig.ctr.startControl(rig.view));
+	rig.ctr.getClosedLoop()->setSetpoint(WIDTH + 1000.0, HEIGHT / 2.0);
+	this_thread::sleep_for(chrono::milliseconds(1000));
+	const StageSample stopped = rig.stage();
+	this_thread::sleep_for(chrono::milliseconds(300));
+	CHECK_NEAR(rig.stage().x, stopped.x, 1e-6);
+	CHECK(stopped.x > 3.0 && stopped.x < 3.5);
+	CHECK(rig.ctr.getClosedLoop()->getStats().featureMisses > 0);
+}
+
+int main() {
+	centroid();
+	openLoopRefused();
+	converges();
+	deadlineMisses();
+	stopsOnCameraLoss();
+	stopsOnFeatureLoss();
+	return checkResult("closedLoopTest");
+}
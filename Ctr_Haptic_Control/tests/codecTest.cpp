@@ -0,0 +1,149 @@
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "losslessCodec.h"
+
+
+enum class Content {
+	Smooth,
+	Noise,
+	Flat
+};
+
+// width x height pixels in rows of stride bytes; 16-bit samples are
+// shifted up by shift bits, leaving the low bits zero.
+static vector<uint8_t> makeImage(PixelFormat format, size_t width, size_t height, size_t stride, Content content,
+	uint32_t shift, uint32_t seed) {
+	mt19937 rng(seed);
+	normal_distribution<double> noise(0.0, 3.0);
+	const bool wide = bytesPerPixel(format) == 2;
+	const double maximum = wide ? static_cast<double>(0xFFFF >> shift) : 255.0;
+	vector<uint8_t> image(height * stride, 0xA5);
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++) {
+			double value = 0.0;
+			if (content == Content::Smooth) {
+				value = maximum * (0.5 + 0.3 * sin(x * 0.05) * cos(y * 0.03)) + ((x ^ y) & 1) * maximum * 0.1 + noise(rng);
+			}
+			else if (content == Content::Noise) {
+				value = static_cast<double>(rng() % (static_cast<uint32_t>(maximum) + 1));
+			}
+			value = value < 0.0 ? 0.0 : value > maximum ? maximum : value;
+			if (wide) {
+				const uint16_t sample = static_cast<uint16_t>(static_cast<uint32_t>(value) << shift);
+				memcpy(image.data() + y * stride + 2 * x, &sample, 2);
+			}
+			else {
+				image[y * stride + x] = static_cast<uint8_t>(value);
+			}
+		}
+	}
+	return image;
+}
+
+static bool samePixels(const vector<uint8_t>& a, size_t aStride, const vector<uint8_t>& b, size_t bStride,
+	size_t rowBytes, size_t height) {
+	for (size_t y = 0; y < height; y++) {
+		if (memcmp(a.data() + y * aStride, b.data() + y * bStride, rowBytes) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every SIMD level must produce the same stream, and each must decode it
+// back to the source pixels.
+static void roundTrip(PixelFormat format, size_t width, size_t height, Content content, uint32_t shift) {
+	const size_t rowBytes = width * bytesPerPixel(format);
+	FrameInfo info;
+	info.width = width;
+	info.height = height;
+	info.stride = rowBytes + 8;
+	info.pixelFormat = format;
+	const vector<uint8_t> image = makeImage(format, width, height, info.stride, content, shift,
+		static_cast<uint32_t>(width * 131 + height));
+
+	vector<uint8_t> reference;
+	for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 }) {
+		LosslessCodec codec(2);
+		codec.setSimdLevel(level);
+		if (codec.getSimdLevel() != level) {
+			continue;
+		}
+		vector<uint8_t> encoded(LosslessCodec::maxEncodedSize(info));
+		const size_t size = codec.encode(image.data(), info, encoded.data(), encoded.size());
+		CHECK(size > 0);
+		encoded.resize(size);
+		if (reference.empty()) {
+			reference = encoded;
+		}
+		const bool sameStream = encoded == reference;
+		CHECK(sameStream);
+
+		vector<uint8_t> decoded(height * rowBytes);
+		FrameInfo decodedInfo;
+		CHECK(codec.decode(encoded.data(), encoded.size(), decoded.data(), rowBytes, &decodedInfo));
+		CHECK(decodedInfo.width == width);
+		CHECK(decodedInfo.height == height);
+		CHECK(decodedInfo.pixelFormat == format);
+		const bool same = samePixels(image, info.stride, decoded, rowBytes, rowBytes, height);
+		CHECK(same);
+		if (!sameStream || !same) {
+			cout << "  " << pixelFormatName(format) << " " << width << "x" << height << " shift " << shift
+				 << " " << simdLevelName(level) << endl;
+		}
+	}
+}
+
+static void formatsAndSizes() {
+	const PixelFormat formats[] = { PixelFormat::Mono8, PixelFormat::Mono16, PixelFormat::BayerRG8,
+		PixelFormat::BayerRG16 };
+	const size_t widths[] = { 1, 2, 3, 15, 17, 33, 101, 640 };
+	const size_t heights[] = { 1, 2, 3, 63, 65, 131 };
+	for (PixelFormat format : formats) {
+		for (size_t width : widths) {
+			for (size_t height : heights) {
+				roundTrip(format, width, height, Content::Smooth, 0);
+			}
+		}
+		roundTrip(format, 257, 70, Content::Noise, 0);
+		roundTrip(format, 257, 70, Content::Flat, 0);
+	}
+}
+
+// Left-aligned 10 and 12-bit data: the zero low bits are dropped per stripe.
+static void shiftedSixteenBit() {
+	for (PixelFormat format : { PixelFormat::Mono16, PixelFormat::BayerRG16 }) {
+		for (uint32_t shift : { 4u, 6u, 15u }) {
+			roundTrip(format, 123, 77, Content::Smooth, shift);
+			roundTrip(format, 123, 77, Content::Noise, shift);
+		}
+	}
+}
+
+static void rejectsBadInput() {
+	LosslessCodec codec;
+	FrameInfo info;
+	info.width = 16;
+	info.height = 16;
+	info.stride = 16 * 3;
+	info.pixelFormat = PixelFormat::BGR8;
+	vector<uint8_t> buffer(4096);
+	CHECK(codec.encode(buffer.data(), info, buffer.data(), buffer.size()) == 0);
+	info.pixelFormat = PixelFormat::Mono8;
+	info.stride = 16;
+	vector<uint8_t> small(LosslessCodec::maxEncodedSize(info) - 1);
+	CHECK(codec.encode(buffer.data(), info, small.data(), small.size()) == 0);
+	vector<uint8_t> decoded(256);
+	CHECK(!codec.decode(buffer.data(), 8, decoded.data(), 16));
+}
+
+int main() {
+	formatsAndSizes();
+	shiftedSixteenBit();
+	rejectsBadInput();
+	return checkResult("codecTest");
+}
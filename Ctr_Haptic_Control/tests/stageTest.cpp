@@ -0,0 +1,101 @@
+#include <chrono>
+#include <thread>
+
+#include "check.h"
+#include "ctr.h"
+#include "simMotionController.h"
+#include "stageSampler.h"
+#include "utilities.h"
+
+
+// Polls feedback until x and y are within tolerance of the target.
+static bool settle(IMotionController& motion, double x, double y, double tolerance, chrono::milliseconds timeout) {
+	const auto deadline = chrono::steady_clock::now() + timeout;
+	StageSample sample;
+	while (chrono::steady_clock::now() < deadline) {
+		if (motion.readFeedback(sample) && fabs(sample.x - x) <= tolerance && fabs(sample.y - y) <= tolerance) {
+			return true;
+		}
+		this_thread::sleep_for(chrono::milliseconds(5));
+	}
+	return false;
+}
+
+static void simulatedMoves() {
+	SimMotionController motion{ SimMotionConfig() };
+	CHECK(motion.connect());
+	CHECK(motion.enable());
+	CHECK(motion.moveAbsolute(10.0, -5.0, 0.0, 100.0));
+	CHECK(settle(motion, 10.0, -5.0, 1e-6, chrono::milliseconds(2000)));
+	CHECK(motion.moveIncremental(-2.0, 1.0, 0.0, 100.0));
+	CHECK(settle(motion, 8.0, -4.0, 1e-6, chrono::milliseconds(2000)));
+
+	StageSample before;
+	StageSample after;
+	CHECK(motion.setVelocity(5.0, 0.0, 0.0));
+	this_thread::sleep_for(chrono::milliseconds(50));
+	CHECK(motion.readFeedback(before));
+	const uint64_t start = hostNanos();
+	this_thread::sleep_for(chrono::milliseconds(200));
+	CHECK(motion.readFeedback(after));
+	const double seconds = (hostNanos() - start) / 1e9;
+	CHECK_NEAR((after.x - before.x) / seconds, 5.0, 0.1);
+	CHECK(motion.stop());
+	this_thread::sleep_for(chrono::milliseconds(50));
+	CHECK(motion.readFeedback(before));
+	this_thread::sleep_for(chrono::milliseconds(100));
+	CHECK(motion.readFeedback(after));
+	CHECK_NEAR(after.x, before.x, 1e-9);
+	motion.disconnect();
+}
+
+static void samplerRate() {
+	SimMotionController motion{ SimMotionConfig() };
+	CHECK(motion.connect());
+	CHECK(motion.enable());
+	CHECK(motion.setVelocity(1.0, 0.0, 0.0));
+	StageSamplerConfig config;
+	config.rate = 1000.0;
+	StageSampler sampler(motion, config);
+	sampler.startSampling();
+	this_thread::sleep_for(chrono::milliseconds(500));
+	sampler.stopSampling();
+
+	const StageSamplerStats stats = sampler.getStats();
+	CHECK_NEAR(stats.achievedRate, 1000.0, 50.0);
+	CHECK(stats.samples > 450);
+	CHECK(stats.samplesDropped == 0);
+	CHECK(stats.queryErrors == 0);
+
+	uint64_t popped = 0;
+	bool ordered = true;
+	StageSample previous;
+	StageSample sample;
+	while (sampler.tryPopSample(sample)) {
+		ordered = ordered && (popped == 0 || (sample.hostTimestamp > previous.hostTimestamp && sample.x >= previous.x));
+		previous = sample;
+		popped++;
+	}
+	CHECK(popped == stats.samples);
+	CHECK(ordered);
+}
+
+// Ctr drives the A3200 by default; here that is the stand-in.
+static void ctrOnStandin() {
+	Ctr ctr;
+	CHECK(ctr.getMotionController() != nullptr);
+	CHECK(ctr.getStageSampler() != nullptr);
+	if (!ctr.getMotionController()) {
+		return;
+	}
+	IMotionController& motion = *ctr.getMotionController();
+	CHECK(motion.moveAbsolute(1.0, 2.0, 0.0, 100.0));
+	CHECK(settle(motion, 1.0, 2.0, 1e-6, chrono::milliseconds(2000)));
+}
+
+int main() {
+	simulatedMoves();
+	samplerRate();
+	ctrOnStandin();
+	return checkResult("stageTest");
+}
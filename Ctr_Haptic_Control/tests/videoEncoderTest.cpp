@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "videoEncoder.h"
+
+
+static const size_t WIDTH = 64;
+static const size_t HEIGHT = 48;
+// Rows are padded so the encoder has to pack them.
+static const size_t STRIDE = WIDTH + 8;
+static const size_t FRAME_BYTES = WIDTH * HEIGHT;
+
+// Mono8 frames whose pixels encode the frame number, backed by buffers
+// the test owns.
+struct Frames {
+	FramePool pool;
+	vector<vector<uint8_t>> buffers;
+
+	explicit Frames(size_t count) :
+		pool{ count, nullptr },
+		buffers(count, vector<uint8_t>(STRIDE * HEIGHT))
+	{
+		for (size_t i = 0; i < count; i++) {
+			for (size_t y = 0; y < HEIGHT; y++) {
+				for (size_t x = 0; x < STRIDE; x++) {
+					buffers[i][y * STRIDE + x] = x < WIDTH ? static_cast<uint8_t>(i * 7 + x + y) : 0xEE;
+				}
+			}
+		}
+	}
+
+	Frame make(size_t i) {
+		FrameInfo info;
+		info.width = WIDTH;
+		info.height = HEIGHT;
+		info.stride = STRIDE;
+		info.pixelFormat = PixelFormat::Mono8;
+		info.frameId = i;
+		return pool.acquire(buffers[i].data(), buffers[i].size(), info);
+	}
+
+	// Frame i as the backend should have stored it.
+	vector<uint8_t> packed(size_t i) const {
+		vector<uint8_t> rows;
+		for (size_t y = 0; y < HEIGHT; y++) {
+			rows.insert(rows.end(), buffers[i].begin() + y * STRIDE, buffers[i].begin() + y * STRIDE + WIDTH);
+		}
+		return rows;
+	}
+};
+
+static vector<uint8_t> readFile(const string& path) {
+	ifstream file(path, ios::binary);
+	return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static string filePath(const string& prefix, size_t index) {
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "-%04zu.raw", index);
+	return prefix + suffix;
+}
+
+// Holds the encoder thread inside append() until released, so the queue
+// can be filled deterministically.
+class GatedBackend : public IVideoBackend {
+
+private:
+	RawVideoBackend raw;
+	atomic<bool>& released;
+	atomic<int>& appending;
+
+public:
+	GatedBackend(atomic<bool>& released_, atomic<int>& appending_) :
+		released(released_),
+		appending(appending_)
+	{}
+
+	bool open(const string& path, const FrameInfo& info, const VideoOptions& options) override {
+		return raw.open(path, info, options);
+	}
+
+	bool append(const uint8_t* pixels, const FrameInfo& info) override {
+		appending++;
+		while (!released) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		return raw.append(pixels, info);
+	}
+
+	void close() override {
+		raw.close();
+	}
+
+	uint64_t fileBytes() const override {
+		return raw.fileBytes();
+	}
+
+	string currentPath() const override {
+		return raw.currentPath();
+	}
+};
+
+static VideoEncoderConfig encoderConfig(const string& prefix) {
+	VideoEncoderConfig config;
+	config.prefix = prefix;
+	config.options.codec = VideoCodec::Uncompressed;
+	config.options.outputFormat = PixelFormat::Mono8;
+	return config;
+}
+
+static void encodesPackedFrames() {
+	const string prefix = "videoEncoderTest-encode";
+	Frames frames(10);
+	VideoEncoder encoder(encoderConfig(prefix), make_unique<RawVideoBackend>());
+	encoder.start();
+	for (size_t i = 0; i < frames.buffers.size(); i++) {
+		CHECK(encoder.submit(frames.make(i)));
+	}
+	encoder.stop();
+
+	const VideoEncoderStats stats = encoder.getStats();
+	CHECK(stats.framesSubmitted == 10);
+	CHECK(stats.framesEncoded == 10);
+	CHECK(stats.framesDropped == 0);
+	CHECK(stats.framesFailed == 0);
+	CHECK(stats.filesWritten == 1);
+	CHECK(stats.bytesWritten == 10 * FRAME_BYTES);
+	CHECK(stats.currentPath == filePath(prefix, 0));
+
+	const vector<uint8_t> file = readFile(filePath(prefix, 0));
+	CHECK(file.size() == 10 * FRAME_BYTES);
+	if (file.size() == 10 * FRAME_BYTES) {
+		for (size_t i = 0; i < 10; i++) {
+			const vector<uint8_t> expected = frames.packed(i);
+			CHECK(equal(expected.begin(), expected.end(), file.begin() + i * FRAME_BYTES));
+		}
+	}
+	remove(filePath(prefix, 0).c_str());
+}
+
+// A file is closed once it has reached maxFileBytes, so each holds three
+// frames and the tenth starts a fourth file.
+static void rollsOverAtMaxFileBytes() {
+	const string prefix = "videoEncoderTest-rollover";
+	Frames frames(10);
+	VideoEncoderConfig config = encoderConfig(prefix);
+	config.maxFileBytes = 3 * FRAME_BYTES;
+	VideoEncoder encoder(config, make_unique<RawVideoBackend>());
+	encoder.start();
+	for (size_t i = 0; i < frames.buffers.size(); i++) {
+		CHECK(encoder.submit(frames.make(i)));
+	}
+	encoder.stop();
+
+	const VideoEncoderStats stats = encoder.getStats();
+	CHECK(stats.framesEncoded == 10);
+	CHECK(stats.filesWritten == 4);
+	CHECK(stats.bytesWritten == 10 * FRAME_BYTES);
+	CHECK(stats.currentPath == filePath(prefix, 3));
+	const size_t framesInFile[] = { 3, 3, 3, 1 };
+	size_t frame = 0;
+	for (size_t index = 0; index < 4; index++) {
+		const vector<uint8_t> file = readFile(filePath(prefix, index));
+		CHECK(file.size() == framesInFile[index] * FRAME_BYTES);
+		for (size_t i = 0; i < framesInFile[index] && file.size() == framesInFile[index] * FRAME_BYTES; i++, frame++) {
+			const vector<uint8_t> expected = frames.packed(frame);
+			CHECK(equal(expected.begin(), expected.end(), file.begin() + i * FRAME_BYTES));
+		}
+		remove(filePath(prefix, index).c_str());
+	}
+}
+
+// With the encoder stuck on the first frame, the queue takes exactly
+// queueCapacity more and the rest are dropped without blocking the caller.
+static void dropsWhenQueueFull() {
+	const string prefix = "videoEncoderTest-drop";
+	const size_t capacity = 4;
+	Frames frames(capacity + 4);
+	atomic<bool> released{ false };
+	atomic<int> appending{ 0 };
+	VideoEncoderConfig config = encoderConfig(prefix);
+	config.queueCapacity = capacity;
+	VideoEncoder encoder(config, make_unique<GatedBackend>(released, appending));
+
+	// Not started yet, so refused and counted as dropped.
+	CHECK(!encoder.submit(frames.make(0)));
+	encoder.start();
+	CHECK(encoder.submit(frames.make(0)));
+	const auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+	while (appending == 0 && chrono::steady_clock::now() < deadline) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	CHECK(appending == 1);
+	for (size_t i = 1; i <= capacity; i++) {
+		CHECK(encoder.submit(frames.make(i)));
+	}
+	for (size_t i = capacity + 1; i < frames.buffers.size(); i++) {
+		CHECK(!encoder.submit(frames.make(i)));
+	}
+	VideoEncoderStats stats = encoder.getStats();
+	CHECK(stats.queueDepth == capacity);
+	CHECK(stats.peakQueueDepth == capacity);
+	CHECK(stats.framesDropped == 4);
+
+	released = true;
+	encoder.stop();
+	stats = encoder.getStats();
+	CHECK(stats.framesSubmitted == capacity + 5);
+	CHECK(stats.framesEncoded == capacity + 1);
+	CHECK(stats.framesDropped == 4);
+	CHECK(stats.queueDepth == 0);
+	const vector<uint8_t> file = readFile(filePath(prefix, 0));
+	CHECK(file.size() == (capacity + 1) * FRAME_BYTES);
+	remove(filePath(prefix, 0).c_str());
+}
+
+int main() {
+	encodesPackedFrames();
+	rollsOverAtMaxFileBytes();
+	dropsWhenQueueFull();
+	return checkResult("videoEncoderTest");
+}
@@ -1,5 +1,11 @@
 #pragma once
 
-void collectData() {
+#include <chrono>
+#include <cstdint>
 
-}
\ No newline at end of file
+// Host monotonic clock in nanoseconds; the common time base for frames and
+// stage samples.
+inline uint64_t hostNanos() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
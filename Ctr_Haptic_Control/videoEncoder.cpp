@@ -0,0 +1,200 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "utilities.h"
+#include "videoEncoder.h"
+
+
+RawVideoBackend::RawVideoBackend() :
+	bytes{ 0 }
+{}
+
+bool RawVideoBackend::open(const string& path_, const FrameInfo& info, const VideoOptions& options) {
+	(void)info;
+	(void)options;
+	close();
+	path = path_ + ".raw";
+	file.open(path, ios::binary | ios::trunc);
+	bytes = 0;
+	return static_cast<bool>(file);
+}
+
+bool RawVideoBackend::append(const uint8_t* pixels, const FrameInfo& info) {
+	const size_t size = info.width * bytesPerPixel(info.pixelFormat) * info.height;
+	file.write(reinterpret_cast<const char*>(pixels), size);
+	if (!file) {
+		return false;
+	}
+	bytes += size;
+	return true;
+}
+
+void RawVideoBackend::close() {
+	if (file.is_open()) {
+		file.close();
+	}
+}
+
+uint64_t RawVideoBackend::fileBytes() const {
+	return bytes;
+}
+
+string RawVideoBackend::currentPath() const {
+	return path;
+}
+
+
+VideoEncoder::VideoEncoder(const VideoEncoderConfig& config_, unique_ptr<IVideoBackend> backend_) :
+	config{ config_ },
+	backend{ move(backend_) },
+	queue{ config.queueCapacity },
+	running{ false },
+	fileOpen{ false },
+	fileIndex{ 0 },
+	closedBytes{ 0 },
+	submitted{ 0 },
+	encoded{ 0 },
+	dropped{ 0 },
+	failed{ 0 },
+	files{ 0 },
+	bytesWritten{ 0 },
+	encodeNanos{ 0 },
+	peakDepth{ 0 }
+{}
+
+VideoEncoder::~VideoEncoder() {
+	stop();
+}
+
+void VideoEncoder::closeFile() {
+	if (!fileOpen) {
+		return;
+	}
+	backend->close();
+	closedBytes += backend->fileBytes();
+	bytesWritten = closedBytes;
+	fileOpen = false;
+}
+
+void VideoEncoder::encode(const Frame& frame) {
+	const uint64_t begin = hostNanos();
+	FrameInfo info = frame.info();
+	const uint8_t* pixels = frame.data();
+	size_t stride = info.stride;
+	if (config.options.outputFormat != PixelFormat::Unknown && config.options.outputFormat != info.pixelFormat) {
+		pixels = frame.converted(config.options.outputFormat);
+		stride = frame.convertedStride(config.options.outputFormat);
+		info.pixelFormat = config.options.outputFormat;
+	}
+	if (!pixels) {
+		failed++;
+		return;
+	}
+	// Backends take packed rows.
+	const size_t rowBytes = info.width * bytesPerPixel(info.pixelFormat);
+	if (stride != rowBytes) {
+		packed.resize(rowBytes * info.height);
+		for (size_t y = 0; y < info.height; y++) {
+			memcpy(packed.data() + y * rowBytes, pixels + y * stride, rowBytes);
+		}
+		pixels = packed.data();
+	}
+	info.stride = rowBytes;
+
+	if (fileOpen && backend->fileBytes() >= config.maxFileBytes) {
+		closeFile();
+	}
+	if (!fileOpen) {
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), "-%04llu", static_cast<unsigned long long>(fileIndex++));
+		if (!backend->open(config.prefix + suffix, info, config.options)) {
+			cout << "Error: unable to open video " << config.prefix + suffix << "." << endl;
+			failed++;
+			return;
+		}
+		fileOpen = true;
+		files++;
+		lock_guard<mutex> guard(pathLock);
+		path = backend->currentPath();
+	}
+	if (backend->append(pixels, info)) {
+		encoded++;
+	}
+	else {
+		failed++;
+	}
+	bytesWritten = closedBytes + backend->fileBytes();
+	encodeNanos += hostNanos() - begin;
+}
+
+void VideoEncoder::encodeLoop() {
+	Frame frame;
+	while (running) {
+		if (!queue.tryPop(frame)) {
+			this_thread::sleep_for(chrono::microseconds(500));
+			continue;
+		}
+		encode(frame);
+		frame.reset();
+	}
+	while (queue.tryPop(frame)) {
+		encode(frame);
+		frame.reset();
+	}
+	closeFile();
+}
+
+void VideoEncoder::start() {
+	if (running) {
+		return;
+	}
+	running = true;
+	encodeThread = thread(&VideoEncoder::encodeLoop, this);
+}
+
+void VideoEncoder::stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	if (encodeThread.joinable()) {
+		encodeThread.join();
+	}
+}
+
+bool VideoEncoder::isRunning() const {
+	return running;
+}
+
+bool VideoEncoder::submit(const Frame& frame) {
+	submitted++;
+	Frame copy = frame;
+	if (!running || !queue.tryPush(move(copy))) {
+		dropped++;
+		return false;
+	}
+	const size_t depth = queue.size();
+	if (depth > peakDepth.load(memory_order_relaxed)) {
+		peakDepth.store(depth, memory_order_relaxed);
+	}
+	return true;
+}
+
+VideoEncoderStats VideoEncoder::getStats() const {
+	VideoEncoderStats stats;
+	stats.framesSubmitted = submitted;
+	stats.framesEncoded = encoded;
+	stats.framesDropped = dropped;
+	stats.framesFailed = failed;
+	stats.filesWritten = files;
+	stats.bytesWritten = bytesWritten;
+	if (encodeNanos > 0) {
+		stats.encodeFps = stats.framesEncoded * 1e9 / encodeNanos;
+	}
+	stats.queueDepth = queue.size();
+	stats.peakQueueDepth = peakDepth;
+	lock_guard<mutex> guard(pathLock);
+	stats.currentPath = path;
+	return stats;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "ringBuffer.h"
+
+using namespace std;
+
+
+enum class VideoCodec {
+	Uncompressed,
+	Mjpg,
+	H264
+};
+
+struct VideoOptions {
+	VideoCodec codec = VideoCodec::Mjpg;
+	float frameRate = 30.0f;
+	// MJPG only, 1-100.
+	unsigned int quality = 75;
+	// H264 only, bits per second.
+	unsigned int bitrate = 1000000;
+	// Frames are converted to this before encoding; Unknown keeps the
+	// camera's format.
+	PixelFormat outputFormat = PixelFormat::Mono8;
+};
+
+// Where encoded frames go. Called from the encoder thread only.
+class IVideoBackend {
+
+public:
+	virtual ~IVideoBackend() = default;
+
+	// path has no extension; the backend adds its own.
+	virtual bool open(const string& path, const FrameInfo& info, const VideoOptions& options) = 0;
+	// pixels are packed rows in info.pixelFormat.
+	virtual bool append(const uint8_t* pixels, const FrameInfo& info) = 0;
+	virtual void close() = 0;
+	// Size of the file currently open, in bytes.
+	virtual uint64_t fileBytes() const = 0;
+	virtual string currentPath() const = 0;
+};
+
+// Writes packed frames back to back to a .raw file, the layout SimCamera's
+// Replay pattern plays. Needs no SDK, so the encoder can be exercised and
+// tested anywhere.
+class RawVideoBackend : public IVideoBackend {
+
+private:
+	ofstream file;
+	string path;
+	uint64_t bytes;
+
+public:
+	RawVideoBackend();
+
+	bool open(const string& path_, const FrameInfo& info, const VideoOptions& options) override;
+	bool append(const uint8_t* pixels, const FrameInfo& info) override;
+	void close() override;
+	uint64_t fileBytes() const override;
+	string currentPath() const override;
+};
+
+struct VideoEncoderConfig {
+	// Files are named <prefix>-0000, <prefix>-0001, ... plus the backend's
+	// extension.
+	string prefix;
+	VideoOptions options;
+	// Frames waiting for the encoder. A full queue drops the frame.
+	size_t queueCapacity = 32;
+	// Start a new file once the current one reaches this size.
+	uint64_t maxFileBytes = 1ull << 31;
+};
+
+struct VideoEncoderStats {
+	uint64_t framesSubmitted = 0;
+	uint64_t framesEncoded = 0;
+	// Refused because the queue was full.
+	uint64_t framesDropped = 0;
+	// Frames the backend or the conversion rejected.
+	uint64_t framesFailed = 0;
+	uint64_t filesWritten = 0;
+	uint64_t bytesWritten = 0;
+	// Frames over time spent converting and encoding.
+	double encodeFps = 0.0;
+	size_t queueDepth = 0;
+	size_t peakQueueDepth = 0;
+	string currentPath;
+};
+
+// Streams frames into video files from a background thread. Memory is
+// bounded by the queue: submit() hands over a Frame reference and never
+// blocks, and a frame that does not fit is dropped and counted, unlike
+// collecting every image before writing the video. Files roll over at
+// maxFileBytes.
+class VideoEncoder {
+
+private:
+	VideoEncoderConfig config;
+	unique_ptr<IVideoBackend> backend;
+	RingBuffer<Frame> queue;
+	vector<uint8_t> packed;
+
+	thread encodeThread;
+	atomic<bool> running;
+	bool fileOpen;
+	uint64_t fileIndex;
+	uint64_t closedBytes;
+
+	atomic<uint64_t> submitted;
+	atomic<uint64_t> encoded;
+	atomic<uint64_t> dropped;
+	atomic<uint64_t> failed;
+	atomic<uint64_t> files;
+	atomic<uint64_t> bytesWritten;
+	atomic<uint64_t> encodeNanos;
+	atomic<size_t> peakDepth;
+	mutable mutex pathLock;
+	string path;
+
+	void closeFile();
+	void encode(const Frame& frame);
+	void encodeLoop();
+
+public:
+	VideoEncoder(const VideoEncoderConfig& config_, unique_ptr<IVideoBackend> backend_);
+	~VideoEncoder();
+	VideoEncoder(const VideoEncoder&) = delete;
+	VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+	void start();
+	// Encodes what is still queued, then closes the file.
+	void stop();
+	bool isRunning() const;
+
+	// One producer thread. Returns false when the frame was dropped.
+	bool submit(const Frame& frame);
+
+	VideoEncoderStats getStats() const;
+};
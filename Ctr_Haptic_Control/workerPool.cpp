@@ -0,0 +1,79 @@
+#include "workerPool.h"
+
+
+WorkerPool::WorkerPool(size_t threads) :
+	threadCount{ threads > 0 ? threads : 1 },
+	task{ nullptr },
+	context{ nullptr },
+	taskCount{ 0 },
+	nextTask{ 0 },
+	generation{ 0 },
+	pending{ 0 },
+	stopping{ false }
+{
+	for (size_t i = 1; i < threadCount; i++) {
+		workers.emplace_back(&WorkerPool::workerLoop, this);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void WorkerPool::runTasks() {
+	for (size_t i = nextTask++; i < taskCount; i = nextTask++) {
+		task(context, i);
+	}
+}
+
+void WorkerPool::workerLoop() {
+	uint64_t seen = 0;
+	unique_lock<mutex> guard(lock);
+	for (;;) {
+		wake.wait(guard, [&] { return stopping || generation != seen; });
+		if (stopping) {
+			return;
+		}
+		seen = generation;
+		guard.unlock();
+		runTasks();
+		guard.lock();
+		if (--pending == 0) {
+			done.notify_one();
+		}
+	}
+}
+
+void WorkerPool::run(size_t count, void (*task_)(void* context, size_t index), void* context_) {
+	if (workers.empty() || count <= 1) {
+		for (size_t i = 0; i < count; i++) {
+			task_(context_, i);
+		}
+		return;
+	}
+	lock_guard<mutex> running(runLock);
+	{
+		lock_guard<mutex> guard(lock);
+		task = task_;
+		context = context_;
+		taskCount = count;
+		nextTask = 0;
+		pending = workers.size();
+		generation++;
+	}
+	wake.notify_all();
+	runTasks();
+	unique_lock<mutex> guard(lock);
+	done.wait(guard, [&] { return pending == 0; });
+}
+
+size_t WorkerPool::getThreadCount() const {
+	return threadCount;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+// Persistent threads that split one call's work into independent tasks.
+// The calling thread takes tasks too, so a pool of n threads starts n - 1
+// workers and a pool of 1 runs everything inline. Calls to run() from
+// different threads are serialized.
+class WorkerPool {
+
+private:
+	size_t threadCount;
+	vector<thread> workers;
+	mutex runLock;
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+
+	void (*task)(void* context, size_t index);
+	void* context;
+	size_t taskCount;
+	atomic<size_t> nextTask;
+	uint64_t generation;
+	size_t pending;
+	bool stopping;
+
+	void runTasks();
+	void workerLoop();
+
+public:
+	explicit WorkerPool(size_t threads);
+	~WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Calls task_(context_, i) for every i in [0, count) and returns once
+	// all of them have finished.
+	void run(size_t count, void (*task_)(void* context, size_t index), void* context_);
+	size_t getThreadCount() const;
+};